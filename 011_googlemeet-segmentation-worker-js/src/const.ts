@@ -17,6 +17,7 @@ export const PostProcessTypes = {
     softmax: 1,
     jbf: 2,
     softmax_jbf: 3,
+    softmax_guided: 4,
 } as const;
 export type PostProcessTypes = typeof PostProcessTypes[keyof typeof PostProcessTypes];
 export const InterpolationTypes = {
@@ -70,9 +71,11 @@ export enum GoogleMeetSegmentationSmoothingType {
 }
 
 export interface TFLite extends EmscriptenModule {
+    _initModelBuffer(size: number): number;
     _getModelBufferMemoryOffset(): number;
     _loadModel(bufferSize: number): number;
 
+    _initInputImageBuffer(width: number, height: number): number;
     _getInputImageBufferOffset(): number;
     _getJbfGuideImageBufferOffset(): number;
     _getJbfInputImageBufferOffset(): number;
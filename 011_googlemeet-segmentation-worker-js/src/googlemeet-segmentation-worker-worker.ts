@@ -10,6 +10,7 @@ let config: GoogleMeetSegmentationConfig | null = null
 
 const predict = async (config: GoogleMeetSegmentationConfig, params: GoogleMeetSegmentationOperationParams, data: Uint8ClampedArray) => {
     const imageData = new ImageData(data, params.processWidth, params.processHeight);
+    tfliteModel!._initInputImageBuffer(imageData.width, imageData.height);
     const inputImageBufferOffset = tfliteModel!._getInputImageBufferOffset();
     tfliteModel!.HEAPU8.set(imageData.data, inputImageBufferOffset);
 
@@ -37,8 +38,9 @@ onmessage = async (event) => {
             const b = Buffer.from(config.wasmBase64!, "base64");
             tfliteModel = await mod({ wasmBinary: b });
         }
-        const modelBufferOffset = tfliteModel!._getModelBufferMemoryOffset();
         const tfliteModelData = Buffer.from(config.modelTFLites[config.modelKey], "base64");
+        tfliteModel!._initModelBuffer(tfliteModelData.byteLength);
+        const modelBufferOffset = tfliteModel!._getModelBufferMemoryOffset();
         tfliteModel!.HEAPU8.set(new Uint8Array(tfliteModelData), modelBufferOffset);
         tfliteModel!._loadModel(tfliteModelData.byteLength);
         ready = true;
@@ -146,8 +146,9 @@ export class LocalGM extends LocalWorker {
             const b = Buffer.from(config.wasmBase64!, "base64");
             this.tfliteModel = await mod({ wasmBinary: b });
         }
-        const modelBufferOffset = this.tfliteModel!._getModelBufferMemoryOffset();
         const tfliteModel = Buffer.from(config.modelTFLites[config.modelKey], "base64");
+        this.tfliteModel!._initModelBuffer(tfliteModel.byteLength);
+        const modelBufferOffset = this.tfliteModel!._getModelBufferMemoryOffset();
         this.tfliteModel!.HEAPU8.set(new Uint8Array(tfliteModel), modelBufferOffset);
         this.tfliteModel!._loadModel(tfliteModel.byteLength);
 
@@ -163,6 +164,7 @@ export class LocalGM extends LocalWorker {
         }
 
         const imageData = targetCanvas.getContext("2d")!.getImageData(0, 0, targetCanvas.width, targetCanvas.height);
+        this.tfliteModel!._initInputImageBuffer(imageData.width, imageData.height);
         const inputImageBufferOffset = this.tfliteModel!._getInputImageBufferOffset();
         this.tfliteModel!.HEAPU8.set(imageData.data, inputImageBufferOffset);
         this.tfliteModel!._exec_with_jbf(imageData.width, imageData.height, params.jbfD, params.jbfSigmaC, params.jbfSigmaS, params.jbfPostProcess, params.interpolation, params.threshold);
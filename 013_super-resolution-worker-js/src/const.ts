@@ -56,12 +56,22 @@ export const InterpolationTypes = {
 export type InterpolationTypes = typeof InterpolationTypes[keyof typeof InterpolationTypes];
 
 export interface TFLite extends EmscriptenModule {
+    _initModelBuffer(size: number): number;
     _getModelBufferMemoryOffset(): number;
+    _initInputImageBuffer(width: number, height: number, scale: number): number;
     _getInputImageBufferOffset(): number;
     _getOutputImageBufferOffset(): number;
 
     _loadModel(bufferSize: number): number;
     _exec(widht: number, height: number, interpolationType: number): number;
+    _setTileSize(tileSize: number, overlap: number): number;
+    _setInterpreterCacheSize(size: number): number;
+    _getInterpreterCacheHits(): number;
+    _getInterpreterCacheMisses(): number;
+    _getTensorType(): number; // 1: float32, 3: uint8, 9: int8
+    _getEspcnThroughput(): number; // output Mpixel/s
+    _resetEspcnThroughput(): number;
+    _setInputFormat(format: number): number; // 0: RGBA, 1: I420, 2: NV12
 
     _extractY(width: number, height: number): number;
     _mergeY(width: number, height: number, scaled_width: number, scaled_height: number): number;
@@ -32,6 +32,7 @@ const predict = async (config: SuperResolutionConfig, params: SuperResolutionOpe
     }
 
     const imageData = new ImageData(data, params.processWidth, params.processHeight);
+    tflite!._initInputImageBuffer(params.processWidth, params.processHeight, config.scaleFactor[config.modelKey]);
 
     if (config.useTFJS && params.interpolation === InterpolationTypes.INTER_ESPCN) {
         tflite!.HEAPU8.set(imageData.data, tflite!._getInputImageBufferOffset());
@@ -120,8 +121,9 @@ onmessage = async (event) => {
             const b = Buffer.from(config.wasmBase64!, "base64");
             tflite = await mod({ wasmBinary: b });
         }
-        const modelBufferOffset = tflite!._getModelBufferMemoryOffset();
         const tfliteModel = Buffer.from(config.modelTFLite[config.modelKey], "base64");
+        tflite!._initModelBuffer(tfliteModel.byteLength);
+        const modelBufferOffset = tflite!._getModelBufferMemoryOffset();
         tflite!.HEAPU8.set(new Uint8Array(tfliteModel), modelBufferOffset);
         tflite!._loadModel(tfliteModel.byteLength);
         ready = true;
@@ -150,8 +150,9 @@ export class LocalSR extends LocalWorker {
             const b = Buffer.from(config.wasmBase64!, "base64");
             this.tflite = await mod({ wasmBinary: b });
         }
-        const modelBufferOffset = this.tflite!._getModelBufferMemoryOffset();
         const tfliteModel = Buffer.from(config.modelTFLite[config.modelKey], "base64");
+        this.tflite!._initModelBuffer(tfliteModel.byteLength);
+        const modelBufferOffset = this.tflite!._getModelBufferMemoryOffset();
         this.tflite!.HEAPU8.set(new Uint8Array(tfliteModel), modelBufferOffset);
         this.tflite!._loadModel(tfliteModel.byteLength);
 
@@ -168,6 +169,7 @@ export class LocalSR extends LocalWorker {
         }
 
         const imageData = targetCanvas.getContext("2d")!.getImageData(0, 0, targetCanvas.width, targetCanvas.height);
+        this.tflite!._initInputImageBuffer(params.processWidth, params.processHeight, config.scaleFactor[config.modelKey]);
         if (config.useTFJS && params.interpolation === InterpolationTypes.INTER_ESPCN) {
             // EXTRACT Y with WASM(TFLITE)
             this.tflite!.HEAPU8.set(imageData.data, this.tflite!._getInputImageBufferOffset());
@@ -1,6 +1,6 @@
 import React, { useEffect, useState } from "react";
 import "./App.css";
-import useTFLite from "./hooks/useTFLite";
+import useTFLite, { MAX_NUM_THREADS } from "./hooks/useTFLite";
 import { makeStyles } from "@material-ui/core";
 import { useVideoInputList } from "./hooks/useVideoInputList";
 import { VideoInputType } from "./const";
@@ -46,7 +46,7 @@ const useStyles = makeStyles((theme) => ({
 
 const App = () => {
     const classes = useStyles();
-    const { tflite, tfliteSIMD, setModelPath } = useTFLite();
+    const { tflite, tfliteSIMD, tfliteSIMDThreads, numThreads, setNumThreads, setModelPath } = useTFLite();
     const { videoInputList } = useVideoInputList();
     // const {setTFLite, setSrc, setDst, setProcessSize} = usePipeline()
 
@@ -175,12 +175,16 @@ const App = () => {
         const resizedResultCtx = resizedResult.getContext("2d")!;
         const dstCtx = dst.getContext("2d")!;
 
+        // mean inference time of this loop, for comparing thread counts
+        let inferenceTotal = 0;
+        let inferenceCount = 0;
         const render = () => {
             console.log("RENDER::::", LOOP_ID);
             const start2 = performance.now();
             let currentTFLite;
             if (useSIMD) {
-                currentTFLite = tfliteSIMD;
+                // pthreads build when the page is cross-origin isolated (see useTFLite)
+                currentTFLite = tfliteSIMDThreads || tfliteSIMD;
             } else {
                 currentTFLite = tflite;
             }
@@ -196,6 +200,7 @@ const App = () => {
 
                 /// データインプット
                 const imageData = dataCtx.getImageData(0, 0, data.width, data.height);
+                currentTFLite._initInputImageBuffer(data.width, data.height);
                 const inputImageBufferOffset = currentTFLite._getInputImageBufferOffset();
                 currentTFLite.HEAPU8.set(imageData.data, inputImageBufferOffset);
 
@@ -206,6 +211,8 @@ const App = () => {
 
                 const end = performance.now();
                 const duration = end - start;
+                inferenceTotal += duration;
+                inferenceCount += 1;
                 /////infoDiv.innerText = `MS: ${duration}`
 
                 /// データ取得
@@ -235,7 +242,8 @@ const App = () => {
                 const end2 = performance.now();
                 const duration2 = end2 - start2;
                 const info = document.getElementById("info") as HTMLCanvasElement;
-                info.innerText = `inference time: ${duration}`;
+                const threadsInfo = useSIMD && tfliteSIMDThreads ? `threads: ${numThreads}` : "threads: 1";
+                info.innerText = `inference time: ${duration} (mean ${(inferenceTotal / inferenceCount).toFixed(2)} over ${inferenceCount} frames, ${threadsInfo})`;
                 const info2 = document.getElementById("info2") as HTMLCanvasElement;
                 info2.innerText = `processing time: ${duration2}`;
             } else {
@@ -247,7 +255,7 @@ const App = () => {
         return () => {
             cancelAnimationFrame(renderRequestId);
         };
-    }, [tflite, tfliteSIMD, processSizeKey, inputMedia, useSIMD, lightWrapping, strict, jbfD, jbfSigmaC, jbfSigmaS, jbfPostProcess, interpolation, threshold]); // eslint-disable-line
+    }, [tflite, tfliteSIMD, tfliteSIMDThreads, numThreads, processSizeKey, inputMedia, useSIMD, lightWrapping, strict, jbfD, jbfSigmaC, jbfSigmaS, jbfPostProcess, interpolation, threshold]); // eslint-disable-line
 
     ///////////////
     // Render    //
@@ -264,6 +272,7 @@ const App = () => {
                     <DropDown title="model" current={modelKey} onchange={setModelKey} options={models} />
                     <DropDown title="ProcessSize" current={processSizeKey} onchange={setProcessSizeKey} options={processSize} />
                     <Toggle title="SIMD" current={useSIMD} onchange={setUseSIMD} />
+                    <SingleValueSlider title="threads(SIMD)" current={numThreads} onchange={setNumThreads} min={1} max={MAX_NUM_THREADS} step={1} />
                     <SingleValueSlider title="jbfPostProcess" current={jbfPostProcess} onchange={setJbfPostProcess} min={0} max={3} step={1} />
                     <SingleValueSlider title="jbfD" current={jbfD} onchange={setJbfD} min={0} max={20} step={1} />
                     <SingleValueSlider title="jbfSigmaC" current={jbfSigmaC} onchange={setJbfSigmaC} min={0} max={20} step={1} />
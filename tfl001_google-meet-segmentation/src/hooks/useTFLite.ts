@@ -1,28 +1,79 @@
-import { useEffect, useState } from "react";
+import { useEffect, useRef, useState } from "react";
 import { BrowserType, getBrowserType } from "../BrowserUtil";
 
 declare function createTFLiteModule(): Promise<TFLite>;
 declare function createTFLiteSIMDModule(): Promise<TFLite>;
+declare function createTFLiteSIMDThreadsModule(): Promise<TFLite>;
+
+export const MAX_NUM_THREADS = 4; // MAX_NUM_THREADS of tflite.cc
+
+// The pthreads build needs SharedArrayBuffer, which only a cross-origin isolated page has (COOP / COEP headers,
+// see setupProxy.js for the dev server).
+const isCrossOriginIsolated = () => {
+    return (window as Window & { crossOriginIsolated?: boolean }).crossOriginIsolated === true;
+};
+
+// tflite-simd-threads.js is not in index.html: it exists only after build_wasm_simd_threads and is useless without
+// cross-origin isolation.
+const loadThreadsScript = () => {
+    return new Promise<void>((resolve, reject) => {
+        const script = document.createElement("script");
+        script.src = `${process.env.PUBLIC_URL}/tflite/tflite-simd-threads.js`;
+        script.onload = () => resolve();
+        script.onerror = () => reject(new Error("tflite-simd-threads.js is not available"));
+        document.head.appendChild(script);
+    });
+};
 
 export interface TFLite extends EmscriptenModule {
     /// TFLite Model Properties
+    _initModelBuffer(size: number): number;
     _getModelBufferMemoryOffset(): number;
     _loadModel(bufferSize: number): number;
 
+    _initInputImageBuffer(width: number, height: number): number;
+    _getReservedBufferSize(): number;
     _getInputImageBufferOffset(): number;
     _getOutputImageBufferOffset(): number;
     _exec_with_jbf(widht: number, height: number, d: number, sigmaColor: number, sigmaSpace: number, postProcessType: number, interpolation: number, threshold: number): number;
+    _setInputFormat(format: number): number; // 0: RGBA, 1: I420, 2: NV12
+
+    /// Threads (tflite-simd-threads only)
+    _setNumThreads(numThreads: number): number;
+
+    /// Composite
+    _setComposite(mode: number, blurLevel: number): number;
+    _getBackgroundImageBufferOffset(): number;
+
+    /// Motion gate
+    _setMotionGate(enable: number, threshold: number, keyframeInterval: number, useWarp: number): number;
+    _getMotionGateSkippedFrames(): number;
+    _getMotionGateInvokedFrames(): number;
+    _resetMotionGateCounters(): number;
+
+    /// Refinement benchmark
+    _benchmarkRefinement(width: number, height: number, iterations: number): number;
+    _getBenchmarkResultBufferOffset(): number;
+
+    /// Stage timing ([frame, stage, msec] records, build with -DENABLE_STAGE_TIMING)
+    _getTimingBufferAddress(): number;
+    _getTimingCount(): number;
 }
 
 function useTFLite() {
     const [tflite, setTFLite] = useState<TFLite>();
     const [tfliteSIMD, setTFLiteSIMD] = useState<TFLite>();
+    const [tfliteSIMDThreads, setTFLiteSIMDThreads] = useState<TFLite>();
     const [modelPath, setModelPath] = useState<string>();
+    const [numThreads, setNumThreads] = useState<number>(Math.min(MAX_NUM_THREADS, navigator.hardwareConcurrency || 1));
+    // created once: each module starts its own web workers (PTHREAD_POOL_SIZE)
+    const threadsModule = useRef<Promise<TFLite>>();
 
     const loadModel = async (t: TFLite, modelPath: string) => {
         const modelResponse = await fetch(modelPath);
         const model = await modelResponse.arrayBuffer();
         console.log("[useTFLite Hook] [loadMeetModel] Model buffer size:", model.byteLength);
+        t._initModelBuffer(model.byteLength);
         const modelBufferOffset = t._getModelBufferMemoryOffset();
         console.log("[useTFLite] [loadMeetModel] Model buffer memory offset:", modelBufferOffset);
         console.log("[useTFLite] [loadMeetModel] Loading model buffer...");
@@ -69,7 +120,32 @@ function useTFLite() {
         }
     }, [modelPath]);
 
-    return { tflite, tfliteSIMD, setModelPath };
+    useEffect(() => {
+        if (!modelPath) {
+            return;
+        }
+        if (getBrowserType() === BrowserType.SAFARI || !isCrossOriginIsolated()) {
+            console.log("[useTFLite] threads build is not used (needs a cross-origin isolated page)");
+            return;
+        }
+        if (!threadsModule.current) {
+            threadsModule.current = loadThreadsScript().then(() => createTFLiteSIMDThreadsModule());
+        }
+        threadsModule.current
+            .then((tflite_threads) => {
+                // the XNNPACK pool of the interpreter is sized when the model is loaded
+                tflite_threads._setNumThreads(numThreads);
+                return loadModel(tflite_threads, modelPath).then(() => {
+                    setTFLiteSIMDThreads(tflite_threads);
+                });
+            })
+            .catch((e) => {
+                console.log("[useTFLite] threads error", e);
+                setTFLiteSIMDThreads(undefined);
+            });
+    }, [modelPath, numThreads]); // eslint-disable-line
+
+    return { tflite, tfliteSIMD, tfliteSIMDThreads, numThreads, setNumThreads, setModelPath };
 }
 
 export default useTFLite;
@@ -0,0 +1,9 @@
+// Dev server only (react-scripts start). Cross-origin isolation, so that the page has SharedArrayBuffer for the
+// pthreads build (tflite-simd-threads). The hosting of the production build needs the same headers.
+module.exports = function (app) {
+    app.use((req, res, next) => {
+        res.setHeader("Cross-Origin-Opener-Policy", "same-origin");
+        res.setHeader("Cross-Origin-Embedder-Policy", "require-corp");
+        next();
+    });
+};
@@ -0,0 +1,101 @@
+#include <cstring>
+#include "replay_util.hpp"
+#include "fused_resize.hpp"
+
+// Native frame replay for meet segmentation. Reports the latency of exec_with_jbf per frame.
+//// bazel build -c opt :replay && bazel-bin/replay --model <tflite> --frames <dir> [--size WxH]
+//// --post <postProcessType(1)> --interpolation <(1)> --d <(2)> --sigma_color <(0.1)> --sigma_space <(2)> --threshold <(0.5)>
+//// --check_resize <1: compare the fused mask upsample with cv::resize first(0)> --threads <XNNPACK and OpenCV(1)>
+extern "C"
+{
+    int setNumThreads(int threads);
+    int initModelBuffer(int size);
+    char *getModelBufferMemoryOffset();
+    int loadModel(int bufferSize);
+    int initInputImageBuffer(int width, int height);
+    int setInputFormat(int format);
+    unsigned char *getInputImageBufferOffset();
+    int exec_with_jbf(int width, int height, int d, double sigmaColor, double sigmaSpace, int postProcessType, int interpolation, float threshold);
+}
+
+// Fused mask upsample (resizeMask8) against cv::resize for every setInterpolation mode, from the tensor sizes of the
+// demo models to the frame size. Fails on a difference above 1 (rounding of the float taps).
+static bool checkMaskResize(int width, int height){
+    const int tensorSizes[][2] = {{160, 96}, {256, 144}, {256, 256}};
+    bool ok = true;
+    for(const auto &size : tensorSizes){
+        cv::Mat mask(size[1], size[0], CV_8UC1);
+        cv::randu(mask, 0, 256);
+        ResizePlanCache plans;
+        std::vector<float> rowBuffer;
+        cv::Mat fused(height, width, CV_8UC1), reference;
+        for(int mode = RESIZE_NEAREST; mode <= RESIZE_LANCZOS4; mode++){
+            resizeMask8(mask.data, fused.data, *plans.get(mask.cols, mask.rows, width, height, mode), MASK_WRITE_ALPHA, rowBuffer);
+            cv::resize(mask, reference, fused.size(), 0, 0, mode);
+            double maxDiff = cv::norm(fused, reference, cv::NORM_INF);
+            printf("[REPLAY] mask resize (%d, %d) -> (%d, %d), interpolation %d: max diff %.0f\n", mask.cols, mask.rows, width, height, mode, maxDiff);
+            ok = ok && maxDiff <= 1;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv){
+    ReplayOptions opt;
+    if(parseReplayOptions(argc, argv, opt) == false){
+        return 1;
+    }
+    int postProcessType = intParam(opt, "post", 1);
+    int interpolation   = intParam(opt, "interpolation", 1);
+    int d               = intParam(opt, "d", 2);
+    float sigmaColor    = floatParam(opt, "sigma_color", 0.1);
+    float sigmaSpace    = floatParam(opt, "sigma_space", 2);
+    float threshold     = floatParam(opt, "threshold", 0.5);
+    setNumThreads(intParam(opt, "threads", 1));
+
+    // (1) Load model
+    std::vector<char> model;
+    if(readFile(opt.model, model) == false){
+        return 1;
+    }
+    initModelBuffer(model.size());
+    memcpy(getModelBufferMemoryOffset(), model.data(), model.size());
+    if(loadModel(model.size()) != 0){
+        return 1;
+    }
+
+    int format = replayFormat(opt, FRAME_FORMAT_RGBA);
+    if(setInputFormat(format) != 0){
+        return 1;
+    }
+
+    // (2) Replay frames
+    std::vector<std::string> frames = listFrames(opt.frameDir);
+    std::vector<unsigned char> encoded;
+    if(intParam(opt, "check_resize", 0) != 0 && frames.empty() == false){
+        cv::Mat frame;
+        if(loadFrame(frames[0], opt, 4, frame) == false || checkMaskResize(frame.cols, frame.rows) == false){
+            return 1;
+        }
+    }
+    LatencyRecorder recorder;
+    for(int r = 0; r < opt.repeat; r++){
+        for(const std::string &path : frames){
+            cv::Mat frame;
+            if(loadFrame(path, opt, 4, frame) == false || encodeFrame(frame, format, encoded) == false){
+                continue;
+            }
+            initInputImageBuffer(frame.cols, frame.rows);
+            memcpy(getInputImageBufferOffset(), encoded.data(), encoded.size());
+            recorder.start();
+            int ret = exec_with_jbf(frame.cols, frame.rows, d, sigmaColor, sigmaSpace, postProcessType, interpolation, threshold);
+            recorder.stop(path);
+            if(ret != 0){
+                printf("[REPLAY] exec_with_jbf failed (%d) at %s\n", ret, path.c_str());
+                return 1;
+            }
+        }
+    }
+    recorder.summary();
+    return 0;
+}
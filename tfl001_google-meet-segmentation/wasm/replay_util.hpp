@@ -0,0 +1,281 @@
+#ifndef __REPLAY_UTIL_HPP__
+#define __REPLAY_UTIL_HPP__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "frame_format.hpp"
+
+// Helpers for the native frame replay CLI (replay.cc).
+//
+// replay --model <tflite> --frames <dir> [--landmark <tflite>] [--raw WxH] [--size WxH] [--repeat N] [--format F] [--<param> <value>]
+//   --frames : directory of .png/.jpg (any size) or .raw (RGBA, size given by --raw) frames, replayed in name order
+//   --size   : processing size. frames are resized to it. (default: frame size)
+//   --repeat : number of passes over the directory
+//   --format : layout written into the input buffer, 0: RGBA, 1: I420, 2: NV12, 3: RGB (see frame_format.hpp).
+//              default: the module's native layout
+//   other --<param> <value> pairs are module specific (see replay.cc)
+typedef struct ReplayOptions
+{
+    std::string model;
+    std::string landmarkModel;
+    std::string frameDir;
+    int rawWidth = 0;
+    int rawHeight = 0;
+    int width = 0;
+    int height = 0;
+    int repeat = 1;
+    int format = -1;
+    std::map<std::string, std::string> params;
+} ReplayOptions;
+
+inline bool parseSize(const std::string &s, int &width, int &height)
+{
+    return sscanf(s.c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+}
+
+inline bool parseReplayOptions(int argc, char **argv, ReplayOptions &opt)
+{
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key.compare(0, 2, "--") != 0)
+        {
+            printf("[REPLAY] unexpected argument: %s\n", key.c_str());
+            return false;
+        }
+        key = key.substr(2);
+        if (key == "model")
+        {
+            opt.model = value;
+        }
+        else if (key == "landmark")
+        {
+            opt.landmarkModel = value;
+        }
+        else if (key == "frames")
+        {
+            opt.frameDir = value;
+        }
+        else if (key == "raw")
+        {
+            if (parseSize(value, opt.rawWidth, opt.rawHeight) == false)
+            {
+                return false;
+            }
+        }
+        else if (key == "size")
+        {
+            if (parseSize(value, opt.width, opt.height) == false)
+            {
+                return false;
+            }
+        }
+        else if (key == "repeat")
+        {
+            opt.repeat = std::max(1, atoi(value.c_str()));
+        }
+        else if (key == "format")
+        {
+            opt.format = atoi(value.c_str());
+            if (isValidFrameFormat(opt.format) == false)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            opt.params[key] = value;
+        }
+    }
+    if (argc % 2 == 0 || opt.model.empty() || opt.frameDir.empty())
+    {
+        printf("usage: %s --model <tflite> --frames <dir> [--landmark <tflite>] [--raw WxH] [--size WxH] [--repeat N] [--format F] [--<param> <value>]\n", argv[0]);
+        return false;
+    }
+    return true;
+}
+
+inline int intParam(const ReplayOptions &opt, const std::string &key, int defaultValue)
+{
+    auto it = opt.params.find(key);
+    return it == opt.params.end() ? defaultValue : atoi(it->second.c_str());
+}
+
+inline float floatParam(const ReplayOptions &opt, const std::string &key, float defaultValue)
+{
+    auto it = opt.params.find(key);
+    return it == opt.params.end() ? defaultValue : (float)atof(it->second.c_str());
+}
+
+inline bool readFile(const std::string &path, std::vector<char> &data)
+{
+    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+    if (!ifs)
+    {
+        printf("[REPLAY] cannot open %s\n", path.c_str());
+        return false;
+    }
+    data.resize((size_t)ifs.tellg());
+    ifs.seekg(0);
+    ifs.read(data.data(), data.size());
+    return (bool)ifs;
+}
+
+inline bool hasSuffix(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Frame files in the directory, sorted by name.
+inline std::vector<std::string> listFrames(const std::string &dir)
+{
+    std::vector<std::string> files;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr)
+    {
+        printf("[REPLAY] cannot open directory %s\n", dir.c_str());
+        return files;
+    }
+    while (struct dirent *e = readdir(d))
+    {
+        std::string name = e->d_name;
+        if (hasSuffix(name, ".png") || hasSuffix(name, ".jpg") || hasSuffix(name, ".jpeg") || hasSuffix(name, ".raw"))
+        {
+            files.push_back(dir + "/" + name);
+        }
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Load a frame as RGBA (channel 4) or RGB (channel 3), resized to the processing size when it is given.
+inline bool loadFrame(const std::string &path, const ReplayOptions &opt, int channel, cv::Mat &frame)
+{
+    cv::Mat rgba;
+    if (hasSuffix(path, ".raw"))
+    {
+        std::vector<char> data;
+        if (opt.rawWidth == 0 || readFile(path, data) == false || data.size() < (size_t)opt.rawWidth * opt.rawHeight * 4)
+        {
+            printf("[REPLAY] invalid raw frame %s (use --raw WxH)\n", path.c_str());
+            return false;
+        }
+        rgba = cv::Mat(opt.rawHeight, opt.rawWidth, CV_8UC4, data.data()).clone();
+    }
+    else
+    {
+        cv::Mat bgr = cv::imread(path, cv::IMREAD_COLOR);
+        if (bgr.empty())
+        {
+            printf("[REPLAY] cannot read %s\n", path.c_str());
+            return false;
+        }
+        cv::cvtColor(bgr, rgba, cv::COLOR_BGR2RGBA);
+    }
+    if (opt.width > 0)
+    {
+        cv::resize(rgba, rgba, cv::Size(opt.width, opt.height), 0, 0, cv::INTER_LINEAR);
+    }
+    if (channel == 3)
+    {
+        cv::cvtColor(rgba, frame, cv::COLOR_RGBA2RGB);
+    }
+    else
+    {
+        frame = rgba;
+    }
+    return true;
+}
+
+// Layout of --format, or nativeFormat when it is not given.
+inline int replayFormat(const ReplayOptions &opt, int nativeFormat)
+{
+    return opt.format < 0 ? nativeFormat : opt.format;
+}
+
+// RGBA frame -> bytes of the input buffer in the format. false when the size can not be used with the format.
+inline bool encodeFrame(const cv::Mat &rgba, int format, std::vector<unsigned char> &out)
+{
+    size_t size = frameBufferSize(format, rgba.cols, rgba.rows);
+    if (size == 0)
+    {
+        printf("[REPLAY] frame (%d, %d) must have even size for YUV input\n", rgba.cols, rgba.rows);
+        return false;
+    }
+    out.resize(size);
+    if (format == FRAME_FORMAT_RGBA || format == FRAME_FORMAT_RGB)
+    {
+        convertFrame(FRAME_FORMAT_RGBA, rgba.data, rgba.cols, rgba.rows, format, out.data());
+        return true;
+    }
+    cv::Mat i420;
+    cv::cvtColor(rgba, i420, cv::COLOR_RGBA2YUV_I420);
+    memcpy(out.data(), i420.data, size);
+    if (format == FRAME_FORMAT_NV12)
+    {
+        // I420 U, V planes -> interleaved UV
+        const size_t lumaSize = (size_t)rgba.cols * rgba.rows;
+        const size_t chromaSize = lumaSize / 4;
+        const unsigned char *u = i420.data + lumaSize;
+        const unsigned char *v = u + chromaSize;
+        for (size_t i = 0; i < chromaSize; i++)
+        {
+            out[lumaSize + i * 2 + 0] = u[i];
+            out[lumaSize + i * 2 + 1] = v[i];
+        }
+    }
+    return true;
+}
+
+// Per frame latency, reported per frame and as summary.
+class LatencyRecorder
+{
+private:
+    std::vector<double> msecs;
+    std::chrono::high_resolution_clock::time_point startTime;
+
+public:
+    void start()
+    {
+        startTime = std::chrono::high_resolution_clock::now();
+    }
+    double stop(const std::string &label)
+    {
+        double msec = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+        msecs.push_back(msec);
+        printf("[REPLAY] %5zu %s %.3f ms\n", msecs.size() - 1, label.c_str(), msec);
+        return msec;
+    }
+    void summary()
+    {
+        if (msecs.empty())
+        {
+            printf("[REPLAY] no frames\n");
+            return;
+        }
+        std::vector<double> sorted = msecs;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (double v : sorted)
+        {
+            sum += v;
+        }
+        auto percentile = [&](double p)
+        { return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))]; };
+        printf("[REPLAY] frames:%zu mean:%.3f p50:%.3f p95:%.3f min:%.3f max:%.3f ms\n",
+               sorted.size(), sum / sorted.size(), percentile(0.5), percentile(0.95), sorted.front(), sorted.back());
+    }
+};
+
+#endif // __REPLAY_UTIL_HPP__
@@ -0,0 +1,106 @@
+#ifndef __STAGE_TIMER_HPP__
+#define __STAGE_TIMER_HPP__
+
+// Per-stage timing of the exec paths.
+// Enabled only when built with --copt=-DENABLE_STAGE_TIMING. Otherwise STAGE_TIMER / STAGE_LAP expand to nothing,
+// and stageTimingRecords() / stageTimingCount() return nullptr / 0.
+//
+// Each record is STAGE_TIMING_FIELDS floats: [frame, stage, msec].
+// Records are kept in a ring buffer of STAGE_TIMING_CAPACITY records.
+// stageTimingCount() is the number of records written so far, and record n is at index (n % STAGE_TIMING_CAPACITY).
+
+// Stage ids. Same values in every module.
+const int STAGE_TOTAL = 0;               // whole exec call
+const int STAGE_PREPROCESS = 1;          // resize, color conversion, normalization into the input tensor
+const int STAGE_INVOKE = 2;              // Interpreter::Invoke()
+const int STAGE_DECODE = 3;              // output tensor -> mask / image / boxes
+const int STAGE_NMS = 4;                 // non max suppression
+const int STAGE_LANDMARK_PREPROCESS = 5; // crop and rotation (warp) for the landmark model
+const int STAGE_LANDMARK_INVOKE = 6;     // landmark Interpreter::Invoke()
+const int STAGE_LANDMARK_DECODE = 7;     // landmark tensor -> frame coordinates
+const int STAGE_REFINE = 8;              // mask refinement (joint bilateral filter, guided filter)
+const int STAGE_OUTPUT = 9;              // resize to the frame, composite, output packing
+
+const int STAGE_TIMING_CAPACITY = 1024;
+const int STAGE_TIMING_FIELDS = 3;
+
+#ifdef ENABLE_STAGE_TIMING
+#include <chrono>
+
+typedef struct StageTimingBuffer
+{
+    float records[STAGE_TIMING_CAPACITY * STAGE_TIMING_FIELDS];
+    int count;
+    int frame;
+} StageTimingBuffer;
+
+inline StageTimingBuffer &stageTimingBuffer()
+{
+    static StageTimingBuffer buffer = {};
+    return buffer;
+}
+
+// Timer of one exec call. lap(stage) records the time since the previous lap (or the construction),
+// and the destructor records STAGE_TOTAL, so early returns are still counted.
+class StageTimer
+{
+private:
+    typedef std::chrono::high_resolution_clock clock;
+    clock::time_point start;
+    clock::time_point last;
+    int frame;
+
+    void record(int stage, clock::time_point from, clock::time_point to)
+    {
+        StageTimingBuffer &buffer = stageTimingBuffer();
+        float *r = &buffer.records[(buffer.count % STAGE_TIMING_CAPACITY) * STAGE_TIMING_FIELDS];
+        r[0] = (float)frame;
+        r[1] = (float)stage;
+        r[2] = std::chrono::duration<float, std::milli>(to - from).count();
+        buffer.count++;
+    }
+
+public:
+    StageTimer()
+    {
+        frame = stageTimingBuffer().frame++;
+        start = last = clock::now();
+    }
+    ~StageTimer()
+    {
+        record(STAGE_TOTAL, start, clock::now());
+    }
+    void lap(int stage)
+    {
+        clock::time_point now = clock::now();
+        record(stage, last, now);
+        last = now;
+    }
+};
+
+#define STAGE_TIMER(timer) StageTimer timer
+#define STAGE_LAP(timer, stage) timer.lap(stage)
+
+inline float *stageTimingRecords()
+{
+    return stageTimingBuffer().records;
+}
+inline int stageTimingCount()
+{
+    return stageTimingBuffer().count;
+}
+#else
+#define STAGE_TIMER(timer)
+#define STAGE_LAP(timer, stage)
+
+inline float *stageTimingRecords()
+{
+    return nullptr;
+}
+inline int stageTimingCount()
+{
+    return 0;
+}
+#endif
+
+#endif // __STAGE_TIMER_HPP__
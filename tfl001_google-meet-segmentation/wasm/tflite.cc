@@ -1,15 +1,22 @@
-#include <SDL/SDL.h>
 #include <cstdio>
-#include <emscripten.h>
+#include "platform.hpp"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/model.h"
 #include "mediapipe/util/tflite/operations/transpose_conv_bias.h"
 
 #include <cmath>
+#include <cstring>
 #include "opencv2/opencv.hpp"
 #include <chrono>
 
 #include "opencv2/ximgproc.hpp"
+#include "fused_resize.hpp"
+#include "guided_filter.hpp"
+#include "buffer_arena.hpp"
+#include "stage_timer.hpp"
+#include "softmax2.hpp"
+#include "frame_format.hpp"
+#include "tensor_feeder.hpp"
 
 #define CHECK_TFLITE_ERROR(x)                                    \
     if (!(x))                                                    \
@@ -20,23 +27,41 @@
 
 
 namespace{
-    ///// Constants
-    const int MAX_WIDTH   = 512;
-    const int MAX_HEIGHT  = 512;
+    ///// Buffers, sized on demand
+    //// model: initModelBuffer(size), frame: initInputImageBuffer(width, height), tensor: loadModel
+    BufferArena arena;
+    const int SLOT_MODEL             = 0;
+    const int SLOT_INPUT_IMAGE       = 1;
+    const int SLOT_GRAYED_IMAGE      = 2;
+    const int SLOT_OUTPUT_IMAGE      = 3;
+    const int SLOT_BACKGROUND_IMAGE  = 4;
+    const int SLOT_OUTPUT_SEG        = 5;
+    const int SLOT_GUIDE_SEG         = 6;
+    const int SLOT_WARPED_SEG        = 7;
+    const int SLOT_JBF_GUIDE         = 8;
+    const int SLOT_JBF_INPUT         = 9;
+    const int SLOT_RESIZED_MASK      = 10;
+    const int SLOT_FRAME_RGBA        = 11;
 
     ///// Buffer for model
-    char modelBuffer[1024 * 1024 * 1];
+    char *modelBuffer = nullptr;
 
-    ///// Buffer for image processing
-    unsigned char inputImageBuffer[4 * MAX_WIDTH * MAX_HEIGHT];                                       // Input image Buffer
-    float         inputImageBuffer32F[3 * MAX_WIDTH * MAX_HEIGHT]; 
-    unsigned char grayedInputImageBuffer[1 * MAX_WIDTH * MAX_HEIGHT];                                 // Grayscaled Image Buffer
+    ///// Buffer for image processing (frame size)
+    unsigned char *inputImageBuffer       = nullptr;                                                  // Input image Buffer
+    unsigned char *grayedInputImageBuffer = nullptr;                                                  // Grayscaled Image Buffer
+    unsigned char *outputImageBuffer      = nullptr;                                                  // final output buffer
+    unsigned char *backgroundImageBuffer  = nullptr;                                                  // background for composite (replace)
+    unsigned char *resizedMaskBuffer      = nullptr;                                                  // mask resized to the frame, for composite
 
-    unsigned char outputSegBuffer[1 * MAX_WIDTH * MAX_HEIGHT];                                        // softmaxed output from model
-    unsigned char outputImageBuffer[4 * MAX_WIDTH * MAX_HEIGHT];                                      // final output buffer
+    ///// Layout of inputImageBuffer (setInputFormat). FRAME_FORMAT_RGBA, FRAME_FORMAT_I420 or FRAME_FORMAT_NV12.
+    //// YUV input is converted to RGB inside the input resize, and the motion gate reads the Y plane.
+    //// A full frame RGBA conversion happens only for composite.
+    int inputFormat = FRAME_FORMAT_RGBA;
 
-    float jbfGuideImageBuffer[1 * MAX_WIDTH * MAX_HEIGHT];                                    // for JBF
-    float jbfInputImageBuffer[1 * MAX_WIDTH * MAX_HEIGHT];                                    // for JBF
+    ///// Buffer for image processing (tensor size)
+    unsigned char *outputSegBuffer = nullptr;                                                         // softmaxed output from model
+    float *jbfGuideImageBuffer = nullptr;                                                             // for JBF
+    float *jbfInputImageBuffer = nullptr;                                                             // for JBF
 
 
     const int INTER_NEAREST = 0;
@@ -49,22 +74,200 @@ namespace{
     [[maybe_unused]] const int POST_SOFTMAX = 1;
     [[maybe_unused]] const int POST_JBF = 2;
     [[maybe_unused]] const int POST_SFOTMAX_JBF = 3;
+    [[maybe_unused]] const int POST_SOFTMAX_GUIDED = 4;
+
+    ///// Threads for XNNPACK and OpenCV parallel_for_. More than 1 is effective only with tflite-simd-threads.
+    //// Both take their threads from the web workers the module starts with (PTHREAD_POOL_SIZE in BUILD): up to
+    //// MAX_NUM_THREADS - 1 for the XNNPACK pool of the interpreter and MAX_NUM_THREADS for OpenCV. A worker cannot be
+    //// added while wasm runs, so a larger count would wait forever for its threads.
+    const int MAX_NUM_THREADS = 4;
+    int numThreads = 1;
+
+    ///// Composite (output the final frame instead of the mask)
+    const int COMPOSITE_NONE    = 0;     // RGBA = (255, 255, 255, mask)
+    const int COMPOSITE_BLUR    = 1;     // person over blurred frame
+    const int COMPOSITE_REPLACE = 2;     // person over backgroundImageBuffer
+    int compositeMode      = COMPOSITE_NONE;
+    int compositeBlurLevel = 3;          // number of pyrDown for background blur
+    cv::Mat blurredBackgroundMat;
+
+    // Background blur by downsampled pyramid. Cost is dominated by the first pyrDown and the final upsample.
+    void blurBackground(const cv::Mat &frame, cv::Mat &dst){
+        cv::Mat level = frame;
+        cv::Mat down;
+        for(int i = 0; i < compositeBlurLevel && level.cols > 8 && level.rows > 8; i++){
+            cv::pyrDown(level, down);
+            level = down.clone();
+        }
+        cv::GaussianBlur(level, down, cv::Size(5, 5), 0);
+        cv::resize(down, dst, frame.size(), 0, 0, cv::INTER_LINEAR);
+    }
+
+    // out = frame * mask + background * (1 - mask). Alpha of the output is 255.
+    void compositeFrame(const unsigned char *frame, const unsigned char *background, const unsigned char *mask, unsigned char *out, int pixelNum){
+        for(int i = 0; i < pixelNum; i++){
+            int a = mask[i];
+            int b = 255 - a;
+            out[i * 4 + 0] = (frame[i * 4 + 0] * a + background[i * 4 + 0] * b + 127) / 255;
+            out[i * 4 + 1] = (frame[i * 4 + 1] * a + background[i * 4 + 1] * b + 127) / 255;
+            out[i * 4 + 2] = (frame[i * 4 + 2] * a + background[i * 4 + 2] * b + 127) / 255;
+            out[i * 4 + 3] = 255;
+        }
+    }
+
+    // RGBA of the current frame. The input buffer itself for RGBA input, converted once otherwise.
+    unsigned char *frameRGBA(int width, int height){
+        if(inputFormat == FRAME_FORMAT_RGBA){
+            return inputImageBuffer;
+        }
+        unsigned char *rgba = arena.reserve(SLOT_FRAME_RGBA, 4 * width * height);
+        if(rgba != nullptr){
+            convertFrame(inputFormat, inputImageBuffer, width, height, FRAME_FORMAT_RGBA, rgba);
+        }
+        return rgba;
+    }
+
+    ///// Index and weight tables of the input resize and the mask upsample, built once per size
+    ResizePlanCache resizePlans;
+    std::vector<float> maskRowBuffer;
+
+    ///// Guided filter (radius independent mask refinement)
+    GuidedFilter guidedFilter;
+    unsigned char *guideSegBuffer = nullptr;                                                          // luma of the model input, guide for the filter
+
+    ///// Benchmark result for refinement ([kernelSize-1][0]: jointBilateralFilter, [kernelSize-1][1]: guided filter), msec
+    const int BENCHMARK_MAX_KERNEL_SIZE = 9;
+    float benchmarkResultBuffer[BENCHMARK_MAX_KERNEL_SIZE * 2];
+
+    ///// Motion gate (reuse the mask of the last inferred frame while the scene is still)
+    const int GATE_THUMB_WIDTH  = 64;
+    const int GATE_THUMB_HEIGHT = 36;
+    int   gateEnable           = 0;
+    float gateThreshold        = 0.02;     // mean abs luma difference to the keyframe (0.0 - 1.0)
+    int   gateKeyframeInterval = 30;       // force inference at least every N frames
+    int   gateUseWarp          = 0;        // shift the mask with the global translation of the frame
+    int   gateHasKeyframe      = 0;
+    int   gateFramesSinceKeyframe = 0;
+    int   gateFrameWidth       = 0;
+    int   gateFrameHeight      = 0;
+    int   gatePostProcessType  = -1;
+    int   gateSkippedFrames    = 0;
+    int   gateInvokedFrames    = 0;
+    unsigned char gateThumbBuffer[GATE_THUMB_WIDTH * GATE_THUMB_HEIGHT];
+    unsigned char gateKeyThumbBuffer[GATE_THUMB_WIDTH * GATE_THUMB_HEIGHT];
+    unsigned char *warpedSegBuffer = nullptr;                                                         // mask shifted by motion gate
+
+    void reserveFrameBuffers(int width, int height){
+        int pixelNum = width * height;
+        inputImageBuffer       = arena.reserve(SLOT_INPUT_IMAGE,      4 * pixelNum);
+        grayedInputImageBuffer = arena.reserve(SLOT_GRAYED_IMAGE,     1 * pixelNum);
+        outputImageBuffer      = arena.reserve(SLOT_OUTPUT_IMAGE,     4 * pixelNum);
+        backgroundImageBuffer  = arena.reserve(SLOT_BACKGROUND_IMAGE, 4 * pixelNum);
+        resizedMaskBuffer      = arena.reserve(SLOT_RESIZED_MASK,     1 * pixelNum);
+    }
+
+    void reserveTensorBuffers(int width, int height){
+        int pixelNum = width * height;
+        outputSegBuffer     = arena.reserve(SLOT_OUTPUT_SEG, pixelNum);
+        guideSegBuffer      = arena.reserve(SLOT_GUIDE_SEG,  pixelNum);
+        warpedSegBuffer     = arena.reserve(SLOT_WARPED_SEG, pixelNum);
+        jbfGuideImageBuffer = (float*)arena.reserve(SLOT_JBF_GUIDE, sizeof(float) * pixelNum);
+        jbfInputImageBuffer = (float*)arena.reserve(SLOT_JBF_INPUT, sizeof(float) * pixelNum);
+    }
+
+    // Returns true when the mask in outputSegBuffer can be reused for this frame.
+    bool updateMotionGate(int width, int height, int postProcessType){
+        // (a) luma thumbnail (point sampled, BT.601). YUV input: Y plane expanded to full range.
+        for(int ty = 0; ty < GATE_THUMB_HEIGHT; ty++){
+            int sy = ((2 * ty + 1) * height) / (2 * GATE_THUMB_HEIGHT);
+            for(int tx = 0; tx < GATE_THUMB_WIDTH; tx++){
+                int sx = ((2 * tx + 1) * width) / (2 * GATE_THUMB_WIDTH);
+                if(inputFormat == FRAME_FORMAT_RGBA){
+                    const unsigned char *p = &inputImageBuffer[(sy * width + sx) * 4];
+                    gateThumbBuffer[ty * GATE_THUMB_WIDTH + tx] = (77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8;
+                }else{
+                    int luma = ((inputImageBuffer[sy * width + sx] - 16) * 298) >> 8;
+                    gateThumbBuffer[ty * GATE_THUMB_WIDTH + tx] = std::min(std::max(luma, 0), 255);
+                }
+            }
+        }
+
+        // (b) decide
+        bool forceKeyframe = gateHasKeyframe == 0
+                          || width != gateFrameWidth || height != gateFrameHeight
+                          || postProcessType != gatePostProcessType
+                          || gateFramesSinceKeyframe + 1 >= gateKeyframeInterval;
+        if(forceKeyframe == false){
+            int diffSum = 0;
+            for(int i = 0; i < GATE_THUMB_WIDTH * GATE_THUMB_HEIGHT; i++){
+                diffSum += std::abs(gateThumbBuffer[i] - gateKeyThumbBuffer[i]);
+            }
+            float diff = diffSum / (255.0f * GATE_THUMB_WIDTH * GATE_THUMB_HEIGHT);
+            if(diff < gateThreshold){
+                gateFramesSinceKeyframe++;
+                gateSkippedFrames++;
+                return true;
+            }
+        }
+
+        // (c) new keyframe. The mask generated from this frame is compared with following frames.
+        memcpy(gateKeyThumbBuffer, gateThumbBuffer, sizeof(gateThumbBuffer));
+        gateHasKeyframe         = 1;
+        gateFramesSinceKeyframe = 0;
+        gateFrameWidth          = width;
+        gateFrameHeight         = height;
+        gatePostProcessType     = postProcessType;
+        gateInvokedFrames++;
+        return false;
+    }
+
+    // Shift the keyframe mask by the global translation between keyframe and current thumbnail.
+    unsigned char *warpKeyframeMask(int maskWidth, int maskHeight){
+        cv::Mat keyThumb(GATE_THUMB_HEIGHT, GATE_THUMB_WIDTH, CV_8UC1, gateKeyThumbBuffer);
+        cv::Mat curThumb(GATE_THUMB_HEIGHT, GATE_THUMB_WIDTH, CV_8UC1, gateThumbBuffer);
+        cv::Mat keyThumb32F, curThumb32F;
+        keyThumb.convertTo(keyThumb32F, CV_32F);
+        curThumb.convertTo(curThumb32F, CV_32F);
+        cv::Point2d shift = cv::phaseCorrelate(keyThumb32F, curThumb32F);
+
+        float dx = shift.x * maskWidth  / GATE_THUMB_WIDTH;
+        float dy = shift.y * maskHeight / GATE_THUMB_HEIGHT;
+        cv::Mat translation = (cv::Mat_<double>(2, 3) << 1.0, 0.0, dx, 0.0, 1.0, dy);
+        cv::Mat keyMask(maskHeight, maskWidth, CV_8UC1, outputSegBuffer);
+        cv::Mat warpedMask(maskHeight, maskWidth, CV_8UC1, warpedSegBuffer);
+        cv::warpAffine(keyMask, warpedMask, translation, warpedMask.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+        return warpedSegBuffer;
+    }
 
 }
 
 using std::chrono::high_resolution_clock;
 std::unique_ptr<tflite::Interpreter> interpreter;
 
-auto start_time = high_resolution_clock::now();
-auto count = 0;
-
 extern "C"
 {
+    // Model buffer. Call initModelBuffer with the model byte size before getModelBufferMemoryOffset.
+    EMSCRIPTEN_KEEPALIVE
+    int initModelBuffer(int size){
+        modelBuffer = (char*)arena.reserve(SLOT_MODEL, size);
+        return modelBuffer != nullptr ? 0 : 1;
+    }
     EMSCRIPTEN_KEEPALIVE
     char *getModelBufferMemoryOffset(){
         return modelBuffer;
     }
 
+    // Frame buffers (input, output, background). Grows only when a larger frame arrives.
+    EMSCRIPTEN_KEEPALIVE
+    int initInputImageBuffer(int width, int height){
+        reserveFrameBuffers(width, height);
+        return inputImageBuffer != nullptr && backgroundImageBuffer != nullptr ? 0 : 1;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getReservedBufferSize(){
+        return arena.reserved();
+    }
+
     // Input Image for exec
     EMSCRIPTEN_KEEPALIVE
     unsigned char *getInputImageBufferOffset(){
@@ -92,9 +295,78 @@ extern "C"
         return grayedInputImageBuffer;
     }
 
+    // Threads
+    //// Applied to OpenCV immediately and to the interpreter at the next loadModel. threads: 1 - MAX_NUM_THREADS
+    EMSCRIPTEN_KEEPALIVE
+    int setNumThreads(int threads){
+        numThreads = std::max(1, std::min(threads, MAX_NUM_THREADS));
+        cv::setNumThreads(numThreads);
+        return 0;
+    }
+
+    // Input format
+    //// format: 0 RGBA, 1 I420, 2 NV12 (see frame_format.hpp). Width and height must be even for I420 / NV12.
+    //// initInputImageBuffer reserves 4 bytes per pixel, enough for every format.
+    EMSCRIPTEN_KEEPALIVE
+    int setInputFormat(int format){
+        if(format != FRAME_FORMAT_RGBA && isYUVFrameFormat(format) == false){
+            printf("[WASM] invalid input format %d\n", format);
+            return 1;
+        }
+        inputFormat = format;
+        return 0;
+    }
+
+    // Composite
+    //// mode: 0 mask only, 1 background blur, 2 background replace(getBackgroundImageBufferOffset, frame size RGBA)
+    //// blurLevel: number of pyrDown for background blur
+    EMSCRIPTEN_KEEPALIVE
+    int setComposite(int mode, int blurLevel){
+        compositeMode      = mode;
+        compositeBlurLevel = blurLevel;
+        return 0;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    unsigned char *getBackgroundImageBufferOffset(){
+        return backgroundImageBuffer;
+    }
+
+    // Motion gate
+    //// threshold: mean abs luma difference (0.0 - 1.0) under which the previous mask is reused
+    //// keyframeInterval: inference is forced at least every N frames
+    //// useWarp: 1 to shift the reused mask with the global motion of the frame
+    EMSCRIPTEN_KEEPALIVE
+    int setMotionGate(int enable, float threshold, int keyframeInterval, int useWarp){
+        gateEnable           = enable;
+        gateThreshold        = threshold;
+        gateKeyframeInterval = keyframeInterval;
+        gateUseWarp          = useWarp;
+        gateHasKeyframe      = 0;
+        return 0;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getMotionGateSkippedFrames(){
+        return gateSkippedFrames;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getMotionGateInvokedFrames(){
+        return gateInvokedFrames;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int resetMotionGateCounters(){
+        gateSkippedFrames = 0;
+        gateInvokedFrames = 0;
+        return 0;
+    }
+
 
     EMSCRIPTEN_KEEPALIVE
     int jbf(int inputWidth, int inputHeight, int outputWidth, int outputHeight, int d, double sigmaColor, double sigmaSpace, int postProcessType, int interpolation, float threshold){
+        STAGE_TIMER(timer);
+        if(arena.capacity(SLOT_OUTPUT_IMAGE) < (size_t)(4 * outputWidth * outputHeight) || arena.capacity(SLOT_OUTPUT_SEG) < (size_t)(inputWidth * inputHeight)){
+            printf("[WASM] size exceeds the buffer. call initInputImageBuffer / loadModel first.\n");
+            return 1;
+        }
         int cv_interpolation = cv::INTER_NEAREST;
         switch(interpolation){
             case INTER_NEAREST:
@@ -139,6 +411,12 @@ extern "C"
         //     cv::divide(expPersonShift, sumMat, softmaxMatPerson);
             
         //     softmaxMatPerson.convertTo(segBufferMat, CV_8U, 255, 0);
+        }else if(postProcessType == 4){ // guided filter
+            cv::Mat guideMat(inputHeight, inputWidth, CV_8UC1, guideSegBuffer);
+            cv::Mat segBufferMat(inputHeight, inputWidth, CV_8UC1, segBuffer);
+            guideImage.convertTo(guideMat, CV_8U, 255, 0);
+            inputImage.convertTo(segBufferMat, CV_8U, 255, 0);
+            guidedFilter.apply(guideSegBuffer, segBuffer, segBuffer, inputWidth, inputHeight, d, sigmaColor * sigmaColor);
         }else if(postProcessType == 1 || postProcessType == 2 || postProcessType == 3){ // joint bilateral filter
             cv::Mat jbfMat;
             cv::Mat segBufferMat(inputHeight, inputWidth, CV_8UC1, segBuffer);   // segBufferMat is mapped to outputSegBuffer
@@ -161,16 +439,12 @@ extern "C"
         //     jbfMat.convertTo(segBufferMat, CV_8U, 255, 0);
         }else{
         }
+        STAGE_LAP(timer, STAGE_REFINE);
 
-        // (4) Resize segmantation 
-        unsigned char *outputImageBuf = &outputImageBuffer[0];
-        cv::Mat grayMat(inputHeight, inputWidth, CV_8UC1, outputSegBuffer);
-        cv::Mat resizedGrayMat(outputHeight, outputWidth, CV_8UC1);
-        cv::resize(grayMat, resizedGrayMat, resizedGrayMat.size(), 0, 0, cv_interpolation);
-        cv::Mat mat255(outputHeight, outputWidth, CV_8UC1, 255);
-        cv::Mat channels[] = {mat255, mat255, mat255, resizedGrayMat};
-        cv::Mat outMat(outputHeight, outputWidth, CV_8UC4, outputImageBuf);
-        cv::merge(channels, 4, outMat);
+        // (4) Resize segmantation, written as RGBA = (255, 255, 255, mask) in one pass
+        std::shared_ptr<const ResizePlan> maskPlan = resizePlans.get(inputWidth, inputHeight, outputWidth, outputHeight, cv_interpolation);
+        resizeMask8(outputSegBuffer, outputImageBuffer, *maskPlan, MASK_WRITE_RGBA, maskRowBuffer);
+        STAGE_LAP(timer, STAGE_OUTPUT);
         return 0;
 
     }
@@ -182,6 +456,14 @@ extern "C"
         // 1: softmax
         // 2: joint bilateral filter  (*1)
         // 3: softmax + joint bilateral filter (*1)
+        // 4: softmax + guided filter (radius: d, eps: sigmaColor^2)
+        STAGE_TIMER(timer);
+
+        size_t frameSize = frameBufferSize(inputFormat, width, height);
+        if(frameSize == 0 || arena.capacity(SLOT_INPUT_IMAGE) < frameSize){
+            printf("[WASM] frame (%d, %d) exceeds the buffer (or odd size for YUV). call initInputImageBuffer first.\n", width, height);
+            return 1;
+        }
 
         int tensorWidth  = interpreter->input_tensor(0)->dims->data[2];
         int tensorHeight = interpreter->input_tensor(0)->dims->data[1];
@@ -212,96 +494,182 @@ extern "C"
         // printf("interpolation::::: %d\n", cv_interpolation);
 
 
-        // (1) Resize
-        float *input = interpreter->typed_input_tensor<float>(0);
-        cv::Mat inputImage(height, width, CV_8UC4, inputImageBuffer);           // map input to matrix
-        cv::Mat inputImageRGB(height, width, CV_8UC3);                          // split alpha channel
-        int fromTo[] = {0,0, 1,1, 2,2};
-        cv::mixChannels(&inputImage, 1, &inputImageRGB, 1, fromTo, 3);
-        cv::Mat inputImage32F(height, width, CV_32FC3, inputImageBuffer32F);    // convert to float
-        cv::Mat resizedInput(tensorHeight, tensorWidth, CV_32FC3, input);       // resize to the size of tflite model
-        inputImageRGB.convertTo(inputImage32F, CV_32FC3);
-        inputImage32F = inputImage32F / 255.0;
-        cv::resize(inputImage32F, resizedInput, resizedInput.size(), 0, 0, cv_interpolation);
-
-        // (2) Infer
-        CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+        // (0) Motion gate
+        unsigned char *segSource = &outputSegBuffer[0];
+        bool reuseMask = false;
+        if(gateEnable == 1){
+            reuseMask = updateMotionGate(width, height, postProcessType);
+        }
+        if(reuseMask && gateUseWarp == 1){
+            segSource = warpKeyframeMask(tensorWidth, tensorHeight);
+        }
 
-        // (3) Generate segmentation
-        float *output = interpreter->typed_output_tensor<float>(0);
-        unsigned char *segBuffer = &outputSegBuffer[0];
-        if(output_ch ==2) {                                                    // not selfie model 
-            cv::Mat outputMat(tensorHeight, tensorWidth, CV_32FC2, output);
-            cv::Mat channels[2]; // 0:background, 1:person 
-            cv::split(outputMat, channels);
-            if(postProcessType == 0){ // none(treshold)
-                cv::Mat segBufferForThreshMat(tensorHeight, tensorWidth, CV_8UC1);
-                channels[1].convertTo(segBufferForThreshMat, CV_8U, 255, 0);
-                cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);
-                unsigned char thresholdValue = static_cast<unsigned char>(255 * threshold);
-                cv::threshold(segBufferForThreshMat, segBufferMat, thresholdValue, 255, cv::THRESH_BINARY);
-            }else if(postProcessType == 1){ // softmax
-                cv::Mat shiftMat, personShift, backgroundShift, expPersonShift, expBackgroundShift, sumMat, softmaxMatPerson;
-                cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);   // segBufferMat is mapped to outputSegBuffer
-                cv::max(channels[0], channels[1], shiftMat);
-                cv::subtract(channels[0], shiftMat, backgroundShift);
-                cv::subtract(channels[1], shiftMat, personShift);
-                cv::exp(backgroundShift, expBackgroundShift);
-                cv::exp(personShift, expPersonShift);
-                cv::add(expBackgroundShift, expPersonShift, sumMat);
-                cv::divide(expPersonShift, sumMat, softmaxMatPerson);
-                
-                softmaxMatPerson.convertTo(segBufferMat, CV_8U, 255, 0);
-            }else if(postProcessType == 2){ // joint bilateral filter
-                cv::Mat jbfMat;
-                cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);   // segBufferMat is mapped to outputSegBuffer
-                cv::ximgproc::jointBilateralFilter(channels[0], channels[1], jbfMat, d, sigmaColor, sigmaSpace);
-                jbfMat.convertTo(segBufferMat, CV_8U, 255, 0);
-
-            }else if(postProcessType == 3){ // softmax + joint bilateral filter
-                cv::Mat shiftMat, personShift, backgroundShift, expPersonShift, expBackgroundShift, sumMat, softmaxMatPerson, softmaxMatBackground, jbfMat;
-                cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);   // segBufferMat is mapped to outputSegBuffer
-                cv::max(channels[0], channels[1], shiftMat);
-                cv::subtract(channels[0], shiftMat, backgroundShift);
-                cv::subtract(channels[1], shiftMat, personShift);
-                cv::exp(backgroundShift, expBackgroundShift);
-                cv::exp(personShift, expPersonShift);
-                cv::add(expBackgroundShift, expPersonShift, sumMat);
-                cv::divide(expPersonShift, sumMat, softmaxMatPerson);
-                cv::divide(expBackgroundShift, sumMat, softmaxMatBackground);
-                
-                cv::ximgproc::jointBilateralFilter(softmaxMatBackground, softmaxMatPerson, jbfMat, d, sigmaColor, sigmaSpace);
-                jbfMat.convertTo(segBufferMat, CV_8U, 255, 0);
+        if(reuseMask == false){
+            // (1) Resize
+            //// RGBA8 (or YUV 4:2:0) -> RGB float[0,1] in one pass, written straight into the input tensor.
+            float *input = interpreter->typed_input_tensor<float>(0);
+            std::shared_ptr<const ResizePlan> inputPlan = resizePlans.get(width, height, tensorWidth, tensorHeight, cv_interpolation);
+            if(inputFormat == FRAME_FORMAT_RGBA){
+                resizeRGBA8ToRGB32F(inputImageBuffer, width, input, tensorWidth, tensorHeight, inputPlan->xTaps, inputPlan->yTaps, 1.0f / 255.0f);
             }else{
+                PlanarFrame frame = planarFrame(inputFormat, inputImageBuffer, width, height);
+                std::shared_ptr<const ResizePlan> chromaPlan = resizePlans.get(frame.chromaWidth, frame.chromaHeight, tensorWidth, tensorHeight, cv_interpolation);
+                resizeYUV420ToRGB32F(frame.y, width, frame.u, frame.v, frame.chromaStride, frame.chromaStep, input, tensorWidth, tensorHeight,
+                                     inputPlan->xTaps, inputPlan->yTaps, chromaPlan->xTaps, chromaPlan->yTaps, 1.0f / 255.0f);
             }
-        }else{                                                               // selfie model
-            cv::Mat outputMat(tensorHeight, tensorWidth, CV_32FC1, output);
-            if(postProcessType == 0) {
-                cv::Mat segBufferForThreshMat(tensorHeight, tensorWidth, CV_8UC1);
-                outputMat.convertTo(segBufferForThreshMat, CV_8U, 255, 0);
-                cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);
-                unsigned char thresholdValue = static_cast<unsigned char>(255 * threshold);
-                cv::threshold(segBufferForThreshMat, segBufferMat, thresholdValue, 255, cv::THRESH_BINARY);
-            }else{
-                cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);
-                outputMat.convertTo(segBufferMat, CV_8U, 255, 0);
+            if(postProcessType == 4){
+                //// luma of the model input as guide
+                for(int i = 0; i < tensorWidth * tensorHeight; i++){
+                    float luma = 0.299f * input[i * 3 + 0] + 0.587f * input[i * 3 + 1] + 0.114f * input[i * 3 + 2];
+                    guideSegBuffer[i] = static_cast<unsigned char>(std::min(std::max(luma * 255.0f + 0.5f, 0.0f), 255.0f));
+                }
             }
+            STAGE_LAP(timer, STAGE_PREPROCESS);
+
+            // (2) Infer
+            CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+            STAGE_LAP(timer, STAGE_INVOKE);
+
+            // (3) Generate segmentation
+            float *output = interpreter->typed_output_tensor<float>(0);
+            unsigned char *segBuffer = &outputSegBuffer[0];
+            const int pixelNum = tensorWidth * tensorHeight;
+            if(output_ch ==2) {                                                    // not selfie model 
+                if(postProcessType == 0){ // none(treshold)
+                    cv::Mat outputMat(tensorHeight, tensorWidth, CV_32FC2, output);
+                    cv::Mat person; // 0:background, 1:person
+                    cv::extractChannel(outputMat, person, 1);
+                    cv::Mat segBufferForThreshMat(tensorHeight, tensorWidth, CV_8UC1);
+                    person.convertTo(segBufferForThreshMat, CV_8U, 255, 0);
+                    cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);
+                    unsigned char thresholdValue = static_cast<unsigned char>(255 * threshold);
+                    cv::threshold(segBufferForThreshMat, segBufferMat, thresholdValue, 255, cv::THRESH_BINARY);
+                }else if(postProcessType == 1 || postProcessType == 4){ // softmax (+ guided filter)
+                    //// single pass from the interleaved output, see softmax2.hpp
+                    softmax2ToU8(output, segBuffer, pixelNum);
+                    if(postProcessType == 4){
+                        guidedFilter.apply(guideSegBuffer, segBuffer, segBuffer, tensorWidth, tensorHeight, d, sigmaColor * sigmaColor);
+                    }
+                }else if(postProcessType == 2){ // joint bilateral filter
+                    cv::Mat outputMat(tensorHeight, tensorWidth, CV_32FC2, output);
+                    cv::Mat channels[2]; // 0:background, 1:person 
+                    cv::split(outputMat, channels);
+                    cv::Mat jbfMat;
+                    cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);   // segBufferMat is mapped to outputSegBuffer
+                    cv::ximgproc::jointBilateralFilter(channels[0], channels[1], jbfMat, d, sigmaColor, sigmaSpace);
+                    jbfMat.convertTo(segBufferMat, CV_8U, 255, 0);
+
+                }else if(postProcessType == 3){ // softmax + joint bilateral filter
+                    cv::Mat softmaxMatPerson(tensorHeight, tensorWidth, CV_32FC1);
+                    cv::Mat softmaxMatBackground, jbfMat;
+                    cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);   // segBufferMat is mapped to outputSegBuffer
+                    softmax2ToF32(output, (float*)softmaxMatPerson.data, pixelNum);
+                    cv::subtract(1.0, softmaxMatPerson, softmaxMatBackground);
+                
+                    cv::ximgproc::jointBilateralFilter(softmaxMatBackground, softmaxMatPerson, jbfMat, d, sigmaColor, sigmaSpace);
+                    jbfMat.convertTo(segBufferMat, CV_8U, 255, 0);
+                }else{
+                }
+            }else{                                                               // selfie model
+                cv::Mat outputMat(tensorHeight, tensorWidth, CV_32FC1, output);
+                if(postProcessType == 0) {
+                    cv::Mat segBufferForThreshMat(tensorHeight, tensorWidth, CV_8UC1);
+                    outputMat.convertTo(segBufferForThreshMat, CV_8U, 255, 0);
+                    cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);
+                    unsigned char thresholdValue = static_cast<unsigned char>(255 * threshold);
+                    cv::threshold(segBufferForThreshMat, segBufferMat, thresholdValue, 255, cv::THRESH_BINARY);
+                }else{
+                    readF32ToU8(output, segBuffer, pixelNum, 255.0f, 0.0f);
+                    if(postProcessType == 4){
+                        guidedFilter.apply(guideSegBuffer, segBuffer, segBuffer, tensorWidth, tensorHeight, d, sigmaColor * sigmaColor);
+                    }
+                }
+            }
+            //// includes the refinement (postProcessType 2, 3, 4)
+            STAGE_LAP(timer, STAGE_DECODE);
         }
 
-        // (4) Resize segmantation 
+        // (4) Resize segmantation, in one pass straight into the output (or the alpha plane for composite)
         unsigned char *outputImageBuf = &outputImageBuffer[0];
-        cv::Mat grayMat(tensorHeight, tensorWidth, CV_8UC1, outputSegBuffer);
-        cv::Mat resizedGrayMat(height, width, CV_8UC1);
-        cv::resize(grayMat, resizedGrayMat, resizedGrayMat.size(), 0, 0, cv_interpolation);
-        cv::Mat mat255(height, width, CV_8UC1, 255);
-        cv::Mat channels[] = {mat255, mat255, mat255, resizedGrayMat};
-        cv::Mat outMat(height, width, CV_8UC4, outputImageBuf);
-        cv::merge(channels, 4, outMat);
+        std::shared_ptr<const ResizePlan> maskPlan = resizePlans.get(tensorWidth, tensorHeight, width, height, cv_interpolation);
+        if(compositeMode == COMPOSITE_BLUR || compositeMode == COMPOSITE_REPLACE){
+            resizeMask8(segSource, resizedMaskBuffer, *maskPlan, MASK_WRITE_ALPHA, maskRowBuffer);
+
+            // (5) Composite
+            unsigned char *frameBuffer = frameRGBA(width, height);
+            if(frameBuffer == nullptr){
+                return 1;
+            }
+            const unsigned char *background = backgroundImageBuffer;
+            if(compositeMode == COMPOSITE_BLUR){
+                cv::Mat frame(height, width, CV_8UC4, frameBuffer);
+                blurBackground(frame, blurredBackgroundMat);
+                background = blurredBackgroundMat.data;
+            }
+            compositeFrame(frameBuffer, background, resizedMaskBuffer, outputImageBuf, width * height);
+            STAGE_LAP(timer, STAGE_OUTPUT);
+            return 0;
+        }
+        resizeMask8(segSource, outputImageBuf, *maskPlan, MASK_WRITE_RGBA, maskRowBuffer);
+        STAGE_LAP(timer, STAGE_OUTPUT);
         return 0;
 
     }
 
-    
+
+    // Benchmark of mask refinement. jointBilateralFilter(d = 2k+1) vs guided filter(r = k) for k = 1..9.
+    //// Synthetic guide/mask of (width, height). Result: getBenchmarkResultBufferOffset(), msec per call.
+    EMSCRIPTEN_KEEPALIVE
+    int benchmarkRefinement(int width, int height, int iterations){
+        if(iterations <= 0){
+            return 1;
+        }
+        reserveTensorBuffers(width, height);
+        gateHasKeyframe = 0;
+        cv::Mat guide8U(height, width, CV_8UC1, guideSegBuffer);
+        cv::Mat mask8U(height, width, CV_8UC1, outputSegBuffer);
+        cv::randu(guide8U, 0, 256);
+        mask8U.setTo(0);
+        mask8U(cv::Rect(width / 4, height / 4, width / 2, height / 2)).setTo(255);
+        cv::Mat guide32F, mask32F, jbfMat;
+        guide8U.convertTo(guide32F, CV_32F, 1.0 / 255.0);
+        mask8U.convertTo(mask32F, CV_32F, 1.0 / 255.0);
+        cv::Mat refined8U(height, width, CV_8UC1);
+
+        for(int k = 1; k <= BENCHMARK_MAX_KERNEL_SIZE; k++){
+            auto jbfStart = high_resolution_clock::now();
+            for(int i = 0; i < iterations; i++){
+                cv::ximgproc::jointBilateralFilter(guide32F, mask32F, jbfMat, 2 * k + 1, 0.1, k);
+            }
+            auto guidedStart = high_resolution_clock::now();
+            for(int i = 0; i < iterations; i++){
+                guidedFilter.apply(guideSegBuffer, outputSegBuffer, refined8U.data, width, height, k, 0.01f);
+            }
+            auto end = high_resolution_clock::now();
+            float jbfMsec    = std::chrono::duration<float, std::milli>(guidedStart - jbfStart).count() / iterations;
+            float guidedMsec = std::chrono::duration<float, std::milli>(end - guidedStart).count() / iterations;
+            benchmarkResultBuffer[(k - 1) * 2 + 0] = jbfMsec;
+            benchmarkResultBuffer[(k - 1) * 2 + 1] = guidedMsec;
+            printf("[WASM] refinement benchmark (%dx%d) kernel:%d jbf:%fms guided:%fms\n", width, height, k, jbfMsec, guidedMsec);
+        }
+        return 0;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    float *getBenchmarkResultBufferOffset(){
+        return benchmarkResultBuffer;
+    }
+
+    // Per-stage timing of jbf / exec_with_jbf. Records of [frame, stage, msec], see stage_timer.hpp.
+    //// nullptr / 0 unless built with --copt=-DENABLE_STAGE_TIMING
+    EMSCRIPTEN_KEEPALIVE
+    float *getTimingBufferAddress(){
+        return stageTimingRecords();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getTimingCount(){
+        return stageTimingCount();
+    }
+
     EMSCRIPTEN_KEEPALIVE
     int loadModel(int bufferSize)
     {
@@ -311,7 +679,7 @@ extern "C"
         printf("[WASM] -   https://github.com/w-okada/image-analyze-workers   -\n");
         printf("[WASM] --------------------------------------------------------\n");
         printf("[WASM] \n");
-        printf("[WASM] Loading model of size: %d\n", bufferSize);
+        printf("[WASM] Loading model of size: %d, threads: %d\n", bufferSize, numThreads);
 
         // Load model
         std::unique_ptr<tflite::FlatBufferModel> model = tflite::FlatBufferModel::BuildFromBuffer(modelBuffer, bufferSize);
@@ -320,11 +688,18 @@ extern "C"
         tflite::ops::builtin::BuiltinOpResolver resolver;
         resolver.AddCustom("Convolution2DTransposeBias", mediapipe::tflite_operations::RegisterConvolution2DTransposeBias());
         tflite::InterpreterBuilder builder(*model, resolver);
-        builder(&interpreter);
+        builder(&interpreter, numThreads);
         CHECK_TFLITE_ERROR(interpreter != nullptr);
 
         // Allocate tensor buffers.
         CHECK_TFLITE_ERROR(interpreter->AllocateTensors() == kTfLiteOk);
+
+        // Allocate buffers for the segmentation (tensor size).
+        int tensorWidth  = interpreter->input_tensor(0)->dims->data[2];
+        int tensorHeight = interpreter->input_tensor(0)->dims->data[1];
+        reserveTensorBuffers(tensorWidth, tensorHeight);
+        gateHasKeyframe = 0;
+        printf("[WASM] Reserved buffer size: %zu\n", arena.reserved());
         return 0;
     }
 }
\ No newline at end of file
@@ -16,13 +16,21 @@ export interface TFLite extends EmscriptenModule {
     _setUsePadding(int: number): number
     _setThresholdWithoutSoftmax(float: number): number
     _setInterpolation(int: number): number
+    _setRefinementType(int: number): number
+    _setGuidedFilterEps(float: number): number
+    _benchmarkRefinement(width: number, height: number, iterations: number): number
+    _getBenchmarkResultBufferOffset(): number
     
     _getInputImageBufferOffset(): number
     _getOutputImageBufferOffset(): number
     _exec(widht: number, height: number): number
+    _setInputFormat(format: number): number // 0: RGBA, 1: I420, 2: NV12
 
     _getGrayedImageBufferOffset():number
 
+    /// Stage timing ([frame, stage, msec] records, build with -DENABLE_STAGE_TIMING)
+    _getTimingBufferAddress(): number
+    _getTimingCount(): number
 }
 
 function useTFLite() {
@@ -0,0 +1,209 @@
+#ifndef __GUIDED_FILTER_HPP__
+#define __GUIDED_FILTER_HPP__
+
+#include <algorithm>
+#include <vector>
+
+// Edge-aware mask refinement (guided filter, He et al.) on uint8 guide and mask.
+// Every step is a box filter by running sums, so the cost does not depend on the radius.
+class GuidedFilter
+{
+private:
+    int width = 0;
+    int height = 0;
+    std::vector<float> guide, mask, meanI, meanP, corrII, corrIP, a, b, rowSum, colSum;
+
+    void allocate(int w, int h)
+    {
+        if (w == width && h == height)
+        {
+            return;
+        }
+        width = w;
+        height = h;
+        int size = w * h;
+        guide.resize(size);
+        mask.resize(size);
+        meanI.resize(size);
+        meanP.resize(size);
+        corrII.resize(size);
+        corrIP.resize(size);
+        a.resize(size);
+        b.resize(size);
+        rowSum.resize(size);
+        colSum.resize(w);
+    }
+
+    // Mean over the (2r+1)x(2r+1) window clipped by the image border.
+    void boxFilter(const float *src, float *dst, int r)
+    {
+        // horizontal running sum
+        for (int y = 0; y < height; y++)
+        {
+            const float *s = src + y * width;
+            float *d = &rowSum[y * width];
+            float sum = 0;
+            for (int x = 0; x < std::min(r, width - 1) + 1; x++)
+            {
+                sum += s[x];
+            }
+            for (int x = 0; x < width; x++)
+            {
+                d[x] = sum;
+                if (x + r + 1 < width)
+                {
+                    sum += s[x + r + 1];
+                }
+                if (x - r >= 0)
+                {
+                    sum -= s[x - r];
+                }
+            }
+        }
+
+        // vertical running sum, one row at a time
+        std::fill(colSum.begin(), colSum.end(), 0.0f);
+        for (int y = 0; y < std::min(r, height - 1) + 1; y++)
+        {
+            const float *s = &rowSum[y * width];
+            for (int x = 0; x < width; x++)
+            {
+                colSum[x] += s[x];
+            }
+        }
+        for (int y = 0; y < height; y++)
+        {
+            int countY = std::min(y + r, height - 1) - std::max(y - r, 0) + 1;
+            float *d = dst + y * width;
+            for (int x = 0; x < width; x++)
+            {
+                int countX = std::min(x + r, width - 1) - std::max(x - r, 0) + 1;
+                d[x] = colSum[x] / (countX * countY);
+            }
+            if (y + r + 1 < height)
+            {
+                const float *s = &rowSum[(y + r + 1) * width];
+                for (int x = 0; x < width; x++)
+                {
+                    colSum[x] += s[x];
+                }
+            }
+            if (y - r >= 0)
+            {
+                const float *s = &rowSum[(y - r) * width];
+                for (int x = 0; x < width; x++)
+                {
+                    colSum[x] -= s[x];
+                }
+            }
+        }
+    }
+
+public:
+    // guideBuf, maskBuf, outBuf: w*h uint8. eps is in normalized (0.0-1.0) intensity units.
+    void apply(const unsigned char *guideBuf, const unsigned char *maskBuf, unsigned char *outBuf, int w, int h, int r, float eps)
+    {
+        allocate(w, h);
+        const int size = w * h;
+        const float inv = 1.0f / 255.0f;
+        for (int i = 0; i < size; i++)
+        {
+            guide[i] = guideBuf[i] * inv;
+            mask[i] = maskBuf[i] * inv;
+            a[i] = guide[i] * guide[i];
+            b[i] = guide[i] * mask[i];
+        }
+        boxFilter(guide.data(), meanI.data(), r);
+        boxFilter(mask.data(), meanP.data(), r);
+        boxFilter(a.data(), corrII.data(), r);
+        boxFilter(b.data(), corrIP.data(), r);
+
+        for (int i = 0; i < size; i++)
+        {
+            float varI = corrII[i] - meanI[i] * meanI[i];
+            float covIP = corrIP[i] - meanI[i] * meanP[i];
+            a[i] = covIP / (varI + eps);
+            b[i] = meanP[i] - a[i] * meanI[i];
+        }
+        // meanI/meanP are reused for mean of a/b
+        boxFilter(a.data(), meanI.data(), r);
+        boxFilter(b.data(), meanP.data(), r);
+
+        for (int i = 0; i < size; i++)
+        {
+            float q = (meanI[i] * guide[i] + meanP[i]) * 255.0f + 0.5f;
+            outBuf[i] = q < 0.0f ? 0 : (q > 255.0f ? 255 : (unsigned char)q);
+        }
+    }
+
+    // Guided upsampling (fast guided filter, He & Sun) of a low resolution result back to the full resolution guide.
+    // The residual (lowSrc - lowGuide) is fitted as a * guide + b at low resolution, a and b are upsampled bilinearly,
+    // and out = guide + a * guide + b at full resolution. So flat regions keep the detail of the full resolution guide,
+    // and edges of the result snap to the edges of the guide.
+    // lowGuideBuf, lowSrcBuf: lw*lh, guideBuf, outBuf: w*h, uint8 with step bytes per pixel (one channel of an
+    // interleaved image: pass base + channel and step = channels). r and eps are at low resolution.
+    void upsample(const unsigned char *lowGuideBuf, const unsigned char *lowSrcBuf, int lw, int lh,
+                  const unsigned char *guideBuf, unsigned char *outBuf, int w, int h, int step, int r, float eps)
+    {
+        allocate(lw, lh);
+        const int size = lw * lh;
+        const float inv = 1.0f / 255.0f;
+        for (int i = 0; i < size; i++)
+        {
+            guide[i] = lowGuideBuf[i * step] * inv;
+            mask[i] = lowSrcBuf[i * step] * inv - guide[i];
+            a[i] = guide[i] * guide[i];
+            b[i] = guide[i] * mask[i];
+        }
+        boxFilter(guide.data(), meanI.data(), r);
+        boxFilter(mask.data(), meanP.data(), r);
+        boxFilter(a.data(), corrII.data(), r);
+        boxFilter(b.data(), corrIP.data(), r);
+
+        for (int i = 0; i < size; i++)
+        {
+            float varI = corrII[i] - meanI[i] * meanI[i];
+            float covIP = corrIP[i] - meanI[i] * meanP[i];
+            a[i] = covIP / (varI + eps);
+            b[i] = meanP[i] - a[i] * meanI[i];
+        }
+        boxFilter(a.data(), meanI.data(), r);
+        boxFilter(b.data(), meanP.data(), r);
+
+        // bilinear sampling positions (pixel centers aligned, same as cv::INTER_LINEAR)
+        std::vector<int> x0(w), x1(w);
+        std::vector<float> fx(w);
+        for (int x = 0; x < w; x++)
+        {
+            float sx = std::min(std::max((x + 0.5f) * lw / w - 0.5f, 0.0f), (float)(lw - 1));
+            x0[x] = (int)sx;
+            x1[x] = std::min(x0[x] + 1, lw - 1);
+            fx[x] = sx - x0[x];
+        }
+        for (int y = 0; y < h; y++)
+        {
+            float sy = std::min(std::max((y + 0.5f) * lh / h - 0.5f, 0.0f), (float)(lh - 1));
+            int y0 = (int)sy;
+            int y1 = std::min(y0 + 1, lh - 1);
+            float fy = sy - y0;
+            const float *a0 = &meanI[y0 * lw];
+            const float *a1 = &meanI[y1 * lw];
+            const float *b0 = &meanP[y0 * lw];
+            const float *b1 = &meanP[y1 * lw];
+            const unsigned char *g = guideBuf + (size_t)y * w * step;
+            unsigned char *o = outBuf + (size_t)y * w * step;
+            for (int x = 0; x < w; x++)
+            {
+                float at = a0[x0[x]] + (a0[x1[x]] - a0[x0[x]]) * fx[x];
+                float ab = a1[x0[x]] + (a1[x1[x]] - a1[x0[x]]) * fx[x];
+                float bt = b0[x0[x]] + (b0[x1[x]] - b0[x0[x]]) * fx[x];
+                float bb = b1[x0[x]] + (b1[x1[x]] - b1[x0[x]]) * fx[x];
+                float gi = g[x * step] * inv;
+                float q = (gi + (at + (ab - at) * fy) * gi + bt + (bb - bt) * fy) * 255.0f + 0.5f;
+                o[x * step] = q < 0.0f ? 0 : (q > 255.0f ? 255 : (unsigned char)q);
+            }
+        }
+    }
+};
+
+#endif // __GUIDED_FILTER_HPP__
@@ -1,6 +1,5 @@
-#include <SDL/SDL.h>
 #include <cstdio>
-#include <emscripten.h>
+#include "platform.hpp"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/model.h"
 #include "mediapipe/util/tflite/operations/transpose_conv_bias.h"
@@ -8,6 +7,11 @@
 #include <cmath>
 #include "opencv2/opencv.hpp"
 #include <chrono>
+#include "fused_resize.hpp"
+#include "guided_filter.hpp"
+#include "stage_timer.hpp"
+#include "frame_format.hpp"
+#include "tensor_feeder.hpp"
 
 #define CHECK_TFLITE_ERROR(x)                                    \
     if (!(x))                                                    \
@@ -31,7 +35,6 @@ namespace{
 
     ///// Buffer for image processing
     unsigned char inputImageBuffer[4 * MAX_WIDTH * MAX_HEIGHT];                                       // Input image Buffer
-    float         inputImageBuffer32F[3 * MAX_WIDTH * MAX_HEIGHT]; 
     unsigned char grayedInputImageBuffer[1 * MAX_WIDTH * MAX_HEIGHT];                                 // Grayscaled Image Buffer
     unsigned char paddedGrayedInputImageBuffer[1 * MAX_WIDTH_WITH_PADDING * MAX_HEIGHT_WITH_PADDING]; // Padded image Buffer
 
@@ -42,11 +45,9 @@ namespace{
     unsigned char outputImageBuffer[4 * MAX_WIDTH * MAX_HEIGHT];                                      // final output buffer
 
 
-    // ////// 拡大縮小用　インデックス変換キャッシュ
-    // unsigned int inputImageWidth  = 0;
-    // unsigned int inputImageHeight = 0;
-    // unsigned int downSamplingIndex[MAX_WIDTH * MAX_HEIGHT];
-    // unsigned int upSamplingIndex[MAX_WIDTH * MAX_HEIGHT];
+    ////// 拡大縮小用　インデックス変換キャッシュ (mask upsample)
+    ResizePlanCache resizePlans;
+    std::vector<float> maskRowBuffer;
 
     ///// その他バッファ
     float matrixmap[256];      // JointBilateralFilter向け
@@ -64,14 +65,67 @@ namespace{
     const int INTER_LANCZOS4 = 4;
     int interpolation = INTER_LINEAR;
 
+    ///// 入力フォーマット (setInputFormat). FRAME_FORMAT_RGBA, FRAME_FORMAT_I420 or FRAME_FORMAT_NV12
+    //// YUV: RGB への変換は入力リサイズ内で、グレースケールは Y プレーンから
+    int inputFormat = FRAME_FORMAT_RGBA;
+
+    const int REFINEMENT_JBF    = 0;
+    const int REFINEMENT_GUIDED = 1;
+    int refinementType = REFINEMENT_JBF;
+    float guidedFilterEps = 0.01;
+    GuidedFilter guidedFilter;
+
+    ///// Benchmark result for refinement ([kernelSize-1][0]: simple JBF, [kernelSize-1][1]: guided filter), msec
+    const int BENCHMARK_MAX_KERNEL_SIZE = 9;
+    float benchmarkResultBuffer[BENCHMARK_MAX_KERNEL_SIZE * 2];
+
+    // Simple Joint Bilateral Filter over grayedInputImageBuffer(guide) and resizedSegBuffer. O(kernelSize^2) per pixel.
+    void simpleJointBilateralFilter(int width, int height, unsigned char *dst){
+        // (a) padding
+        int paddedWidth = width + (kernelSize * 2);
+        int paddedHeight = height + (kernelSize * 2);
+
+        ////// Input Image
+        cv::Mat grayedInputImageMat(height, width, CV_8UC1, grayedInputImageBuffer);
+        cv::Mat paddedGrayedInputImageMat(paddedHeight, paddedWidth, CV_8UC1, paddedGrayedInputImageBuffer);
+
+        ////// Segmentation
+        cv::Mat resizedSegMat(height, width, CV_8UC1, resizedSegBuffer);
+        cv::Mat paddedResizedSegMat(paddedHeight, paddedWidth, CV_8UC1, paddedResizedSegBuffer);
+
+        int borderType = (usePadding == 1 ? cv::BORDER_REFLECT : cv::BORDER_CONSTANT);
+        cv::copyMakeBorder(grayedInputImageMat, paddedGrayedInputImageMat, kernelSize, kernelSize, kernelSize, kernelSize, borderType, 0);
+        cv::copyMakeBorder(resizedSegMat, paddedResizedSegMat, kernelSize, kernelSize, kernelSize, kernelSize, borderType, 0);
+
+        // (b) Simple Joint Bilateral Filter # Tobe fixed
+        unsigned char* grayOutputImageBuf = dst;
+        for(int y = kernelSize; y < kernelSize + height; y++){
+            for(int x = kernelSize; x < kernelSize + width; x++){
+                int centerVal = paddedGrayedInputImageBuffer[(paddedWidth * y) + x];
+                int norm = 0;
+                int sum  = 0;
+                for(int ky = 0; ky < kernelSize*2+1; ky++){
+                    for(int kx = 0; kx < kernelSize*2+1; kx++){
+                        int positionX = x - kernelSize + kx;
+                        int positionY = y - kernelSize + ky;
+                        int index = std::abs(paddedGrayedInputImageBuffer[paddedWidth * positionY + positionX] - centerVal);
+                        int val = matrixmap[index];
+                        norm += val;
+                        sum += paddedResizedSegBuffer[paddedWidth * positionY + positionX] * val;
+                    }
+                }
+                int pixelValue = sum / norm;
+                *grayOutputImageBuf = pixelValue;
+                grayOutputImageBuf++;
+            }
+        }
+    }
+
 }
 
 using std::chrono::high_resolution_clock;
 std::unique_ptr<tflite::Interpreter> interpreter;
 
-auto start_time = high_resolution_clock::now();
-auto count = 0;
-
 extern "C"
 {
     EMSCRIPTEN_KEEPALIVE
@@ -127,6 +181,17 @@ extern "C"
         return 0;
     }
 
+    EMSCRIPTEN_KEEPALIVE
+    int setRefinementType(int type){
+        refinementType = type;
+        return 0;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int setGuidedFilterEps(float eps){
+        guidedFilterEps = eps;
+        return 0;
+    }
+
     EMSCRIPTEN_KEEPALIVE
     int setInterpolation(int mode){
         switch(mode){
@@ -152,8 +217,25 @@ extern "C"
     }
 
 
+    // format: 0 RGBA, 1 I420, 2 NV12 (see frame_format.hpp). Width and height must be even for I420 / NV12.
+    EMSCRIPTEN_KEEPALIVE
+    int setInputFormat(int format){
+        if(format != FRAME_FORMAT_RGBA && isYUVFrameFormat(format) == false){
+            printf("[WASM] invalid input format %d\n", format);
+            return 1;
+        }
+        inputFormat = format;
+        return 0;
+    }
+
+
     EMSCRIPTEN_KEEPALIVE
     int exec(int width, int height){
+        STAGE_TIMER(timer);
+        if(frameBufferSize(inputFormat, width, height) == 0){
+            printf("[WASM] frame (%d, %d) must have even size for YUV input\n", width, height);
+            return 1;
+        }
         int tensorWidth  = interpreter->input_tensor(0)->dims->data[2];
         int tensorHeight = interpreter->input_tensor(0)->dims->data[1];
         int output_ch     = interpreter->output_tensor(0)->dims->data[3];
@@ -164,17 +246,22 @@ extern "C"
         // (1) Resize
         float *input = interpreter->typed_input_tensor<float>(0);
         cv::Mat inputImage(height, width, CV_8UC4, inputImageBuffer);
-        cv::Mat inputImageRGB(height, width, CV_8UC3);
-        int fromTo[] = {0,0, 1,1, 2,2};
-        cv::mixChannels(&inputImage, 1, &inputImageRGB, 1, fromTo, 3);
-        cv::Mat inputImage32F(height, width, CV_32FC3, inputImageBuffer32F);
-        cv::Mat resizedInput(tensorHeight, tensorWidth, CV_32FC3, input);
-        inputImageRGB.convertTo(inputImage32F, CV_32FC3);
-        inputImage32F = inputImage32F / 255.0;
-        cv::resize(inputImage32F, resizedInput, resizedInput.size(), 0, 0, interpolation);
+        std::shared_ptr<const ResizePlan> lumaPlan = resizePlans.get(width, height, tensorWidth, tensorHeight, interpolation);
+        if(inputFormat == FRAME_FORMAT_RGBA){
+            //// RGBA -> RGB float[0,1] in one pass (channel drop, resize and normalization), written straight into the input tensor
+            resizeRGBA8ToRGB32F(inputImageBuffer, width, input, tensorWidth, tensorHeight, lumaPlan->xTaps, lumaPlan->yTaps, 1.0f / 255.0f);
+        }else{
+            //// YUV 4:2:0 -> RGB float[0,1] in one pass, written straight into the input tensor
+            PlanarFrame frame = planarFrame(inputFormat, inputImageBuffer, width, height);
+            std::shared_ptr<const ResizePlan> chromaPlan = resizePlans.get(frame.chromaWidth, frame.chromaHeight, tensorWidth, tensorHeight, interpolation);
+            resizeYUV420ToRGB32F(frame.y, width, frame.u, frame.v, frame.chromaStride, frame.chromaStep, input, tensorWidth, tensorHeight,
+                                 lumaPlan->xTaps, lumaPlan->yTaps, chromaPlan->xTaps, chromaPlan->yTaps, 1.0f / 255.0f);
+        }
+        STAGE_LAP(timer, STAGE_PREPROCESS);
 
         // (2) Infer
         CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+        STAGE_LAP(timer, STAGE_INVOKE);
 
         // (3) Generate segmentation
         float *output = interpreter->typed_output_tensor<float>(0);
@@ -208,8 +295,7 @@ extern "C"
         }else{
             cv::Mat outputMat(tensorHeight, tensorWidth, CV_32FC1, output);
             if(useSoftmax == 1) {
-                cv::Mat segBufferMat(tensorHeight, tensorWidth, CV_8UC1, segBuffer);
-                outputMat.convertTo(segBufferMat, CV_8U, 255, 0);
+                readF32ToU8(output, segBuffer, tensorWidth * tensorHeight, 255.0f, 0.0f);
             }else{
                 cv::Mat segBufferForThreshMat(tensorHeight, tensorWidth, CV_8UC1);
                 outputMat.convertTo(segBufferForThreshMat, CV_8U, 255, 0);
@@ -218,84 +304,100 @@ extern "C"
                 cv::threshold(segBufferForThreshMat, segBufferMat, thresholdValue, 255, cv::THRESH_BINARY);
             }
         }
+        STAGE_LAP(timer, STAGE_DECODE);
 
 
         // (4) Resize segmantation 
         //// kernelSize <= 0: return without JBF
         //// kenerlSize >0  : goto JBF
+        std::shared_ptr<const ResizePlan> maskPlan = resizePlans.get(tensorWidth, tensorHeight, width, height, interpolation);
         if(kernelSize <= 0){ // Without JBF
-            unsigned char *outputImageBuf = &outputImageBuffer[0];
-            cv::Mat grayMat(tensorHeight, tensorWidth, CV_8UC1, outputSegBuffer);
-            cv::Mat resizedGrayMat(height, width, CV_8UC1);
-            cv::resize(grayMat, resizedGrayMat, resizedGrayMat.size(), 0, 0, interpolation);
-            cv::Mat mat255(height, width, CV_8UC1, 255);
-            cv::Mat channels[] = {mat255, mat255, mat255, resizedGrayMat};
-            cv::Mat outMat(height, width, CV_8UC4, outputImageBuf);
-            cv::merge(channels, 4, outMat);
+            resizeMask8(outputSegBuffer, outputImageBuffer, *maskPlan, MASK_WRITE_RGBA, maskRowBuffer);
+            STAGE_LAP(timer, STAGE_OUTPUT);
             return 0;                    // fin
         }else{ // With JBF
-            unsigned char *resizedSegBuf = &resizedSegBuffer[0];
-            cv::Mat grayMat(tensorHeight, tensorWidth, CV_8UC1, outputSegBuffer);
-            cv::Mat outMat(height, width, CV_8UC1, resizedSegBuf);
-            cv::resize(grayMat, outMat, outMat.size(), 0, 0, interpolation);
+            resizeMask8(outputSegBuffer, resizedSegBuffer, *maskPlan, MASK_WRITE_ALPHA, maskRowBuffer);
         }
 
-        // (5) Grayscale input image
+        // (5) Grayscale input image (YUV: Y plane expanded to full range)
         cv::Mat grayImage(height, width, CV_8UC1, grayedInputImageBuffer);
-        cv::cvtColor(inputImage, grayImage, cv::COLOR_RGBA2GRAY);
-
-        // (6) padding
-        int paddedWidth = width + (kernelSize * 2);
-        int paddedHeight = height + (kernelSize * 2);
-
-        ////// Input Image
-        cv::Mat grayedInputImageMat(height, width, CV_8UC1, grayedInputImageBuffer);
-        cv::Mat paddedGrayedInputImageMat(paddedHeight, paddedWidth, CV_8UC1, paddedGrayedInputImageBuffer);
-
-        ////// Segmentation
-        cv::Mat resizedSegMat(height, width, CV_8UC1, resizedSegBuffer);
-        cv::Mat paddedResizedSegMat(paddedHeight, paddedWidth, CV_8UC1, paddedResizedSegBuffer);
-
-        int borderType = (usePadding == 1 ? cv::BORDER_REFLECT : cv::BORDER_CONSTANT);
-        cv::copyMakeBorder(grayedInputImageMat, paddedGrayedInputImageMat, kernelSize, kernelSize, kernelSize, kernelSize, borderType, 0);
-        cv::copyMakeBorder(resizedSegMat, paddedResizedSegMat, kernelSize, kernelSize, kernelSize, kernelSize, borderType, 0);
+        if(inputFormat == FRAME_FORMAT_RGBA){
+            cv::cvtColor(inputImage, grayImage, cv::COLOR_RGBA2GRAY);
+        }else{
+            cv::Mat lumaPlane(height, width, CV_8UC1, inputImageBuffer);
+            lumaPlane.convertTo(grayImage, CV_8U, 255.0 / 219.0, -16.0 * 255.0 / 219.0);
+        }
 
-        // (7) Simple Joint Bilateral Filter # Tobe fixed
+        // (6) Refinement
         unsigned char grayOutputImageBuffer[width * height];
-        unsigned char* grayOutputImageBuf = &grayOutputImageBuffer[0];
-        for(int y = kernelSize; y < kernelSize + height; y++){
-            for(int x = kernelSize; x < kernelSize + width; x++){
-                int centerVal = paddedGrayedInputImageBuffer[(paddedWidth * y) + x];
-                int norm = 0;
-                int sum  = 0;
-                for(int ky = 0; ky < kernelSize*2+1; ky++){
-                    for(int kx = 0; kx < kernelSize*2+1; kx++){
-                        int positionX = x - kernelSize + kx;
-                        int positionY = y - kernelSize + ky;
-                        int index = std::abs(paddedGrayedInputImageBuffer[paddedWidth * positionY + positionX] - centerVal);
-                        int val = matrixmap[index];
-                        norm += val;
-                        sum += paddedResizedSegBuffer[paddedWidth * positionY + positionX] * val;
-                    }
-                }
-                int pixelValue = sum / norm;
-                *grayOutputImageBuf = pixelValue;
-                grayOutputImageBuf++;
-            }
+        if(refinementType == REFINEMENT_GUIDED){
+            guidedFilter.apply(grayedInputImageBuffer, resizedSegBuffer, grayOutputImageBuffer, width, height, kernelSize, guidedFilterEps);
+        }else{
+            simpleJointBilateralFilter(width, height, grayOutputImageBuffer);
         }
+        STAGE_LAP(timer, STAGE_REFINE);
         cv::Mat grayOutputMat(height, width, CV_8UC1, grayOutputImageBuffer);
         cv::Mat mat255(height, width, CV_8UC1, 255);
         cv::Mat channels[] = {mat255, mat255, mat255, grayOutputMat};
         cv::Mat outMat(height, width, CV_8UC4, outputImageBuffer);
         cv::merge(channels, 4, outMat);
+        STAGE_LAP(timer, STAGE_OUTPUT);
 
         return 0;
     }
 
 
+    // Per-stage timing of exec. Records of [frame, stage, msec], see stage_timer.hpp.
+    //// nullptr / 0 unless built with --copt=-DENABLE_STAGE_TIMING
+    EMSCRIPTEN_KEEPALIVE
+    float *getTimingBufferAddress(){
+        return stageTimingRecords();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getTimingCount(){
+        return stageTimingCount();
+    }
 
+    // Benchmark of mask refinement. simple JBF vs guided filter for kernelSize = 1..9.
+    //// Synthetic guide/mask of (width, height). Result: getBenchmarkResultBufferOffset(), msec per call.
+    EMSCRIPTEN_KEEPALIVE
+    int benchmarkRefinement(int width, int height, int iterations){
+        if(width * height > MAX_WIDTH * MAX_HEIGHT || iterations <= 0){
+            return 1;
+        }
+        cv::Mat guide(height, width, CV_8UC1, grayedInputImageBuffer);
+        cv::Mat mask(height, width, CV_8UC1, resizedSegBuffer);
+        cv::randu(guide, 0, 256);
+        mask.setTo(0);
+        mask(cv::Rect(width / 4, height / 4, width / 2, height / 2)).setTo(255);
+        std::vector<unsigned char> refined(width * height);
+
+        int orgKernelSize = kernelSize;
+        for(int k = 1; k <= BENCHMARK_MAX_KERNEL_SIZE; k++){
+            kernelSize = k;
+            auto jbfStart = high_resolution_clock::now();
+            for(int i = 0; i < iterations; i++){
+                simpleJointBilateralFilter(width, height, refined.data());
+            }
+            auto guidedStart = high_resolution_clock::now();
+            for(int i = 0; i < iterations; i++){
+                guidedFilter.apply(grayedInputImageBuffer, resizedSegBuffer, refined.data(), width, height, k, guidedFilterEps);
+            }
+            auto end = high_resolution_clock::now();
+            float jbfMsec    = std::chrono::duration<float, std::milli>(guidedStart - jbfStart).count() / iterations;
+            float guidedMsec = std::chrono::duration<float, std::milli>(end - guidedStart).count() / iterations;
+            benchmarkResultBuffer[(k - 1) * 2 + 0] = jbfMsec;
+            benchmarkResultBuffer[(k - 1) * 2 + 1] = guidedMsec;
+            printf("[WASM] refinement benchmark (%dx%d) kernel:%d jbf:%fms guided:%fms\n", width, height, k, jbfMsec, guidedMsec);
+        }
+        kernelSize = orgKernelSize;
+        return 0;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    float *getBenchmarkResultBufferOffset(){
+        return benchmarkResultBuffer;
+    }
 
-    
     EMSCRIPTEN_KEEPALIVE
     int loadModel(int bufferSize)
     {
@@ -153,6 +153,7 @@ const App = () => {
 
                 /// Input data
                 const imageData = tmpCtx.getImageData(0, 0, tmp.width, tmp.height)
+                currentTFLite._initInputImageBuffer(tmp.width, tmp.height)
                 const inputImageBufferOffset = currentTFLite._getInputImageBufferOffset()
                 for (let i = 0; i < tmp.width * tmp.height; i++) {
                     currentTFLite.HEAPU8[inputImageBufferOffset + i * 3 + 0] = imageData.data[i * 4 + 0]
@@ -5,11 +5,28 @@ declare function createTFLiteModule(): Promise<TFLite>
 declare function createTFLiteSIMDModule(): Promise<TFLite>
 
 export interface TFLite extends EmscriptenModule {
+    _initModelBuffer(size: number): number
     _getModelBufferMemoryOffset(): number
+    _initInputImageBuffer(width: number, height: number): number
+    _getReservedBufferSize(): number
     _getInputImageBufferOffset(): number
     _getOutputImageBufferOffset(): number
     _loadModel(bufferSize: number): number
     _exec(widht: number, height: number): number
+    _setInputFormat(format: number): number // 3: RGB, 1: I420, 2: NV12
+    _setTileSize(tileSize: number): number // 0: resize to the model input, 64 - 1024 (multiple of 8): full resolution tiles
+    _setTileOverlap(overlap: number): number
+    _setUpsampling(mode: number, radius: number, eps: number): number // 0: bilinear, 1: guided
+
+    /// Streaming (model on keyframes, optical flow warp in between)
+    _setStreaming(enable: number, keyframeInterval: number, threshold: number, flowWidth: number): number
+    _getStreamingKeyframes(): number
+    _getStreamingWarpedFrames(): number
+    _resetStreamingCounters(): number
+
+    /// Stage timing ([frame, stage, msec] records, build with -DENABLE_STAGE_TIMING)
+    _getTimingBufferAddress(): number
+    _getTimingCount(): number
 }
 
 function useTFLite() {
@@ -21,6 +38,7 @@ function useTFLite() {
         const modelResponse = await fetch(modelPath)
         const model = await modelResponse.arrayBuffer()
         console.log('[useTFLite Hook] [loadMeetModel] Model buffer size:', model.byteLength);
+        t._initModelBuffer(model.byteLength)
         const modelBufferOffset = t._getModelBufferMemoryOffset()
         console.log('[useTFLite] [loadMeetModel] Model buffer memory offset:', modelBufferOffset)
         console.log('[useTFLite] [loadMeetModel] Loading model buffer...')
@@ -0,0 +1,84 @@
+#include <cstring>
+#include "replay_util.hpp"
+
+// Native frame replay for white-box-cartoonization. Reports the latency of exec per frame.
+//// bazel build -c opt :replay && bazel-bin/replay --model <tflite> --frames <dir> [--size WxH]
+//// --tile <tile size, 0: resize to the model input(0)> --overlap <tile overlap(16)>
+//// --upsample <0: bilinear, 1: guided(0)> --stream <keyframe interval, 0: off(0)>
+extern "C"
+{
+    int initModelBuffer(int size);
+    char *getModelBufferMemoryOffset();
+    int loadModel(int bufferSize);
+    int initInputImageBuffer(int width, int height);
+    unsigned char *getInputImageBufferOffset();
+    int exec(int width, int height);
+    int setInputFormat(int format);
+    int setTileSize(int size);
+    int setTileOverlap(int overlap);
+    int setUpsampling(int mode, int radius, float eps);
+    int setStreaming(int enable, int keyframeInterval, float threshold, int flowWidth);
+    int getStreamingKeyframes();
+    int getStreamingWarpedFrames();
+}
+
+int main(int argc, char **argv){
+    ReplayOptions opt;
+    if(parseReplayOptions(argc, argv, opt) == false){
+        return 1;
+    }
+    int tile     = intParam(opt, "tile", 0);
+    int overlap  = intParam(opt, "overlap", 16);
+    int upsample = intParam(opt, "upsample", 0);
+    int stream   = intParam(opt, "stream", 0);
+
+    // (1) Load model
+    std::vector<char> model;
+    if(readFile(opt.model, model) == false){
+        return 1;
+    }
+    initModelBuffer(model.size());
+    memcpy(getModelBufferMemoryOffset(), model.data(), model.size());
+    if(loadModel(model.size()) != 0){
+        return 1;
+    }
+
+    if(setTileSize(tile) != 0 || setTileOverlap(overlap) != 0 || setUpsampling(upsample, 2, 0.001f) != 0){
+        return 1;
+    }
+    if(stream > 0 && setStreaming(1, stream, 0.04f, 160) != 0){
+        return 1;
+    }
+
+    int format = replayFormat(opt, FRAME_FORMAT_RGB);
+    if(setInputFormat(format) != 0){
+        return 1;
+    }
+
+    // (2) Replay frames
+    std::vector<std::string> frames = listFrames(opt.frameDir);
+    std::vector<unsigned char> encoded;
+    LatencyRecorder recorder;
+    for(int r = 0; r < opt.repeat; r++){
+        for(const std::string &path : frames){
+            cv::Mat frame;
+            if(loadFrame(path, opt, 4, frame) == false || encodeFrame(frame, format, encoded) == false){
+                continue;
+            }
+            initInputImageBuffer(frame.cols, frame.rows);
+            memcpy(getInputImageBufferOffset(), encoded.data(), encoded.size());
+            recorder.start();
+            int ret = exec(frame.cols, frame.rows);
+            recorder.stop(path);
+            if(ret != 0){
+                printf("[REPLAY] exec failed (%d) at %s\n", ret, path.c_str());
+                return 1;
+            }
+        }
+    }
+    recorder.summary();
+    if(stream > 0){
+        printf("[REPLAY] streaming: %d keyframes, %d warped frames\n", getStreamingKeyframes(), getStreamingWarpedFrames());
+    }
+    return 0;
+}
@@ -1,11 +1,17 @@
-#include <SDL/SDL.h>
 #include <cstdio>
-#include <emscripten.h>
+#include "platform.hpp"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/model.h"
 #include "opencv2/opencv.hpp"
 #include <cmath>
-#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "buffer_arena.hpp"
+#include "stage_timer.hpp"
+#include "frame_format.hpp"
+#include "guided_filter.hpp"
+#include "tensor_feeder.hpp"
 
 #define CHECK_TFLITE_ERROR(x)                                    \
     if (!(x))                                                    \
@@ -16,31 +22,302 @@
 
 
 namespace{
-    const int MAX_WIDTH   = 512;
-    const int MAX_HEIGHT  = 512;
-    char modelBuffer[1024*1024*256]; 
+    ///// Buffers, sized on demand
+    //// model: initModelBuffer(size), frame: initInputImageBuffer(width, height), tensor: loadModel
+    BufferArena arena;
+    const int SLOT_MODEL          = 0;
+    const int SLOT_INPUT_IMAGE    = 1;
+    const int SLOT_OUTPUT_IMAGE   = 2;
+    const int SLOT_RESIZED_IMAGE  = 3;
+    const int SLOT_RESULT_IMAGE   = 4;
+    const int SLOT_FRAME_RGB      = 5;
+    const int SLOT_TILE_ACC       = 6;
+    const int SLOT_TILE_WEIGHT    = 7;
+    const int SLOT_STREAM_KEY     = 8;
+
+    char *modelBuffer = nullptr;
     
     ///// Buffer for image processing
-    unsigned char inputImageBuffer[3 * MAX_WIDTH * MAX_HEIGHT]; 
-    unsigned char resizedImageBuffer[3 * MAX_WIDTH * MAX_HEIGHT]; 
-    unsigned char resultImageBuffer[3 * MAX_WIDTH * MAX_HEIGHT];
-    unsigned char outputImageBuffer[3 * MAX_WIDTH * MAX_HEIGHT];  
+    unsigned char *inputImageBuffer   = nullptr;   // frame size
+    unsigned char *outputImageBuffer  = nullptr;   // frame size
+    unsigned char *resizedImageBuffer = nullptr;   // tensor size
+    unsigned char *resultImageBuffer  = nullptr;   // tensor size
+
+    ///// Layout of inputImageBuffer (setInputFormat). FRAME_FORMAT_RGB, FRAME_FORMAT_I420 or FRAME_FORMAT_NV12.
+    //// YUV input is resized plane by plane and converted at the tensor size. The output is RGB.
+    int inputFormat = FRAME_FORMAT_RGB;
+
+    ///// Upsampling of the result to the frame size (setUpsampling), for the non tiled path
+    //// UPSAMPLE_LINEAR: bilinear resize of the result.
+    //// UPSAMPLE_GUIDED: the stylization residual (result - model input) is fitted against the model input and applied
+    //// to the full resolution frame (guided upsampling). Edges and texture come from the frame, colors from the model.
+    const int UPSAMPLE_LINEAR = 0;
+    const int UPSAMPLE_GUIDED = 1;
+    int upsampleMode   = UPSAMPLE_LINEAR;
+    int guidedRadius   = 2;         // at the model input resolution
+    float guidedEps    = 0.001f;    // normalized (0.0 - 1.0) intensity units
+    GuidedFilter guidedFilter;
+
+    // Full resolution RGB of the frame. YUV input is converted once into SLOT_FRAME_RGB.
+    const unsigned char *frameRGB(int width, int height){
+        if(inputFormat == FRAME_FORMAT_RGB){
+            return inputImageBuffer;
+        }
+        unsigned char *rgb = arena.reserve(SLOT_FRAME_RGB, 3 * width * height);
+        if(rgb != nullptr){
+            convertFrame(inputFormat, inputImageBuffer, width, height, FRAME_FORMAT_RGB, rgb);
+        }
+        return rgb;
+    }
+
+    ///// Streaming (setStreaming): the model runs on keyframes only
+    //// In-between frames warp the result of the keyframe with dense optical flow (DIS) from the frame to the keyframe,
+    //// computed on luma downsampled to streamFlowWidth. Warping the keyframe (not the previous output) keeps the
+    //// in-between frames from blurring out. A new keyframe is made every streamKeyframeInterval frames, or when the
+    //// keyframe luma warped by the flow no longer matches the frame (occlusion, scene change).
+    int   streamEnable           = 0;
+    int   streamKeyframeInterval = 10;      // run the model at least every N frames
+    float streamThreshold        = 0.04;    // mean abs luma error of the warped keyframe (0.0 - 1.0)
+    int   streamFlowWidth        = 160;     // width of the luma the flow is computed on
+    int   streamHasKeyframe      = 0;
+    int   streamFramesSinceKeyframe = 0;
+    int   streamFrameWidth       = 0;
+    int   streamFrameHeight      = 0;
+    int   streamKeyframes        = 0;
+    int   streamWarpedFrames     = 0;
+    //// The Mats below keep their memory between frames, so a steady stream of one size does not allocate.
+    cv::Mat streamSmallRGB;                 // RGB input resized to the flow size
+    cv::Mat streamLuma;                     // current frame, flow size
+    cv::Mat streamKeyLuma;                  // keyframe, flow size
+    cv::Mat streamFlow;                     // frame -> keyframe, flow size
+    cv::Mat streamFlowMap;                  // frame -> keyframe, flow size (remap)
+    cv::Mat streamWarpedLuma;               // keyframe luma warped by the flow, flow size
+    cv::Mat streamMap;                      // frame -> keyframe, frame size (remap)
+    cv::Ptr<cv::DISOpticalFlow> streamDIS;
+
+    // Luma of the frame at the flow size. YUV input: the Y plane, RGB: resized then converted.
+    void streamLumaOf(int width, int height){
+        int flowHeight = std::max(8, (height * streamFlowWidth + width / 2) / width);
+        cv::Size flowSize(streamFlowWidth, flowHeight);
+        if(inputFormat == FRAME_FORMAT_RGB){
+            cv::resize(cv::Mat(height, width, CV_8UC3, inputImageBuffer), streamSmallRGB, flowSize, 0, 0, cv::INTER_AREA);
+            cv::cvtColor(streamSmallRGB, streamLuma, cv::COLOR_RGB2GRAY);
+        }else{
+            cv::resize(cv::Mat(height, width, CV_8UC1, inputImageBuffer), streamLuma, flowSize, 0, 0, cv::INTER_AREA);
+        }
+    }
+
+    // Writes the warped keyframe result into the output and returns true, or returns false when a keyframe is needed.
+    bool streamWarp(int width, int height){
+        streamLumaOf(width, height);
+        bool forceKeyframe = streamHasKeyframe == 0
+                          || width != streamFrameWidth || height != streamFrameHeight
+                          || streamFramesSinceKeyframe + 1 >= streamKeyframeInterval;
+        if(forceKeyframe){
+            return false;
+        }
 
+        // (a) flow frame -> keyframe, and the error of the keyframe luma warped by it
+        if(streamDIS.empty()){
+            streamDIS = cv::DISOpticalFlow::create(cv::DISOpticalFlow::PRESET_ULTRAFAST);
+        }
+        streamDIS->calc(streamLuma, streamKeyLuma, streamFlow);
+        streamFlowMap.create(streamFlow.size(), CV_32FC2);
+        for(int y = 0; y < streamFlowMap.rows; y++){
+            const cv::Point2f *f = streamFlow.ptr<cv::Point2f>(y);
+            cv::Point2f *m = streamFlowMap.ptr<cv::Point2f>(y);
+            for(int x = 0; x < streamFlowMap.cols; x++){
+                m[x] = cv::Point2f(x + f[x].x, y + f[x].y);
+            }
+        }
+        cv::remap(streamKeyLuma, streamWarpedLuma, streamFlowMap, cv::noArray(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+        double error = cv::norm(streamWarpedLuma, streamLuma, cv::NORM_L1) / (255.0 * streamLuma.total());
+        if(error > streamThreshold){
+            return false;
+        }
+
+        // (b) warp the keyframe result with the flow scaled to the frame
+        //// the flow is resized straight into streamMap and turned into the remap grid in place
+        float sx = (float)width  / streamFlow.cols;
+        float sy = (float)height / streamFlow.rows;
+        cv::resize(streamFlow, streamMap, cv::Size(width, height), 0, 0, cv::INTER_LINEAR);
+        for(int y = 0; y < height; y++){
+            cv::Point2f *m = streamMap.ptr<cv::Point2f>(y);
+            for(int x = 0; x < width; x++){
+                m[x] = cv::Point2f(x + m[x].x * sx, y + m[x].y * sy);
+            }
+        }
+        cv::Mat keyOutput(height, width, CV_8UC3, arena.reserve(SLOT_STREAM_KEY, 3 * width * height));
+        cv::Mat output(height, width, CV_8UC3, outputImageBuffer);
+        cv::remap(keyOutput, output, streamMap, cv::noArray(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+        streamFramesSinceKeyframe++;
+        streamWarpedFrames++;
+        return true;
+    }
+
+    // Keeps the result of a model run as the new keyframe.
+    void streamKeep(int width, int height){
+        unsigned char *key = arena.reserve(SLOT_STREAM_KEY, 3 * width * height);
+        if(key == nullptr){
+            streamHasKeyframe = 0;
+            return;
+        }
+        memcpy(key, outputImageBuffer, 3 * width * height);
+        streamLuma.copyTo(streamKeyLuma);
+        streamHasKeyframe         = 1;
+        streamFramesSinceKeyframe = 0;
+        streamFrameWidth          = width;
+        streamFrameHeight         = height;
+        streamKeyframes++;
+    }
+
+    ///// Input size of the model. The interpreter is resized to the tile for the tiled mode and back to this size otherwise.
+    int modelTensorWidth  = 0;
+    int modelTensorHeight = 0;
+
+    ///// Tiled cartoonization (setTileSize / setTileOverlap)
+    //// 0: the frame is resized to the tensor and the result is resized back, so the sharpness is capped at the tensor size.
+    //// > 0: the full resolution frame goes through the interpreter (resized to tileSize x tileSize once) tile by tile.
+    //// Tiles overlap by tileOverlap pixels and the seams are blended with linear ramps over the overlap.
+    int tileSize    = 0;
+    int tileOverlap = 16;
+    std::vector<float> tileRampX;
+    std::vector<float> tileRampY;
+
+    // Tile origins covering the length, stepping (tile - overlap). The last tile is aligned to the end.
+    void tileOrigins(int length, int tile, int overlap, std::vector<int> &origins){
+        origins.clear();
+        if(length <= tile){
+            origins.push_back(0);
+            return;
+        }
+        for(int o = 0; ; o += tile - overlap){
+            if(o + tile >= length){
+                origins.push_back(length - tile);
+                break;
+            }
+            origins.push_back(o);
+        }
+    }
+
+    // Blend weight along one axis of a tile. Ramps up / down over the overlap on the sides shared with a neighbor.
+    void tileRamp(int length, int ramp, bool head, bool tail, std::vector<float> &weight){
+        weight.assign(length, 1.0f);
+        for(int i = 0; i < ramp && i < length; i++){
+            float w = (i + 0.5f) / ramp;
+            if(head){
+                weight[i] = std::min(weight[i], w);
+            }
+            if(tail){
+                weight[length - 1 - i] = std::min(weight[length - 1 - i], w);
+            }
+        }
+    }
+
+    // Input of the interpreter resized to (width, height). Tensors are re-allocated only when the size changes.
+    int fitInterpreter(tflite::Interpreter *interpreter, int width, int height){
+        const TfLiteIntArray *dims = interpreter->input_tensor(0)->dims;
+        if(dims->data[1] == height && dims->data[2] == width){
+            return 0;
+        }
+        CHECK_TFLITE_ERROR(interpreter->ResizeInputTensor(interpreter->inputs()[0], {1, height, width, 3}) == kTfLiteOk);
+        CHECK_TFLITE_ERROR(interpreter->AllocateTensors() == kTfLiteOk);
+        return 0;
+    }
+
+    // Frame (RGB) -> cartoonized frame (RGB, same size), tile by tile.
+    int cartoonizeTiled(tflite::Interpreter *interpreter, const unsigned char *frame, int width, int height, unsigned char *dst){
+        const int overlap     = std::min(tileOverlap, tileSize / 2);
+        const size_t pixelNum = (size_t)width * height;
+        float *acc    = (float*)arena.reserve(SLOT_TILE_ACC,    sizeof(float) * 3 * pixelNum);
+        float *weight = (float*)arena.reserve(SLOT_TILE_WEIGHT, sizeof(float) * pixelNum);
+        if(acc == nullptr || weight == nullptr){
+            return 1;
+        }
+        memset(acc,    0, sizeof(float) * 3 * pixelNum);
+        memset(weight, 0, sizeof(float) * pixelNum);
+
+        std::vector<int> xs, ys;
+        tileOrigins(width,  tileSize, overlap, xs);
+        tileOrigins(height, tileSize, overlap, ys);
+        float *input = interpreter->typed_input_tensor<float>(0);
+        for(size_t ty = 0; ty < ys.size(); ty++){
+            tileRamp(tileSize, overlap, ty > 0, ty + 1 < ys.size(), tileRampY);
+            for(size_t tx = 0; tx < xs.size(); tx++){
+                tileRamp(tileSize, overlap, tx > 0, tx + 1 < xs.size(), tileRampX);
+                const int x0 = xs[tx];
+                const int y0 = ys[ty];
+
+                // (a) tile input (-1.0 - 1.0). Edge pixels are repeated when the frame is smaller than the tile.
+                for(int j = 0; j < tileSize; j++){
+                    const unsigned char *src = frame + ((size_t)std::min(y0 + j, height - 1) * width + x0) * 3;
+                    float *in = input + j * tileSize * 3;
+                    const int valid = std::min(tileSize, width - x0);
+                    feedU8ToF32(src, in, valid * 3, 1.0f / 127.5f, -1.0f);
+                    for(int i = valid; i < tileSize; i++){
+                        memcpy(in + i * 3, in + (valid - 1) * 3, sizeof(float) * 3);
+                    }
+                }
+
+                // (b) infer
+                CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+
+                // (c) accumulate the weighted tile (0 - 255)
+                const float *output   = interpreter->typed_output_tensor<float>(0);
+                const int validWidth  = std::min(tileSize, width  - x0);
+                const int validHeight = std::min(tileSize, height - y0);
+                for(int j = 0; j < validHeight; j++){
+                    const float *o = output + j * tileSize * 3;
+                    float *a = acc    + ((size_t)(y0 + j) * width + x0) * 3;
+                    float *w = weight + (size_t)(y0 + j) * width + x0;
+                    for(int i = 0; i < validWidth; i++){
+                        float tw = tileRampX[i] * tileRampY[j] * 127.5f;
+                        a[i * 3 + 0] += (o[i * 3 + 0] + 1.0f) * tw;
+                        a[i * 3 + 1] += (o[i * 3 + 1] + 1.0f) * tw;
+                        a[i * 3 + 2] += (o[i * 3 + 2] + 1.0f) * tw;
+                        w[i] += tileRampX[i] * tileRampY[j];
+                    }
+                }
+            }
+        }
+
+        // (d) normalize
+        for(size_t p = 0; p < pixelNum; p++){
+            float inv = 1.0f / weight[p];
+            for(int c = 0; c < 3; c++){
+                float v = acc[p * 3 + c] * inv + 0.5f;
+                dst[p * 3 + c] = v < 0.0f ? 0 : (v > 255.0f ? 255 : (unsigned char)v);
+            }
+        }
+        return 0;
+    }
 }
 
-using std::chrono::high_resolution_clock;
 std::unique_ptr<tflite::Interpreter> interpreter;
 
-auto start_time = high_resolution_clock::now();
-auto count = 0;
-
 extern "C"
 {
+    EMSCRIPTEN_KEEPALIVE
+    int initModelBuffer(int size){
+        modelBuffer = (char*)arena.reserve(SLOT_MODEL, size);
+        return modelBuffer != nullptr ? 0 : 1;
+    }
     EMSCRIPTEN_KEEPALIVE
     char *getModelBufferMemoryOffset(){
         return modelBuffer;
     }
 
+    EMSCRIPTEN_KEEPALIVE
+    int initInputImageBuffer(int width, int height){
+        inputImageBuffer  = arena.reserve(SLOT_INPUT_IMAGE,  3 * width * height);
+        outputImageBuffer = arena.reserve(SLOT_OUTPUT_IMAGE, 3 * width * height);
+        return inputImageBuffer != nullptr && outputImageBuffer != nullptr ? 0 : 1;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getReservedBufferSize(){
+        return arena.reserved();
+    }
+
     EMSCRIPTEN_KEEPALIVE
     unsigned char *getInputImageBufferOffset(){
         return inputImageBuffer;
@@ -51,41 +328,170 @@ extern "C"
         return outputImageBuffer;
     }
 
+    // format: 3 RGB, 1 I420, 2 NV12 (see frame_format.hpp). Width and height must be even for I420 / NV12.
+    EMSCRIPTEN_KEEPALIVE
+    int setInputFormat(int format){
+        if(format != FRAME_FORMAT_RGB && isYUVFrameFormat(format) == false){
+            printf("[WASM] invalid input format %d\n", format);
+            return 1;
+        }
+        inputFormat = format;
+        streamHasKeyframe = 0;
+        return 0;
+    }
+
     EMSCRIPTEN_KEEPALIVE
     int exec(int width, int height){
-        int tensorWidth  = interpreter->input_tensor(0)->dims->data[2];
-        int tensorHeight = interpreter->input_tensor(0)->dims->data[1];
+        STAGE_TIMER(timer);
+        size_t frameSize = frameBufferSize(inputFormat, width, height);
+        if(frameSize == 0 || arena.capacity(SLOT_INPUT_IMAGE) < frameSize){
+            printf("[WASM] frame (%d, %d) exceeds the buffer (or odd size for YUV). call initInputImageBuffer first.\n", width, height);
+            return 1;
+        }
+        //// Streaming: in-between frames warp the last keyframe result
+        if(streamEnable == 1 && streamWarp(width, height)){
+            STAGE_LAP(timer, STAGE_OUTPUT);
+            return 0;
+        }
 
-        //// Resize
-        cv::Mat inputImage(height, width, CV_8UC3, (unsigned char*)inputImageBuffer);
+        //// Tiled: full resolution in, full resolution out
+        if(tileSize > 0){
+            CHECK_TFLITE_ERROR(fitInterpreter(interpreter.get(), tileSize, tileSize) == 0);
+            const unsigned char *frame = frameRGB(width, height);
+            CHECK_TFLITE_ERROR(frame != nullptr);
+            STAGE_LAP(timer, STAGE_PREPROCESS);
+            CHECK_TFLITE_ERROR(cartoonizeTiled(interpreter.get(), frame, width, height, outputImageBuffer) == 0);
+            STAGE_LAP(timer, STAGE_INVOKE);
+            if(streamEnable == 1){
+                streamKeep(width, height);
+            }
+            return 0;
+        }
+
+        CHECK_TFLITE_ERROR(fitInterpreter(interpreter.get(), modelTensorWidth, modelTensorHeight) == 0);
+        int tensorWidth  = modelTensorWidth;
+        int tensorHeight = modelTensorHeight;
+
+        //// Resize (and convert YUV input at the tensor size)
         cv::Mat resizedImage(tensorHeight, tensorWidth, CV_8UC3, (unsigned char*)resizedImageBuffer);
-        cv::resize(inputImage, resizedImage, resizedImage.size(), 0, 0, cv::INTER_LINEAR);
+        resizeFrame(inputFormat, inputImageBuffer, width, height, FRAME_FORMAT_RGB, resizedImage, cv::INTER_LINEAR);
 
-        //// input
+        //// input (-1.0 - 1.0)
         float *input = interpreter->typed_input_tensor<float>(0);
-        for(int i = 0; i < tensorHeight * tensorWidth; i++){
-            input[i * 3 + 0] = resizedImageBuffer[i * 3 + 0] / 127.5 - 1;
-            input[i * 3 + 1] = resizedImageBuffer[i * 3 + 1] / 127.5 - 1;
-            input[i * 3 + 2] = resizedImageBuffer[i * 3 + 2] / 127.5 - 1;
-        }
+        feedU8ToF32(resizedImageBuffer, input, tensorHeight * tensorWidth * 3, 1.0f / 127.5f, -1.0f);
+        STAGE_LAP(timer, STAGE_PREPROCESS);
 
         // infer       
         CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+        STAGE_LAP(timer, STAGE_INVOKE);
 
         // output
+        //// (-1.0 - 1.0) -> (0 - 255)
         float *output = interpreter->typed_output_tensor<float>(0);
-        cv::Mat resultImage32FC(tensorHeight, tensorWidth, CV_32FC3, output);
         cv::Mat resultImage8UC(tensorHeight, tensorWidth, CV_8UC3, resultImageBuffer);
         cv::Mat resizedResultImage(height, width, CV_8UC3, outputImageBuffer);
-        
-        resultImage32FC = resultImage32FC +  cv::Scalar(1, 1, 1);
-        resultImage32FC = resultImage32FC * 127.5;
-        resultImage32FC.convertTo(resultImage8UC, CV_8UC3);
-        cv::resize(resultImage8UC, resizedResultImage, resizedResultImage.size(), 0, 0, cv::INTER_LINEAR);
+        readF32ToU8(output, resultImageBuffer, tensorHeight * tensorWidth * 3, 127.5f, 127.5f);
+        STAGE_LAP(timer, STAGE_DECODE);
+        if(upsampleMode == UPSAMPLE_GUIDED){
+            const unsigned char *frame = frameRGB(width, height);
+            CHECK_TFLITE_ERROR(frame != nullptr);
+            for(int c = 0; c < 3; c++){
+                guidedFilter.upsample(resizedImageBuffer + c, resultImageBuffer + c, tensorWidth, tensorHeight,
+                                      frame + c, outputImageBuffer + c, width, height, 3, guidedRadius, guidedEps);
+            }
+        }else{
+            cv::resize(resultImage8UC, resizedResultImage, resizedResultImage.size(), 0, 0, cv::INTER_LINEAR);
+        }
+        if(streamEnable == 1){
+            streamKeep(width, height);
+        }
+        STAGE_LAP(timer, STAGE_OUTPUT);
 
         return 0;
     }
     
+    // Tiled cartoonization for exec. size: 0 (resize the frame to the model input) or 64 - 1024, multiple of 8.
+    //// The interpreter is resized to size x size at the next exec. Larger tiles: fewer invokes, more tensor memory.
+    EMSCRIPTEN_KEEPALIVE
+    int setTileSize(int size){
+        if(size != 0 && (size < 64 || size > 1024 || size % 8 != 0)){
+            printf("[WASM] invalid tile size %d\n", size);
+            return 1;
+        }
+        tileSize = size;
+        streamHasKeyframe = 0;
+        return 0;
+    }
+
+    // Overlap of neighbor tiles in pixels, clamped to tileSize / 2. The seams are blended over it.
+    EMSCRIPTEN_KEEPALIVE
+    int setTileOverlap(int overlap){
+        if(overlap < 0 || overlap > 512){
+            printf("[WASM] invalid tile overlap %d\n", overlap);
+            return 1;
+        }
+        tileOverlap = overlap;
+        return 0;
+    }
+
+    // Upsampling of the model result to the frame size (resize path, tileSize 0)
+    //// mode: 0 bilinear, 1 guided (radius: 1 - 16 at the model input resolution, eps: > 0, normalized intensity)
+    EMSCRIPTEN_KEEPALIVE
+    int setUpsampling(int mode, int radius, float eps){
+        if((mode != UPSAMPLE_LINEAR && mode != UPSAMPLE_GUIDED) || radius < 1 || radius > 16 || eps <= 0.0f){
+            printf("[WASM] invalid upsampling (%d, %d, %f)\n", mode, radius, eps);
+            return 1;
+        }
+        upsampleMode = mode;
+        guidedRadius = radius;
+        guidedEps    = eps;
+        streamHasKeyframe = 0;
+        return 0;
+    }
+
+    // Streaming (the model runs on keyframes, the frames between warp the keyframe result with optical flow)
+    //// keyframeInterval: the model runs at least every N frames (1 - 120)
+    //// threshold: mean abs luma error (0.0 - 1.0) of the warped keyframe above which the model runs again
+    //// flowWidth: width of the downsampled luma for the flow (32 - 640)
+    EMSCRIPTEN_KEEPALIVE
+    int setStreaming(int enable, int keyframeInterval, float threshold, int flowWidth){
+        if(keyframeInterval < 1 || keyframeInterval > 120 || threshold < 0.0f || flowWidth < 32 || flowWidth > 640){
+            printf("[WASM] invalid streaming (%d, %f, %d)\n", keyframeInterval, threshold, flowWidth);
+            return 1;
+        }
+        streamEnable           = enable;
+        streamKeyframeInterval = keyframeInterval;
+        streamThreshold        = threshold;
+        streamFlowWidth        = flowWidth;
+        streamHasKeyframe      = 0;
+        return 0;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getStreamingKeyframes(){
+        return streamKeyframes;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getStreamingWarpedFrames(){
+        return streamWarpedFrames;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int resetStreamingCounters(){
+        streamKeyframes    = 0;
+        streamWarpedFrames = 0;
+        return 0;
+    }
+
+    // Per-stage timing of exec. Records of [frame, stage, msec], see stage_timer.hpp.
+    //// nullptr / 0 unless built with --copt=-DENABLE_STAGE_TIMING
+    EMSCRIPTEN_KEEPALIVE
+    float *getTimingBufferAddress(){
+        return stageTimingRecords();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getTimingCount(){
+        return stageTimingCount();
+    }
+
     EMSCRIPTEN_KEEPALIVE
     int loadModel(int bufferSize){
         printf("[WASM] --------------------------------------------------------\n");
@@ -106,6 +512,12 @@ extern "C"
         CHECK_TFLITE_ERROR(interpreter != nullptr);
         CHECK_TFLITE_ERROR(interpreter->AllocateTensors() == kTfLiteOk);
 
+        modelTensorWidth  = interpreter->input_tensor(0)->dims->data[2];
+        modelTensorHeight = interpreter->input_tensor(0)->dims->data[1];
+        resizedImageBuffer = arena.reserve(SLOT_RESIZED_IMAGE, 3 * modelTensorWidth * modelTensorHeight);
+        resultImageBuffer  = arena.reserve(SLOT_RESULT_IMAGE,  3 * modelTensorWidth * modelTensorHeight);
+        printf("[WASM] Reserved buffer size: %zu\n", arena.reserved());
+        streamHasKeyframe = 0;
         return 0;
     }
 }
\ No newline at end of file
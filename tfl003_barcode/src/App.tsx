@@ -159,6 +159,7 @@ export const App = () => {
 
                 /// Input data
                 const imageData = tmpCtx.getImageData(0, 0, tmp.width, tmp.height)                
+                currentTFLite._initInputImageBuffer(tmp.width, tmp.height)
                 const inputImageBufferOffset = currentTFLite._getInputImageBufferOffset()
                 currentTFLite.HEAPU8.set(imageData.data, inputImageBufferOffset);
 
@@ -6,7 +6,10 @@ declare function createTFLiteSIMDModule(): Promise<TFLite>
 declare function createTFLiteModule_for_safari(): Promise<TFLite>
 
 export interface TFLite extends EmscriptenModule {
+    _initModelBuffer(size: number): number
     _getModelBufferMemoryOffset(): number
+    _initInputImageBuffer(width: number, height: number): number
+    _getReservedBufferSize(): number
     _getInputImageBufferOffset(): number
     _getOutputImageBufferOffset(): number
 
@@ -15,6 +18,28 @@ export interface TFLite extends EmscriptenModule {
 
     _loadModel(bufferSize: number): number
     _exec(widht: number, height: number, scale:number, mode:number): number
+    _setInputFormat(format: number): number // 3: RGB, 1: I420, 2: NV12
+
+    /// Classical localizer in front of the model. mode 0: none, 1: gate, 2: ROI. size: shorter side for the detector
+    _setPreFilter(mode: number, size: number, minScore: number): number
+    _getCandidateBufferAddress(): number // [x0, y0, x1, y1, x2, y2, x3, y3, score] float32 x getCandidateCount()
+    _getCandidateCount(): number
+
+    /// Decision at tensor resolution. Quads of the mask scaled to the frame; the frame size mask is optional
+    _setMaskOutput(enable: number): number // 1: probability at frame size in the output image buffer, 0: quads only
+    _setQuadThreshold(threshold: number): number
+    _getQuadBufferAddress(): number // [x0, y0, x1, y1, x2, y2, x3, y3, score] float32 x getQuadCount()
+    _getQuadCount(): number
+
+    /// Tracking. The model runs on detection frames, quads are followed with optical flow in between
+    _setTracking(enable: number, interval: number, minCoherence: number): number
+    _getTrackingDetectedFrames(): number
+    _getTrackingTrackedFrames(): number
+    _resetTrackingCounters(): number
+
+    /// Stage timing ([frame, stage, msec] records, build with -DENABLE_STAGE_TIMING)
+    _getTimingBufferAddress(): number
+    _getTimingCount(): number
 }
 
 function useTFLite() {
@@ -26,6 +51,7 @@ function useTFLite() {
         const modelResponse = await fetch(modelPath)
         const model = await modelResponse.arrayBuffer()
         console.log('[useTFLite Hook] [loadMeetModel] Model buffer size:', model.byteLength);
+        t._initModelBuffer(model.byteLength)
         const modelBufferOffset = t._getModelBufferMemoryOffset()
         console.log('[useTFLite] [loadMeetModel] Model buffer memory offset:', modelBufferOffset)
         console.log('[useTFLite] [loadMeetModel] Loading model buffer...')
@@ -1,42 +1,18 @@
 #include "bardetect.hpp"
 
+#include <opencv2/core/utility.hpp>
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 #include <numeric>
 #include <string>
 
 namespace cv {
 namespace barcode {
 static constexpr float PI = static_cast<float>(CV_PI);
-static constexpr float HALF_PI = static_cast<float>(CV_PI / 2);
-
-#define CALCULATE_SUM(ptr, result) \
-    top_left = static_cast<float>(*((ptr) + left_col + integral_cols * top_row));\
-    top_right = static_cast<float>(*((ptr) + integral_cols * top_row + right_col));\
-    bottom_right = static_cast<float>(*((ptr) + right_col + bottom_row * integral_cols));\
-    bottom_left = static_cast<float>(*((ptr) + bottom_row * integral_cols + left_col));\
-    (result) = (bottom_right - bottom_left - top_right + top_left);
-
-
-inline bool Detect::isValidCoord(const Point &coord, const Size &limit)
-{
-    if ((coord.x < 0) || (coord.y < 0))
-    {
-        return false;
-    }
-
-    if ((unsigned) coord.x > (unsigned) (limit.width - 1) || ((unsigned) coord.y > (unsigned) (limit.height - 1)))
-    {
-        return false;
-    }
-
-    return true;
-}
-
 
 void Detect::init(const Mat &src)
 {
     const double min_side = std::min(src.size().width, src.size().height);
-    printf("init!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!1\n");
 
     if (min_side > 512.0 * 10)
     {
@@ -72,24 +48,37 @@ void Detect::init(const Mat &src)
 
 void Detect::localization()
 {
-    printf("localization!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!1\n");
     localization_bbox.clear();
     bbox_scores.clear();
 
     // get integral image
     preprocess();
     // empirical setting
-    static constexpr float SCALE_LIST[] = {0.01f, 0.03f, 0.06f, 0.08f};
+    static constexpr float SCALE_LIST[SCALE_NUM] = {0.01f, 0.03f, 0.06f, 0.08f};
     const auto min_side = static_cast<float>(std::min(width, height));
-    int window_size;
-    for (const float scale:SCALE_LIST)
+    for (int i = 0; i < SCALE_NUM; i++)
     {
-        window_size = cvRound(min_side * scale);
-        calCoherence(window_size);
-        barcodeErode();
-        regionGrowing(window_size);
+        scales[i].window_size = std::max(1, cvRound(min_side * SCALE_LIST[i]));
+    }
+    // the scales only read the integral images, so they run side by side (serially without threads)
+    parallel_for_(Range(0, SCALE_NUM), [this](const Range &range)
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            Scale &scale = scales[i];
+            scale.bbox.clear();
+            scale.scores.clear();
+            calCoherence(scale);
+            barcodeErode(scale);
+            regionGrowing(scale);
+        }
+    });
+    // merged in the order of SCALE_LIST, same as one scale after another
+    for (const Scale &scale : scales)
+    {
+        localization_bbox.insert(localization_bbox.end(), scale.bbox.begin(), scale.bbox.end());
+        bbox_scores.insert(bbox_scores.end(), scale.scores.begin(), scale.scores.end());
     }
-
 }
 
 
@@ -98,11 +87,12 @@ bool Detect::computeTransformationPoints()
 
     bbox_indices.clear();
     transformation_points.clear();
-    transformation_points.reserve(bbox_indices.size());
+    transformation_scores.clear();
     RotatedRect rect;
     Point2f temp[4];
     const float THRESHOLD_SCORE = float(width * height) / 300.f;
-    dnn::NMSBoxes(localization_bbox, bbox_scores, THRESHOLD_SCORE, 0.1f, bbox_indices);
+    suppressOverlaps(localization_bbox, bbox_scores, THRESHOLD_SCORE, 0.1f, bbox_indices);
+    transformation_points.reserve(bbox_indices.size());
 
     for (const auto &bbox_index : bbox_indices)
     {
@@ -121,136 +111,371 @@ bool Detect::computeTransformationPoints()
         }
         rect.points(temp);
         transformation_points.emplace_back(vector<Point2f>{temp[0], temp[1], temp[2], temp[3]});
+        transformation_scores.push_back(bbox_scores[bbox_index] / float(width * height));
     }
 
     return !transformation_points.empty();
 }
 
 
-void Detect::preprocess()
+float Detect::coherenceScore(const Mat &gray, float min_edge_ratio)
 {
-    Mat scharr_x, scharr_y, temp;
-    static constexpr double THRESHOLD_MAGNITUDE = 64.;
-    Scharr(resized_barcode, scharr_x, CV_32F, 1, 0);
-    Scharr(resized_barcode, scharr_y, CV_32F, 0, 1);
-    // calculate magnitude of gradient and truncate
-    magnitude(scharr_x, scharr_y, temp);
-    threshold(temp, temp, THRESHOLD_MAGNITUDE, 1, THRESH_BINARY);
-    temp.convertTo(gradient_magnitude, CV_8U);
-    integral(gradient_magnitude, integral_edges, CV_32F);
+    resized_barcode = gray;
+    width = gray.cols;
+    height = gray.rows;
+    preprocess();
+    const float edges = integral_edges.at<float_t>(height, width);
+    if (edges <= 0 || edges < min_edge_ratio * float(width * height))
+    {
+        return 0.f;
+    }
+    const float x_sq = integral_x_sq.at<float_t>(height, width);
+    const float y_sq = integral_y_sq.at<float_t>(height, width);
+    const float xy = integral_xy.at<float_t>(height, width);
+    return sqrt((x_sq - y_sq) * (x_sq - y_sq) + 4 * xy * xy) / (x_sq + y_sq);
+}
 
 
-    for (int y = 0; y < height; y++)
+// Greedy non maximum suppression of rotated boxes, same as dnn::NMSBoxes (without the dnn module).
+// indices: boxes with score > score_threshold that overlap no higher scored kept box by more than iou_threshold.
+void Detect::suppressOverlaps(const vector<RotatedRect> &boxes, const vector<float> &scores, float score_threshold,
+                              float iou_threshold, vector<int> &indices)
+{
+    vector<int> order;
+    for (int i = 0; i < static_cast<int>(scores.size()); i++)
     {
-        auto *const x_row = scharr_x.ptr<float_t>(y);
-        auto *const y_row = scharr_y.ptr<float_t>(y);
-        auto *const magnitude_row = gradient_magnitude.ptr<uint8_t>(y);
-        for (int pos = 0; pos < width; pos++)
+        if (scores[i] > score_threshold)
         {
-            if (magnitude_row[pos] == 0)
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&scores](int a, int b) { return scores[a] > scores[b]; });
+
+    vector<Point2f> intersection;
+    for (const int i : order)
+    {
+        bool keep = true;
+        for (const int k : indices)
+        {
+            if (rotatedRectangleIntersection(boxes[i], boxes[k], intersection) == INTERSECT_NONE)
             {
-                x_row[pos] = 0;
-                y_row[pos] = 0;
                 continue;
             }
-            if (x_row[pos] < 0)
+            const float inter = static_cast<float>(contourArea(intersection));
+            const float uni = boxes[i].size.area() + boxes[k].size.area() - inter;
+            if (uni > 0 && inter / uni > iou_threshold)
             {
-                x_row[pos] *= -1;
-                y_row[pos] *= -1;
+                keep = false;
+                break;
             }
         }
+        if (keep)
+        {
+            indices.push_back(i);
+        }
     }
-    integral(scharr_x, temp, integral_x_sq, CV_32F, CV_32F);
-    integral(scharr_y, temp, integral_y_sq, CV_32F, CV_32F);
-    integral(scharr_x.mul(scharr_y), integral_xy, temp, CV_32F, CV_32F);
 }
 
 
-// Change coherence orientation edge_nums
+// Row index with BORDER_REFLECT_101 (the border of Scharr), for one step outside.
+static inline int reflect101(int i, int size)
+{
+    if (size == 1)
+    {
+        return 0;
+    }
+    return i < 0 ? -i : (i >= size ? 2 * size - 2 - i : i);
+}
+
+// Change integral_edges integral_x_sq integral_y_sq integral_xy
+// One pass over the rows of resized_barcode, fusing Scharr, the magnitude threshold and the four integral images.
+// The Scharr kernels are separable: gx = [-1 0 1] x [3 10 3]^T and gy = [3 10 3] x [-1 0 1]^T. So each row first
+// gets the vertical [3 10 3] and [-1 0 1] of its three source rows (smooth / diff), and gx, gy come from
+// neighbors in those. Everything is integer up to the squares, so gx, gy and the threshold
+// (magnitude > 64 <=> gx^2 + gy^2 > 64^2) are exact. Gradients under the threshold count as 0.
+// The old sign normalization (gx >= 0) changed neither the squares nor gx * gy, so it is gone.
+// Integral rows are accumulated in double and stored as float, so rounding does not build up down the image.
+// The per pixel loops work on row buffers in L1 and are plain array arithmetic for the compiler to vectorize.
+void Detect::preprocess()
+{
+    static constexpr int THRESHOLD_MAGNITUDE_SQ = 64 * 64;
+    const int cols = width + 1;
+    integral_edges.create(height + 1, cols, CV_32F);
+    integral_x_sq.create(height + 1, cols, CV_32F);
+    integral_y_sq.create(height + 1, cols, CV_32F);
+    integral_xy.create(height + 1, cols, CV_32F);
+    std::fill_n(integral_edges.ptr<float_t>(0), cols, 0.f);
+    std::fill_n(integral_x_sq.ptr<float_t>(0), cols, 0.f);
+    std::fill_n(integral_y_sq.ptr<float_t>(0), cols, 0.f);
+    std::fill_n(integral_xy.ptr<float_t>(0), cols, 0.f);
+
+    // smooth, diff: width + 2 with the reflected columns at both ends. edges, x_sq, y_sq, xy: width
+    gradient_rows.resize(2 * (width + 2) + 4 * width);
+    int *smooth = gradient_rows.data();
+    int *diff = smooth + width + 2;
+    int *edges = diff + width + 2;
+    int *x_sq = edges + width;
+    int *y_sq = x_sq + width;
+    int *xy = y_sq + width;
+    // integral of the previous row, edges / x_sq / y_sq / xy
+    integral_rows.assign(4 * cols, 0.);
+    double *edges_acc = integral_rows.data();
+    double *x_sq_acc = edges_acc + cols;
+    double *y_sq_acc = x_sq_acc + cols;
+    double *xy_acc = y_sq_acc + cols;
+
+    for (int y = 0; y < height; y++)
+    {
+        const auto *up = resized_barcode.ptr<uint8_t>(reflect101(y - 1, height));
+        const auto *row = resized_barcode.ptr<uint8_t>(y);
+        const auto *down = resized_barcode.ptr<uint8_t>(reflect101(y + 1, height));
+        for (int x = 0; x < width; x++)
+        {
+            smooth[x + 1] = 3 * up[x] + 10 * row[x] + 3 * down[x];
+            diff[x + 1] = down[x] - up[x];
+        }
+        smooth[0] = smooth[reflect101(-1, width) + 1];
+        diff[0] = diff[reflect101(-1, width) + 1];
+        smooth[width + 1] = smooth[reflect101(width, width) + 1];
+        diff[width + 1] = diff[reflect101(width, width) + 1];
+
+        for (int x = 0; x < width; x++)
+        {
+            const int gx = smooth[x + 2] - smooth[x];
+            const int gy = 3 * diff[x] + 10 * diff[x + 1] + 3 * diff[x + 2];
+            const int edge = gx * gx + gy * gy > THRESHOLD_MAGNITUDE_SQ ? 1 : 0;
+            edges[x] = edge;
+            x_sq[x] = edge * gx * gx;
+            y_sq[x] = edge * gy * gy;
+            xy[x] = edge * gx * gy;
+        }
+
+        auto *edges_out = integral_edges.ptr<float_t>(y + 1);
+        auto *x_sq_out = integral_x_sq.ptr<float_t>(y + 1);
+        auto *y_sq_out = integral_y_sq.ptr<float_t>(y + 1);
+        auto *xy_out = integral_xy.ptr<float_t>(y + 1);
+        edges_out[0] = x_sq_out[0] = y_sq_out[0] = xy_out[0] = 0.f;
+        double edges_run = 0, x_sq_run = 0, y_sq_run = 0, xy_run = 0;
+        for (int x = 0; x < width; x++)
+        {
+            edges_run += edges[x];
+            x_sq_run += x_sq[x];
+            y_sq_run += y_sq[x];
+            xy_run += xy[x];
+            edges_out[x + 1] = static_cast<float>(edges_acc[x + 1] += edges_run);
+            x_sq_out[x + 1] = static_cast<float>(x_sq_acc[x + 1] += x_sq_run);
+            y_sq_out[x + 1] = static_cast<float>(y_sq_acc[x + 1] += y_sq_run);
+            xy_out[x + 1] = static_cast<float>(xy_acc[x + 1] += xy_run);
+        }
+    }
+}
+
+
+// Change scale.coherence scale.sin2 scale.cos2 scale.edge_nums
 // depend on width height integral_edges integral_x_sq integral_y_sq integral_xy
-void Detect::calCoherence(int window_size)
+// One sweep per block row: the sums of the block columns between the top and bottom rows of the integral images
+// are taken once at every block boundary, and a block is the difference of two neighbors.
+// The coherence threshold is compared squared. The orientation is atan2(x_sq - y_sq, 2 * xy) / 2, so sin and cos of
+// twice of it are (x_sq - y_sq) / r and 2 * xy / r: one sqrt for a coherent block, no atan2 / sin / cos.
+void Detect::calCoherence(Scale &scale) const
 {
     static constexpr float THRESHOLD_COHERENCE = 0.9f;
-    int right_col, left_col, top_row, bottom_row;
-    float xy, x_sq, y_sq, d, rect_area;
+    static constexpr float THRESHOLD_COHERENCE_SQ = THRESHOLD_COHERENCE * THRESHOLD_COHERENCE;
+    const int window_size = scale.window_size;
     const float THRESHOLD_AREA = float(window_size * window_size) * 0.42f;
-    Size new_size(width / window_size, height / window_size);
-    coherence = Mat(new_size, CV_8U), orientation = Mat(new_size, CV_32F), edge_nums = Mat(new_size, CV_32F);
+    // the grid covers whole blocks only, the remainder at the right and bottom is ignored
+    const Size new_size(width / window_size, height / window_size);
+    scale.coherence.create(new_size, CV_8U);
+    scale.sin2.create(new_size, CV_32F);
+    scale.cos2.create(new_size, CV_32F);
+    scale.edge_nums.create(new_size, CV_32F);
+
+    const int boundaries = new_size.width + 1;
+    scale.column_sums.resize(4 * boundaries);
+    float *edges_sum = scale.column_sums.data();
+    float *x_sq_sum = edges_sum + boundaries;
+    float *y_sq_sum = x_sq_sum + boundaries;
+    float *xy_sum = y_sq_sum + boundaries;
 
-    float top_left, top_right, bottom_left, bottom_right;
-    int integral_cols = width + 1;
-    const auto *edges_ptr = integral_edges.ptr<float_t>(), *x_sq_ptr = integral_x_sq.ptr<float_t>(), *y_sq_ptr = integral_y_sq.ptr<float_t>(), *xy_ptr = integral_xy.ptr<float_t>();
     for (int y = 0; y < new_size.height; y++)
     {
-        auto *coherence_row = coherence.ptr<uint8_t>(y);
-        auto *orientation_row = orientation.ptr<float_t>(y);
-        auto *edge_nums_row = edge_nums.ptr<float_t>(y);
-        if (y * window_size >= height)
+        const int top_row = y * window_size;
+        const int bottom_row = top_row + window_size;
+        const auto *edges_top = integral_edges.ptr<float_t>(top_row), *edges_bottom = integral_edges.ptr<float_t>(bottom_row);
+        const auto *x_sq_top = integral_x_sq.ptr<float_t>(top_row), *x_sq_bottom = integral_x_sq.ptr<float_t>(bottom_row);
+        const auto *y_sq_top = integral_y_sq.ptr<float_t>(top_row), *y_sq_bottom = integral_y_sq.ptr<float_t>(bottom_row);
+        const auto *xy_top = integral_xy.ptr<float_t>(top_row), *xy_bottom = integral_xy.ptr<float_t>(bottom_row);
+        for (int k = 0, col = 0; k < boundaries; k++, col += window_size)
         {
-            continue;
+            edges_sum[k] = edges_bottom[col] - edges_top[col];
+            x_sq_sum[k] = x_sq_bottom[col] - x_sq_top[col];
+            y_sq_sum[k] = y_sq_bottom[col] - y_sq_top[col];
+            xy_sum[k] = xy_bottom[col] - xy_top[col];
         }
-        top_row = y * window_size;
-        bottom_row = min(height, (y + 1) * window_size);
 
+        auto *coherence_row = scale.coherence.ptr<uint8_t>(y);
+        auto *sin2_row = scale.sin2.ptr<float_t>(y);
+        auto *cos2_row = scale.cos2.ptr<float_t>(y);
+        auto *edge_nums_row = scale.edge_nums.ptr<float_t>(y);
         for (int pos = 0; pos < new_size.width; pos++)
         {
-
-            // then calculate the column locations of the rectangle and set them to -1
-            // if they are outside the matrix bounds
-            if (pos * window_size >= width)
-            {
-                continue;
-            }
-            left_col = pos * window_size;
-            right_col = min(width, (pos + 1) * window_size);
-
             //we had an integral image to count non-zero elements
-            CALCULATE_SUM(edges_ptr, rect_area)
-            if (rect_area < THRESHOLD_AREA)
+            const float rect_area = edges_sum[pos + 1] - edges_sum[pos];
+            const float x_sq = x_sq_sum[pos + 1] - x_sq_sum[pos];
+            const float y_sq = y_sq_sum[pos + 1] - y_sq_sum[pos];
+            const float xy = xy_sum[pos + 1] - xy_sum[pos];
+            const float diff = x_sq - y_sq;
+            const float sum = x_sq + y_sq;
+            // smooth region, or d = sqrt(diff^2 + 4xy^2) / sum not above the threshold
+            if (rect_area < THRESHOLD_AREA || diff * diff + 4 * xy * xy <= THRESHOLD_COHERENCE_SQ * sum * sum)
             {
-                // smooth region
                 coherence_row[pos] = 0;
                 continue;
             }
+            const float r = sqrt(diff * diff + 4 * xy * xy);
+            coherence_row[pos] = 255;
+            sin2_row[pos] = diff / r;
+            cos2_row[pos] = 2 * xy / r;
+            edge_nums_row[pos] = rect_area;
+        }
+    }
+}
+
+// Root of a block in the union-find forest, halving the path on the way.
+static inline int findRoot(int *labels, int i)
+{
+    while (labels[i] != i)
+    {
+        labels[i] = labels[labels[i]];
+        i = labels[i];
+    }
+    return i;
+}
+
+// The root is always the first block of the region in raster order, so regions come out in the same order
+// as a scan for seeds.
+static inline void unite(int *labels, int a, int b)
+{
+    a = findRoot(labels, a);
+    b = findRoot(labels, b);
+    if (a < b)
+    {
+        labels[b] = a;
+    }
+    else if (b < a)
+    {
+        labels[a] = b;
+    }
+}
 
-            CALCULATE_SUM(x_sq_ptr, x_sq)
-            CALCULATE_SUM(y_sq_ptr, y_sq)
-            CALCULATE_SUM(xy_ptr, xy)
+static constexpr float THRESHOLD_RADIAN = PI / 30;
 
-            // get the values of the rectangle corners from the integral image - 0 if outside bounds
-            d = sqrt((x_sq - y_sq) * (x_sq - y_sq) + 4 * xy * xy) / (x_sq + y_sq);
-            if (d > THRESHOLD_COHERENCE)
+// will change scale.bbox scale.scores
+// will change scale.labels scale.regions
+// depend on scale.coherence scale.sin2 scale.cos2 scale.edge_nums
+// Connected regions of coherent blocks whose orientations differ by less than THRESHOLD_RADIAN (modulo PI),
+// by two pass union-find labelling. Linear in the blocks, no allocation per region.
+void Detect::regionGrowing(Scale &scale)
+{
+    // |a - b| < THRESHOLD_RADIAN or > PI - THRESHOLD_RADIAN  <=>  cos(2a - 2b) > cos(2 * THRESHOLD_RADIAN)
+    static const float THRESHOLD_COS = cos(2 * THRESHOLD_RADIAN);
+    const int rows = scale.coherence.rows;
+    const int cols = scale.coherence.cols;
+    scale.labels.resize(static_cast<size_t>(rows) * cols);
+    scale.regions.resize(static_cast<size_t>(rows) * cols);
+    int *labels = scale.labels.data();
+    Region *regions = scale.regions.data();
+
+    // first pass: link each coherent block to the compatible blocks already visited (W, NW, N, NE)
+    for (int y = 0; y < rows; y++)
+    {
+        const auto *coherence_row = scale.coherence.ptr<uint8_t>(y);
+        const auto *sin2_row = scale.sin2.ptr<float_t>(y);
+        const auto *cos2_row = scale.cos2.ptr<float_t>(y);
+        const auto *coherence_up = y > 0 ? scale.coherence.ptr<uint8_t>(y - 1) : nullptr;
+        const auto *sin2_up = y > 0 ? scale.sin2.ptr<float_t>(y - 1) : nullptr;
+        const auto *cos2_up = y > 0 ? scale.cos2.ptr<float_t>(y - 1) : nullptr;
+        for (int x = 0; x < cols; x++)
+        {
+            const int i = y * cols + x;
+            labels[i] = i;
+            if (coherence_row[x] == 0)
             {
-                coherence_row[pos] = 255;
-                orientation_row[pos] = atan2(x_sq - y_sq, 2 * xy) / 2.0f;
-                edge_nums_row[pos] = rect_area;
+                continue;
             }
-            else
+            const float s = sin2_row[x];
+            const float c = cos2_row[x];
+            if (x > 0 && coherence_row[x - 1] != 0 && s * sin2_row[x - 1] + c * cos2_row[x - 1] > THRESHOLD_COS)
             {
-                coherence_row[pos] = 0;
+                unite(labels, i, i - 1);
+            }
+            if (coherence_up == nullptr)
+            {
+                continue;
+            }
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                const int nx = x + dx;
+                if (nx < 0 || nx >= cols || coherence_up[nx] == 0)
+                {
+                    continue;
+                }
+                if (s * sin2_up[nx] + c * cos2_up[nx] > THRESHOLD_COS)
+                {
+                    unite(labels, i, i - cols + dx);
+                }
             }
-
         }
+    }
 
+    // second pass: sums per region, kept at the root
+    for (int y = 0; y < rows; y++)
+    {
+        const auto *coherence_row = scale.coherence.ptr<uint8_t>(y);
+        for (int x = 0; x < cols; x++)
+        {
+            const int i = y * cols + x;
+            if (coherence_row[x] != 0 && labels[i] == i)
+            {
+                regions[i] = Region{0, 0.f, 0.f, 0.f, 0., 0., 0., 0., 0.};
+            }
+        }
     }
+    for (int y = 0; y < rows; y++)
+    {
+        const auto *coherence_row = scale.coherence.ptr<uint8_t>(y);
+        const auto *sin2_row = scale.sin2.ptr<float_t>(y);
+        const auto *cos2_row = scale.cos2.ptr<float_t>(y);
+        const auto *edge_nums_row = scale.edge_nums.ptr<float_t>(y);
+        for (int x = 0; x < cols; x++)
+        {
+            if (coherence_row[x] == 0)
+            {
+                continue;
+            }
+            Region &region = regions[findRoot(labels, y * cols + x)];
+            region.counter += 1;
+            region.sin_sum += sin2_row[x];
+            region.cos_sum += cos2_row[x];
+            region.edge_num += edge_nums_row[x];
+            region.x_sum += x;
+            region.y_sum += y;
+            region.xx_sum += double(x) * x;
+            region.yy_sum += double(y) * y;
+            region.xy_sum += double(x) * y;
+        }
+    }
+    regionBoxes(scale);
 }
 
-// will change localization_bbox bbox_scores
-// will change coherence,
-// depend on coherence orientation edge_nums
-void Detect::regionGrowing(int window_size)
+// will change scale.bbox scale.scores
+// will change scale.labels scale.regions
+// depend on scale.coherence scale.sin2 scale.cos2 scale.edge_nums
+// The stack based flood fill regionGrowing replaced, kept as the reference for compareRegionGrowing. Grows in eight
+// directions over the orientation angles with the angle difference test, as before. The regions go to the same
+// sums and regionBoxes (the boxes used to come from minAreaRect of the blocks), so both give the same boxes.
+void Detect::regionGrowingFloodFill(Scale &scale)
 {
-    static constexpr float LOCAL_THRESHOLD_COHERENCE = 0.95f, THRESHOLD_RADIAN =
-            PI / 30, LOCAL_RATIO = 0.5f, EXPANSION_FACTOR = 1.2f;
-    static constexpr uint THRESHOLD_BLOCK_NUM = 35;
-    Point pt_to_grow, pt;                       //point to grow
-
-    float src_value;
-    float cur_value;
-    float edge_num;
-    float rect_orientation;
-    float sin_sum, cos_sum;
-    uint counter;
     //grow direction
     static constexpr int DIR[8][2] = {{-1, -1},
                                       {0,  -1},
@@ -260,104 +485,149 @@ void Detect::regionGrowing(int window_size)
                                       {0,  1},
                                       {-1, 1},
                                       {-1, 0}};
-    vector<Point2f> growingPoints, growingImgPoints;
-    for (int y = 0; y < coherence.rows; y++)
+    const int rows = scale.coherence.rows;
+    const int cols = scale.coherence.cols;
+    Mat orientation(rows, cols, CV_32F);
+    for (int y = 0; y < rows; y++)
     {
-        auto *coherence_row = coherence.ptr<uint8_t>(y);
-
-        for (int x = 0; x < coherence.cols; x++)
+        const auto *coherence_row = scale.coherence.ptr<uint8_t>(y);
+        const auto *sin2_row = scale.sin2.ptr<float_t>(y);
+        const auto *cos2_row = scale.cos2.ptr<float_t>(y);
+        auto *orientation_row = orientation.ptr<float_t>(y);
+        for (int x = 0; x < cols; x++)
         {
-            if (coherence_row[x] == 0)
+            if (coherence_row[x] != 0)
+            {
+                orientation_row[x] = atan2(sin2_row[x], cos2_row[x]) / 2.0f;
+            }
+        }
+    }
+    // -1: coherent block not reached yet (the flag was coherence = 0, but coherence is kept here)
+    scale.labels.assign(static_cast<size_t>(rows) * cols, -1);
+    scale.regions.resize(static_cast<size_t>(rows) * cols);
+    int *labels = scale.labels.data();
+    vector<Point> growingPoints;
+    for (int y = 0; y < rows; y++)
+    {
+        const auto *coherence_row = scale.coherence.ptr<uint8_t>(y);
+        for (int x = 0; x < cols; x++)
+        {
+            const int seed = y * cols + x;
+            if (coherence_row[x] == 0 || labels[seed] >= 0)
             {
                 continue;
             }
-            // flag
-            coherence_row[x] = 0;
+            labels[seed] = seed;
+            Region &region = scale.regions[seed];
+            region = Region{0, 0.f, 0.f, 0.f, 0., 0., 0., 0., 0.};
             growingPoints.clear();
-            growingImgPoints.clear();
-
-            pt = Point(x, y);
-            cur_value = orientation.at<float_t>(pt);
-            sin_sum = sin(2 * cur_value);
-            cos_sum = cos(2 * cur_value);
-            counter = 1;
-            edge_num = edge_nums.at<float_t>(pt);
-            growingPoints.push_back(pt);
-            growingImgPoints.push_back(Point(pt));
+            growingPoints.emplace_back(x, y);
             while (!growingPoints.empty())
             {
-                pt = growingPoints.back();
+                const Point pt = growingPoints.back();
                 growingPoints.pop_back();
-                src_value = orientation.at<float_t>(pt);
+                const float src_value = orientation.at<float_t>(pt);
+                region.counter += 1;
+                region.sin_sum += sin(2 * src_value);
+                region.cos_sum += cos(2 * src_value);
+                region.edge_num += scale.edge_nums.at<float_t>(pt);
+                region.x_sum += pt.x;
+                region.y_sum += pt.y;
+                region.xx_sum += double(pt.x) * pt.x;
+                region.yy_sum += double(pt.y) * pt.y;
+                region.xy_sum += double(pt.x) * pt.y;
 
                 //growing in eight directions
                 for (auto i : DIR)
                 {
-                    pt_to_grow = Point(pt.x + i[0], pt.y + i[1]);
-
+                    const Point pt_to_grow(pt.x + i[0], pt.y + i[1]);
                     //check if out of boundary
-                    if (!isValidCoord(pt_to_grow, coherence.size()))
+                    if (pt_to_grow.x < 0 || pt_to_grow.y < 0 || pt_to_grow.x >= cols || pt_to_grow.y >= rows)
                     {
                         continue;
                     }
-
-                    if (coherence.at<uint8_t>(pt_to_grow) == 0)
+                    const int k = pt_to_grow.y * cols + pt_to_grow.x;
+                    if (scale.coherence.data[k] == 0 || labels[k] >= 0)
                     {
                         continue;
                     }
-                    cur_value = orientation.at<float_t>(pt_to_grow);
+                    const float cur_value = orientation.at<float_t>(pt_to_grow);
                     if (abs(cur_value - src_value) < THRESHOLD_RADIAN ||
                         abs(cur_value - src_value) > PI - THRESHOLD_RADIAN)
                     {
-                        coherence.at<uint8_t>(pt_to_grow) = 0;
-                        sin_sum += sin(2 * cur_value);
-                        cos_sum += cos(2 * cur_value);
-                        counter += 1;
-                        edge_num += edge_nums.at<float_t>(pt_to_grow);
+                        labels[k] = seed;
                         growingPoints.push_back(pt_to_grow);                 //push next point to grow back to stack
-                        growingImgPoints.push_back(pt_to_grow);
                     }
                 }
             }
-            //minimum block num
-            if (counter < THRESHOLD_BLOCK_NUM)
-            {
-                continue;
-            }
-            float local_coherence = (sin_sum * sin_sum + cos_sum * cos_sum) / static_cast<float>(counter * counter);
-            // minimum local gradient orientation_arg coherence_arg
-            if (local_coherence < LOCAL_THRESHOLD_COHERENCE)
-            {
-                continue;
-            }
-            RotatedRect minRect = minAreaRect(growingImgPoints);
-            if (edge_num < minRect.size.area() * float(window_size * window_size) * LOCAL_RATIO ||
-                static_cast<float>(counter) < minRect.size.area() * LOCAL_RATIO)
-            {
-                continue;
-            }
-            const float local_orientation = atan2(cos_sum, sin_sum) / 2.0f;
-            // only orientation_arg is approximately equal to the rectangle orientation_arg
-            rect_orientation = (minRect.angle) * PI / 180.f;
-            if (minRect.size.width < minRect.size.height)
-            {
-                rect_orientation += (rect_orientation <= 0.f ? HALF_PI : -HALF_PI);
-                std::swap(minRect.size.width, minRect.size.height);
-            }
-            if (abs(local_orientation - rect_orientation) > THRESHOLD_RADIAN &&
-                abs(local_orientation - rect_orientation) < PI - THRESHOLD_RADIAN)
-            {
-                continue;
-            }
-            minRect.angle = local_orientation * 180.f / PI;
-            minRect.size.width *= static_cast<float>(window_size) * EXPANSION_FACTOR;
-            minRect.size.height *= static_cast<float>(window_size);
-            minRect.center.x = (minRect.center.x + 0.5f) * static_cast<float>(window_size);
-            minRect.center.y = (minRect.center.y + 0.5f) * static_cast<float>(window_size);
-            localization_bbox.push_back(minRect);
-            bbox_scores.push_back(edge_num);
+        }
+    }
+    regionBoxes(scale);
+}
 
+// will change scale.bbox scale.scores
+// depend on scale.labels scale.regions scale.coherence
+// One rotated rect per region that passes the filters, in the raster order of the first block of the region.
+void Detect::regionBoxes(Scale &scale)
+{
+    static constexpr float LOCAL_THRESHOLD_COHERENCE = 0.95f, LOCAL_RATIO = 0.5f, EXPANSION_FACTOR = 1.2f;
+    static constexpr int THRESHOLD_BLOCK_NUM = 35;
+    const int window_size = scale.window_size;
+    const int *labels = scale.labels.data();
+    const Region *regions = scale.regions.data();
+    for (int i = 0; i < scale.coherence.rows * scale.coherence.cols; i++)
+    {
+        if (labels[i] != i || scale.coherence.data[i] == 0)
+        {
+            continue;
+        }
+        const Region &region = regions[i];
+        //minimum block num
+        if (region.counter < THRESHOLD_BLOCK_NUM)
+        {
+            continue;
+        }
+        const auto counter = static_cast<float>(region.counter);
+        const float local_coherence = (region.sin_sum * region.sin_sum + region.cos_sum * region.cos_sum) / (counter * counter);
+        // minimum local gradient orientation_arg coherence_arg
+        if (local_coherence < LOCAL_THRESHOLD_COHERENCE)
+        {
+            continue;
         }
+
+        // rect from the second moments of the block positions. The extent of n blocks in a line is n - 1
+        // (from center to center, same as minAreaRect of the block positions), variance (n^2 - 1) / 12.
+        const double mean_x = region.x_sum / region.counter;
+        const double mean_y = region.y_sum / region.counter;
+        const double mu20 = region.xx_sum / region.counter - mean_x * mean_x;
+        const double mu02 = region.yy_sum / region.counter - mean_y * mean_y;
+        const double mu11 = region.xy_sum / region.counter - mean_x * mean_y;
+        const double half_trace = (mu20 + mu02) / 2;
+        const double root = std::sqrt((mu20 - mu02) * (mu20 - mu02) / 4 + mu11 * mu11);
+        const auto major = static_cast<float>(std::sqrt(std::max(0.0, 12 * (half_trace + root) + 1)) - 1);
+        const auto minor = static_cast<float>(std::sqrt(std::max(0.0, 12 * (half_trace - root) + 1)) - 1);
+        // direction of the major axis, in (-PI/2, PI/2]
+        const auto rect_orientation = static_cast<float>(std::atan2(2 * mu11, mu20 - mu02) / 2);
+        const float area = major * minor;
+        if (region.edge_num < area * float(window_size * window_size) * LOCAL_RATIO || counter < area * LOCAL_RATIO)
+        {
+            continue;
+        }
+        const float local_orientation = atan2(region.cos_sum, region.sin_sum) / 2.0f;
+        // only orientation_arg is approximately equal to the rectangle orientation_arg
+        if (abs(local_orientation - rect_orientation) > THRESHOLD_RADIAN &&
+            abs(local_orientation - rect_orientation) < PI - THRESHOLD_RADIAN)
+        {
+            continue;
+        }
+        RotatedRect minRect;
+        minRect.angle = local_orientation * 180.f / PI;
+        minRect.size.width = major * static_cast<float>(window_size) * EXPANSION_FACTOR;
+        minRect.size.height = minor * static_cast<float>(window_size);
+        minRect.center.x = (static_cast<float>(mean_x) + 0.5f) * static_cast<float>(window_size);
+        minRect.center.y = (static_cast<float>(mean_y) + 0.5f) * static_cast<float>(window_size);
+        scale.bbox.push_back(minRect);
+        scale.scores.push_back(region.edge_num);
     }
 }
 
@@ -373,11 +643,12 @@ inline const std::array<Mat, 4> &getStructuringElement()
     return structuringElement;
 }
 
-// Change mat
-void Detect::barcodeErode()
+// Change scale.coherence
+void Detect::barcodeErode(Scale &scale)
 {
     static const std::array<Mat, 4> &structuringElement = getStructuringElement();
-    Mat m0, m1, m2, m3;
+    Mat &coherence = scale.coherence;
+    Mat &m0 = scale.dilated[0], &m1 = scale.dilated[1], &m2 = scale.dilated[2], &m3 = scale.dilated[3];
     dilate(coherence, m0, structuringElement[0]);
     dilate(coherence, m1, structuringElement[1]);
     dilate(coherence, m2, structuringElement[2]);
@@ -402,5 +673,100 @@ void Detect::barcodeErode()
         }
     }
 }
+
+// Same boxes from two labellings of one grid. Centers, sizes and scores come from integer sums and must be equal,
+// the angles may differ in the last bits (the orientation sums are added in another order).
+static bool sameBoxes(const vector<RotatedRect> &a, const vector<float> &a_scores, const vector<RotatedRect> &b,
+                      const vector<float> &b_scores)
+{
+    static constexpr float THRESHOLD_DEGREE = 0.01f;
+    if (a.size() != b.size() || a_scores != b_scores)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        const float angle_diff = abs(a[i].angle - b[i].angle);
+        if (a[i].center != b[i].center || a[i].size != b[i].size ||
+            std::min(angle_diff, 180.f - angle_diff) > THRESHOLD_DEGREE)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// will change scale.bbox scale.scores scale.labels scale.regions
+bool Detect::compareScale(Scale &scale, double &union_find_msec, double &flood_fill_msec)
+{
+    scale.bbox.clear();
+    scale.scores.clear();
+    int64 start = getTickCount();
+    regionGrowing(scale);
+    union_find_msec += static_cast<double>(getTickCount() - start) * 1000.0 / getTickFrequency();
+    const vector<RotatedRect> bbox = std::move(scale.bbox);
+    const vector<float> scores = std::move(scale.scores);
+
+    scale.bbox.clear();
+    scale.scores.clear();
+    start = getTickCount();
+    regionGrowingFloodFill(scale);
+    flood_fill_msec += static_cast<double>(getTickCount() - start) * 1000.0 / getTickFrequency();
+    return sameBoxes(bbox, scores, scale.bbox, scale.scores);
+}
+
+bool Detect::compareRegionGrowing(double &union_find_msec, double &flood_fill_msec)
+{
+    bool same = true;
+    for (Scale &scale : scales)
+    {
+        same = compareScale(scale, union_find_msec, flood_fill_msec) && same;
+    }
+    return same;
+}
+
+// Grids of up to 48 x 48 blocks with one barcode like band: blocks along a random direction, with the gradient
+// orientation that makes regionBoxes accept it, plus scattered blocks of random orientation around it. Jitter,
+// width and densities are random, so that regions merge, split and pass or fail the filters.
+int Detect::compareRegionGrowingRandom(int count, uint64 seed)
+{
+    RNG rng(seed);
+    Scale scale;
+    int mismatches = 0;
+    double union_find_msec = 0, flood_fill_msec = 0;
+    for (int n = 0; n < count; n++)
+    {
+        scale.window_size = rng.uniform(4, 17);
+        const Size size(rng.uniform(1, 49), rng.uniform(1, 49));
+        scale.coherence.create(size, CV_8U);
+        scale.sin2.create(size, CV_32F);
+        scale.cos2.create(size, CV_32F);
+        scale.edge_nums.create(size, CV_32F);
+        // band direction, and the block orientation whose local_orientation in regionBoxes is that direction
+        const float direction = rng.uniform(-PI / 2, PI / 2);
+        const float band_orientation = PI / 4 - direction;
+        const float half_width = rng.uniform(1.f, 12.f);
+        const float jitter = rng.uniform(0.f, 0.2f);
+        const float band_density = rng.uniform(0.6f, 1.f);
+        const float noise_density = rng.uniform(0.f, 0.5f);
+        const int area = scale.window_size * scale.window_size;
+        for (int y = 0; y < size.height; y++)
+        {
+            for (int x = 0; x < size.width; x++)
+            {
+                const float distance = abs((static_cast<float>(x) - static_cast<float>(size.width) / 2) * sin(direction) -
+                                           (static_cast<float>(y) - static_cast<float>(size.height) / 2) * cos(direction));
+                const bool band = distance < half_width;
+                const float orientation = band ? band_orientation + rng.uniform(-jitter, jitter) : rng.uniform(-PI / 2, PI / 2);
+                scale.coherence.at<uint8_t>(y, x) = rng.uniform(0.f, 1.f) < (band ? band_density : noise_density) ? 255 : 0;
+                scale.sin2.at<float_t>(y, x) = sin(2 * orientation);
+                scale.cos2.at<float_t>(y, x) = cos(2 * orientation);
+                scale.edge_nums.at<float_t>(y, x) = static_cast<float>(rng.uniform(area / 2, area + 1));
+            }
+        }
+        mismatches += compareScale(scale, union_find_msec, flood_fill_msec) ? 0 : 1;
+    }
+    return mismatches;
+}
 }
 }
\ No newline at end of file
@@ -3,7 +3,6 @@
 
 
 #include <opencv2/core.hpp>
-#include <opencv2/dnn/dnn.hpp>
 
 namespace cv {
 namespace barcode {
@@ -17,6 +16,7 @@ private:
     vector<float> bbox_scores;
     vector<int> bbox_indices;
     vector<vector<Point2f>> transformation_points;
+    vector<float> transformation_scores;
 
 
 public:
@@ -27,8 +27,24 @@ public:
     vector<vector<Point2f>> getTransformationPoints()
     { return transformation_points; }
 
+    // Edge count of each box in transformation points, normalized by the area of the image (0.0 - 1.0)
+    vector<float> getTransformationScores()
+    { return transformation_scores; }
+
     bool computeTransformationPoints();
 
+    // Structure tensor coherence (0.0 - 1.0) of the edge pixels of a gray image, 0 when fewer than min_edge_ratio
+    // of the pixels are edges. The gradient pass of localization only, for checking that a region still looks
+    // like a barcode. Replaces the state of localization.
+    float coherenceScore(const Mat &gray, float min_edge_ratio);
+
+    // Runs regionGrowing and regionGrowingFloodFill (the flood fill it replaced) again on the block grids of the
+    // last localization, true when both give the same boxes and scores. Adds the time of each to the totals (msec).
+    bool compareRegionGrowing(double &union_find_msec, double &flood_fill_msec);
+
+    // The same on count random block grids. Returns the number of grids with different boxes.
+    static int compareRegionGrowingRandom(int count, uint64 seed);
+
 protected:
     enum resize_direction
     {
@@ -36,19 +52,54 @@ protected:
     } purpose = UNCHANGED;
 
 
+    // Sums over the blocks of one connected region: orientation (as sin / cos of twice the angle), edges, and
+    // moments of the block positions for the rotated rect.
+    struct Region
+    {
+        int counter;
+        float sin_sum, cos_sum, edge_num;
+        double x_sum, y_sum, xx_sum, yy_sum, xy_sum;
+    };
+
+    // Block statistics and boxes of one window size. Kept across frames, so the buffers are reallocated only when
+    // the block grid changes, and each scale can be processed on its own thread.
+    // sin2 / cos2: sin and cos of twice the orientation of the coherent blocks.
+    struct Scale
+    {
+        int window_size = 0;
+        Mat coherence, sin2, cos2, edge_nums;
+        Mat dilated[4];
+        vector<float> column_sums;
+        vector<int> labels;
+        vector<Region> regions;
+        vector<RotatedRect> bbox;
+        vector<float> scores;
+    };
+    static constexpr int SCALE_NUM = 4;
+    Scale scales[SCALE_NUM];
+
     double coeff_expansion = 1.0;
     int height, width;
-    Mat resized_barcode, gradient_magnitude, coherence, orientation, edge_nums, integral_x_sq, integral_y_sq, integral_xy, integral_edges;
+    Mat resized_barcode, integral_x_sq, integral_y_sq, integral_xy, integral_edges;
+    vector<int> gradient_rows;
+    vector<double> integral_rows;
 
     void preprocess();
 
-    void calCoherence(int window_size);
+    void calCoherence(Scale &scale) const;
+
+    static void regionGrowing(Scale &scale);
+
+    static void regionGrowingFloodFill(Scale &scale);
+
+    static void regionBoxes(Scale &scale);
 
-    static inline bool isValidCoord(const Point &coord, const Size &limit);
+    static bool compareScale(Scale &scale, double &union_find_msec, double &flood_fill_msec);
 
-    void regionGrowing(int window_size);
+    static void barcodeErode(Scale &scale);
 
-    void barcodeErode();
+    static void suppressOverlaps(const vector<RotatedRect> &boxes, const vector<float> &scores, float score_threshold,
+                                 float iou_threshold, vector<int> &indices);
 
 
 };
@@ -0,0 +1,141 @@
+#include <cstring>
+#include "replay_util.hpp"
+#include "bardetect.hpp"
+
+// Native frame replay for barcode segmentation. Reports the latency of exec per frame.
+//// bazel build -c opt :replay && bazel-bin/replay --model <tflite> --frames <dir> [--size WxH]
+//// --prefilter <0: none, 1: gate, 2: ROI(0)> --detect_size <shorter side for Detect(512)> --mask <frame size mask 0/1(1)>
+//// --track <detection interval, 0: off(0)>
+//// --detect_bench <random block grids, 0: off(0)>: instead of exec, checks the union-find regionGrowing of Detect
+//// against the flood fill it replaced on that many random grids and on the Detect grids of every frame (gray at
+//// --detect_size), and reports the time of both. Fails when any boxes differ. The model is not loaded.
+extern "C"
+{
+    int initModelBuffer(int size);
+    char *getModelBufferMemoryOffset();
+    int loadModel(int bufferSize);
+    int initInputImageBuffer(int width, int height);
+    unsigned char *getInputImageBufferOffset();
+    int exec(int width, int height);
+    int setInputFormat(int format);
+    int setPreFilter(int mode, int size, float minScore);
+    int getCandidateCount();
+    int setMaskOutput(int enable);
+    int getQuadCount();
+    int setTracking(int enable, int interval, float minCoherence);
+    int getTrackingDetectedFrames();
+    int getTrackingTrackedFrames();
+}
+
+static int detectBench(const ReplayOptions &opt, int grids, int detectSize){
+    int mismatches = cv::barcode::Detect::compareRegionGrowingRandom(grids, 0x5eed);
+    printf("[REPLAY] detect_bench: %d of %d random grids differ\n", mismatches, grids);
+
+    std::vector<std::string> frames = listFrames(opt.frameDir);
+    cv::barcode::Detect detector;
+    double unionFindMsec  = 0;
+    double floodFillMsec  = 0;
+    int differentFrames   = 0;
+    int benchedFrames     = 0;
+    for(int r = 0; r < opt.repeat; r++){
+        for(const std::string &path : frames){
+            cv::Mat frame, gray;
+            if(loadFrame(path, opt, 3, frame) == false){
+                continue;
+            }
+            // same as detectLuma of exec
+            const double scale = std::min(1.0, (double)detectSize / std::min(frame.cols, frame.rows));
+            if(scale < 1.0){
+                cv::resize(frame, frame, cv::Size(std::max(1, cvRound(frame.cols * scale)), std::max(1, cvRound(frame.rows * scale))), 0, 0, cv::INTER_AREA);
+            }
+            cv::cvtColor(frame, gray, cv::COLOR_RGB2GRAY);
+            detector.init(gray);
+            detector.localization();
+            if(detector.compareRegionGrowing(unionFindMsec, floodFillMsec) == false){
+                printf("[REPLAY] detect_bench: boxes differ at %s\n", path.c_str());
+                differentFrames++;
+            }
+            benchedFrames++;
+        }
+    }
+    printf("[REPLAY] detect_bench: %d frames, union-find %.3f ms, flood fill %.3f ms (x%.2f), boxes differ in %d frames\n",
+           benchedFrames, unionFindMsec, floodFillMsec, unionFindMsec > 0 ? floodFillMsec / unionFindMsec : 0.0, differentFrames);
+    return mismatches == 0 && differentFrames == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv){
+    ReplayOptions opt;
+    if(parseReplayOptions(argc, argv, opt) == false){
+        return 1;
+    }
+    int prefilter  = intParam(opt, "prefilter", 0);
+    int detectSize = intParam(opt, "detect_size", 512);
+    int mask       = intParam(opt, "mask", 1);
+    int track      = intParam(opt, "track", 0);
+    int detectBenchGrids = intParam(opt, "detect_bench", 0);
+
+    if(detectBenchGrids > 0){
+        return detectBench(opt, detectBenchGrids, detectSize);
+    }
+
+    // (1) Load model
+    std::vector<char> model;
+    if(readFile(opt.model, model) == false){
+        return 1;
+    }
+    initModelBuffer(model.size());
+    memcpy(getModelBufferMemoryOffset(), model.data(), model.size());
+    if(loadModel(model.size()) != 0){
+        return 1;
+    }
+
+    if(setPreFilter(prefilter, detectSize, 0.0f) != 0 || setMaskOutput(mask) != 0){
+        return 1;
+    }
+
+    if(track > 0 && setTracking(1, track, 0.6f) != 0){
+        return 1;
+    }
+
+    int format = replayFormat(opt, FRAME_FORMAT_RGB);
+    if(setInputFormat(format) != 0){
+        return 1;
+    }
+
+    // (2) Replay frames
+    std::vector<std::string> frames = listFrames(opt.frameDir);
+    std::vector<unsigned char> encoded;
+    LatencyRecorder recorder;
+    int candidateFrames = 0;
+    int quadFrames      = 0;
+    int replayedFrames  = 0;
+    for(int r = 0; r < opt.repeat; r++){
+        for(const std::string &path : frames){
+            cv::Mat frame;
+            if(loadFrame(path, opt, 4, frame) == false || encodeFrame(frame, format, encoded) == false){
+                continue;
+            }
+            initInputImageBuffer(frame.cols, frame.rows);
+            memcpy(getInputImageBufferOffset(), encoded.data(), encoded.size());
+            recorder.start();
+            int ret = exec(frame.cols, frame.rows);
+            recorder.stop(path);
+            if(ret != 0){
+                printf("[REPLAY] exec failed (%d) at %s\n", ret, path.c_str());
+                return 1;
+            }
+            candidateFrames += getCandidateCount() > 0 ? 1 : 0;
+            quadFrames      += getQuadCount() > 0 ? 1 : 0;
+            replayedFrames++;
+        }
+    }
+    recorder.summary();
+    printf("[REPLAY] quads in %d of %d frames\n", quadFrames, replayedFrames);
+    if(track > 0){
+        printf("[REPLAY] tracking: %d detected frames, %d tracked frames\n", getTrackingDetectedFrames(), getTrackingTrackedFrames());
+    }
+    if(prefilter > 0){
+        printf("[REPLAY] prefilter: candidates in %d of %d frames\n", candidateFrames, replayedFrames);
+    }
+    return 0;
+}
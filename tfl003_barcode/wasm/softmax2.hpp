@@ -0,0 +1,183 @@
+#ifndef __SOFTMAX2_HPP__
+#define __SOFTMAX2_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Softmax of a 2 class segmentation output, person probability only.
+// softmax(background, person)[person] == sigmoid(person - background), so one exp per pixel is enough.
+// The input is the interleaved CV_32FC2 output tensor ([background, person] x pixelNum), read in a single pass.
+// 4 pixels at a time with wasm SIMD (-msimd128), SSE2 or NEON. Otherwise (and for the tail) scalar.
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define SOFTMAX2_SIMD 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFTMAX2_SIMD 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SOFTMAX2_SIMD 1
+#endif
+
+namespace softmax2
+{
+    // Beyond +-20 the probability is 0 or 1 in float precision anyway. Keeps 2^n in the normal range.
+    const float LOGIT_LIMIT = 20.0f;
+
+    inline float scalar(float background, float person)
+    {
+        float d = std::min(std::max(person - background, -LOGIT_LIMIT), LOGIT_LIMIT);
+        return 1.0f / (1.0f + std::exp(-d));
+    }
+
+#ifdef SOFTMAX2_SIMD
+#if defined(__wasm_simd128__)
+    typedef v128_t vf;
+    inline vf set1(float x) { return wasm_f32x4_splat(x); }
+    inline vf add(vf a, vf b) { return wasm_f32x4_add(a, b); }
+    inline vf sub(vf a, vf b) { return wasm_f32x4_sub(a, b); }
+    inline vf mul(vf a, vf b) { return wasm_f32x4_mul(a, b); }
+    inline vf div(vf a, vf b) { return wasm_f32x4_div(a, b); }
+    inline vf clamp(vf a, float lo, float hi) { return wasm_f32x4_min(wasm_f32x4_max(a, set1(lo)), set1(hi)); }
+    // [b0 p0 b1 p1][b2 p2 b3 p3] -> [b0 b1 b2 b3], [p0 p1 p2 p3]
+    inline void load2(const float *p, vf &background, vf &person)
+    {
+        vf x = wasm_v128_load(p);
+        vf y = wasm_v128_load(p + 4);
+        background = wasm_i32x4_shuffle(x, y, 0, 2, 4, 6);
+        person = wasm_i32x4_shuffle(x, y, 1, 3, 5, 7);
+    }
+    // 2^n from the bits of (n + magic), see exp() below.
+    inline vf pow2FromMagic(vf nPlusMagic, int bias) { return wasm_i32x4_shl(wasm_i32x4_sub(nPlusMagic, wasm_i32x4_splat(bias)), 23); }
+    inline void store(vf v, float *dst) { wasm_v128_store(dst, v); }
+    inline void storeU8(vf v, unsigned char *dst)
+    {
+        v128_t i32 = wasm_i32x4_trunc_sat_f32x4(v);
+        v128_t i16 = wasm_i16x8_narrow_i32x4(i32, i32);
+        v128_t u8 = wasm_u8x16_narrow_i16x8(i16, i16);
+        int packed = wasm_i32x4_extract_lane(u8, 0);
+        memcpy(dst, &packed, 4);
+    }
+#elif defined(__SSE2__)
+    typedef __m128 vf;
+    inline vf set1(float x) { return _mm_set1_ps(x); }
+    inline vf add(vf a, vf b) { return _mm_add_ps(a, b); }
+    inline vf sub(vf a, vf b) { return _mm_sub_ps(a, b); }
+    inline vf mul(vf a, vf b) { return _mm_mul_ps(a, b); }
+    inline vf div(vf a, vf b) { return _mm_div_ps(a, b); }
+    inline vf clamp(vf a, float lo, float hi) { return _mm_min_ps(_mm_max_ps(a, set1(lo)), set1(hi)); }
+    inline void load2(const float *p, vf &background, vf &person)
+    {
+        vf x = _mm_loadu_ps(p);
+        vf y = _mm_loadu_ps(p + 4);
+        background = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+        person = _mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+    inline vf pow2FromMagic(vf nPlusMagic, int bias) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_castps_si128(nPlusMagic), _mm_set1_epi32(bias)), 23)); }
+    inline void store(vf v, float *dst) { _mm_storeu_ps(dst, v); }
+    inline void storeU8(vf v, unsigned char *dst)
+    {
+        __m128i i32 = _mm_cvttps_epi32(v);
+        __m128i i16 = _mm_packs_epi32(i32, i32);
+        __m128i u8 = _mm_packus_epi16(i16, i16);
+        int packed = _mm_cvtsi128_si32(u8);
+        memcpy(dst, &packed, 4);
+    }
+#else // __ARM_NEON
+    typedef float32x4_t vf;
+    inline vf set1(float x) { return vdupq_n_f32(x); }
+    inline vf add(vf a, vf b) { return vaddq_f32(a, b); }
+    inline vf sub(vf a, vf b) { return vsubq_f32(a, b); }
+    inline vf mul(vf a, vf b) { return vmulq_f32(a, b); }
+    inline vf div(vf a, vf b)
+    {
+#if defined(__aarch64__)
+        return vdivq_f32(a, b);
+#else
+        vf r = vrecpeq_f32(b);
+        r = vmulq_f32(r, vrecpsq_f32(b, r));
+        r = vmulq_f32(r, vrecpsq_f32(b, r));
+        return vmulq_f32(a, r);
+#endif
+    }
+    inline vf clamp(vf a, float lo, float hi) { return vminq_f32(vmaxq_f32(a, set1(lo)), set1(hi)); }
+    inline void load2(const float *p, vf &background, vf &person)
+    {
+        float32x4x2_t x = vld2q_f32(p);
+        background = x.val[0];
+        person = x.val[1];
+    }
+    inline vf pow2FromMagic(vf nPlusMagic, int bias) { return vreinterpretq_f32_s32(vshlq_n_s32(vsubq_s32(vreinterpretq_s32_f32(nPlusMagic), vdupq_n_s32(bias)), 23)); }
+    inline void store(vf v, float *dst) { vst1q_f32(dst, v); }
+    inline void storeU8(vf v, unsigned char *dst)
+    {
+        uint16x4_t u16 = vmovn_u32(vcvtq_u32_f32(v));
+        uint8x8_t u8 = vqmovn_u16(vcombine_u16(u16, u16));
+        vst1_lane_u32((uint32_t *)dst, vreinterpret_u32_u8(u8), 0);
+    }
+#endif
+
+    // exp(x) for |x| <= LOGIT_LIMIT.
+    // x * log2(e) = n + f (n: nearest integer, |f| <= 0.5). 2^n is built in the exponent bits, 2^f by a degree 5 polynomial.
+    inline vf exp(vf x)
+    {
+        // adding 1.5 * 2^23 rounds to the nearest integer and leaves it in the low mantissa bits
+        const float MAGIC = 12582912.0f;
+        const int MAGIC_BITS = 0x4B400000;
+        vf t = mul(x, set1(1.44269504f));
+        vf nPlusMagic = add(t, set1(MAGIC));
+        vf f = mul(sub(t, sub(nPlusMagic, set1(MAGIC))), set1(0.693147181f));
+        vf p = add(mul(f, set1(1.0f / 120)), set1(1.0f / 24));
+        p = add(mul(p, f), set1(1.0f / 6));
+        p = add(mul(p, f), set1(0.5f));
+        p = add(mul(p, f), set1(1.0f));
+        p = add(mul(p, f), set1(1.0f));
+        return mul(p, pow2FromMagic(nPlusMagic, MAGIC_BITS - 127));
+    }
+
+    inline vf sigmoid(const float *logits)
+    {
+        vf background, person;
+        load2(logits, background, person);
+        vf d = clamp(sub(person, background), -LOGIT_LIMIT, LOGIT_LIMIT);
+        return div(set1(1.0f), add(set1(1.0f), exp(sub(set1(0.0f), d))));
+    }
+#endif
+}
+
+// Person probability as uint8 (0-255, rounded). Same result as softmax + convertTo(CV_8U, 255).
+inline void softmax2ToU8(const float *logits, unsigned char *dst, int pixelNum)
+{
+    int i = 0;
+#ifdef SOFTMAX2_SIMD
+    for (; i + 4 <= pixelNum; i += 4)
+    {
+        softmax2::vf v = softmax2::sigmoid(logits + i * 2);
+        softmax2::storeU8(softmax2::add(softmax2::mul(v, softmax2::set1(255.0f)), softmax2::set1(0.5f)), dst + i);
+    }
+#endif
+    for (; i < pixelNum; i++)
+    {
+        dst[i] = (unsigned char)(softmax2::scalar(logits[i * 2], logits[i * 2 + 1]) * 255.0f + 0.5f);
+    }
+}
+
+// Person probability as float (0.0-1.0).
+inline void softmax2ToF32(const float *logits, float *dst, int pixelNum)
+{
+    int i = 0;
+#ifdef SOFTMAX2_SIMD
+    for (; i + 4 <= pixelNum; i += 4)
+    {
+        softmax2::store(softmax2::sigmoid(logits + i * 2), dst + i);
+    }
+#endif
+    for (; i < pixelNum; i++)
+    {
+        dst[i] = softmax2::scalar(logits[i * 2], logits[i * 2 + 1]);
+    }
+}
+
+#endif // __SOFTMAX2_HPP__
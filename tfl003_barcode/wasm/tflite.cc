@@ -1,11 +1,16 @@
-#include <SDL/SDL.h>
 #include <cstdio>
-#include <emscripten.h>
+#include "platform.hpp"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/model.h"
 #include "opencv2/opencv.hpp"
 #include <cmath>
-#include <chrono>
+#include <algorithm>
+#include <vector>
+#include "bardetect.hpp"
+#include "buffer_arena.hpp"
+#include "stage_timer.hpp"
+#include "softmax2.hpp"
+#include "frame_format.hpp"
 
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/optional_debug_tools.h"
@@ -19,33 +24,294 @@
 
 
 namespace{
-    const int MAX_WIDTH   = 512;
-    const int MAX_HEIGHT  = 512;
-    char modelBuffer[1024*1024*256]; 
+    ///// Buffers, sized on demand
+    //// model: initModelBuffer(size), frame: initInputImageBuffer(width, height)
+    BufferArena arena;
+    const int SLOT_MODEL                  = 0;
+    const int SLOT_INPUT_IMAGE            = 1;
+    const int SLOT_RESIZED_OUTPUT_IMAGE   = 2;
+    const int SLOT_OUTPUT_IMAGE           = 3;
+
+    char *modelBuffer = nullptr;
     
     ///// Buffer for image processing
-    unsigned char inputImageBuffer[3 * MAX_WIDTH * MAX_HEIGHT]; 
-    unsigned char resizedImageBuffer[3 * MAX_WIDTH * MAX_HEIGHT]; 
+    unsigned char *inputImageBuffer = nullptr;           // frame size
+
+    float *resizedOutputImageBuffer = nullptr;           // frame size, probability of a crop before blending (PREFILTER_ROI)
+    float *outputImageBuffer = nullptr;                  // frame size, barcode probability (setMaskOutput)
+
+    ///// Layout of inputImageBuffer (setInputFormat). FRAME_FORMAT_RGB, FRAME_FORMAT_I420 or FRAME_FORMAT_NV12.
+    //// YUV input is resized plane by plane and converted at the tensor size.
+    int inputFormat = FRAME_FORMAT_RGB;
+
+    ///// Classical localizer (bardetect.cpp) in front of the model (setPreFilter)
+    //// PREFILTER_NONE: the model runs over the whole frame.
+    //// PREFILTER_GATE: the model runs over the whole frame only when Detect finds a candidate.
+    //// PREFILTER_ROI:  the model runs over a crop around each candidate, the rest of the mask is 0.
+    //// With a prefilter, frames without a candidate cost the gradient pass of Detect only (no invoke).
+    const int PREFILTER_NONE = 0;
+    const int PREFILTER_GATE = 1;
+    const int PREFILTER_ROI  = 2;
+    int preFilterMode       = PREFILTER_NONE;
+    int detectSize          = 512;      // shorter side of the luma image Detect runs on
+    float minCandidateScore = 0.0f;     // candidates below are dropped (score: edge pixels / image pixels)
+    const float ROI_MARGIN  = 0.2f;     // crops are the candidate bounding box grown by this ratio on each side
+
+    ///// Candidates of the last exec. [x0, y0, x1, y1, x2, y2, x3, y3, score] in frame coordinates, higher score first.
+    const int MAX_CANDIDATES   = 8;
+    const int CANDIDATE_FIELDS = 9;
+    float candidateBuffer[MAX_CANDIDATES * CANDIDATE_FIELDS];
+    int candidateCount = 0;
+
+    ///// Decision at tensor resolution
+    //// The softmax, the threshold and the contours run on the output tensor grid, and only the quads are scaled to the
+    //// frame. The frame size probability (outputImageBuffer) is an upscale of the tensor grid one, skipped without
+    //// setMaskOutput(1).
+    float quadThreshold = 0.5f;         // barcode probability of the pixels in a quad
+    const int MIN_QUAD_AREA = 16;       // contours smaller than this (tensor pixels) are dropped
+    bool maskOutput = true;
+
+    ///// Quads of the last exec. [x0, y0, x1, y1, x2, y2, x3, y3, score] in frame coordinates, score: mean probability.
+    const int MAX_QUADS   = 16;
+    const int QUAD_FIELDS = 9;
+    float quadBuffer[MAX_QUADS * QUAD_FIELDS];
+    int quadCount = 0;
+
+    cv::Mat tensorProbability;          // CV_32F, output tensor size
+    cv::Mat tensorMask;                 // CV_8U, output tensor size, probability > quadThreshold
+    cv::Mat contourMask;                // CV_8U, output tensor size, one filled contour for its score
+    std::vector<std::vector<cv::Point>> contours;
+
+    // Quads of the mask at tensor resolution, mapped into roi of the frame. Appended to quadBuffer.
+    void extractQuads(const cv::Rect &roi){
+        cv::compare(tensorProbability, quadThreshold, tensorMask, cv::CMP_GT);
+        cv::findContours(tensorMask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+        if(contourMask.size() != tensorMask.size()){
+            contourMask = cv::Mat::zeros(tensorMask.size(), CV_8UC1);
+        }
+        const float scaleX = (float)roi.width / tensorMask.cols;
+        const float scaleY = (float)roi.height / tensorMask.rows;
+        for(size_t i = 0; i < contours.size() && quadCount < MAX_QUADS; i++){
+            if(cv::contourArea(contours[i]) < MIN_QUAD_AREA){
+                continue;
+            }
+            const cv::Rect bound = cv::boundingRect(contours[i]);
+            cv::drawContours(contourMask, contours, (int)i, cv::Scalar(255), cv::FILLED);
+            const double score = cv::mean(tensorProbability(bound), contourMask(bound))[0];
+            contourMask(bound).setTo(0);
+
+            //// pixel centers of the tensor grid -> frame
+            cv::Point2f corners[4];
+            cv::minAreaRect(contours[i]).points(corners);
+            float *q = &quadBuffer[quadCount * QUAD_FIELDS];
+            for(int k = 0; k < 4; k++){
+                q[k * 2 + 0] = roi.x + (corners[k].x + 0.5f) * scaleX;
+                q[k * 2 + 1] = roi.y + (corners[k].y + 0.5f) * scaleY;
+            }
+            q[8] = (float)score;
+            quadCount++;
+        }
+    }
+
+    cv::barcode::Detect detector;
+    cv::Mat detectRGB;
+    cv::Mat detectGray;
+    std::vector<cv::Rect> regions;
+    int execCount       = 0;            // incremented by every exec
+    int detectGrayFrame = -1;           // execCount detectGray was computed for, -1: none
+
+    // Luma of the frame downscaled to detectSize on the shorter side, into detectGray. Computed once per exec.
+    //// YUV input: the Y plane is used as is, no color conversion.
+    void detectLuma(int width, int height){
+        if(detectGrayFrame == execCount){
+            return;
+        }
+        detectGrayFrame = execCount;
+        const double scale = std::min(1.0, (double)detectSize / std::min(width, height));
+        const cv::Size size(std::max(1, cvRound(width * scale)), std::max(1, cvRound(height * scale)));
+        if(isYUVFrameFormat(inputFormat)){
+            cv::Mat luma(height, width, CV_8UC1, inputImageBuffer);
+            if(scale < 1.0){
+                cv::resize(luma, detectGray, size, 0, 0, cv::INTER_AREA);
+            }else{
+                luma.copyTo(detectGray);
+            }
+        }else{
+            cv::Mat rgb(height, width, CV_8UC3, inputImageBuffer);
+            if(scale < 1.0){
+                cv::resize(rgb, detectRGB, size, 0, 0, cv::INTER_AREA);
+                cv::cvtColor(detectRGB, detectGray, cv::COLOR_RGB2GRAY);
+            }else{
+                cv::cvtColor(rgb, detectGray, cv::COLOR_RGB2GRAY);
+            }
+        }
+    }
 
-    // long long resizedOutputImageBuffer[2 * MAX_WIDTH * MAX_HEIGHT];
-    float resizedOutputImageBuffer[2 * MAX_WIDTH * MAX_HEIGHT];
-    // unsigned char outputImageBuffer[1 * MAX_WIDTH * MAX_HEIGHT];
-    float outputImageBuffer[1 * MAX_WIDTH * MAX_HEIGHT];
+    // Detect over detectLuma. Fills candidateBuffer.
+    void findCandidates(int width, int height){
+        detectLuma(width, height);
+
+        candidateCount = 0;
+        detector.init(detectGray);
+        detector.localization();
+        if(detector.computeTransformationPoints() == false){
+            return;
+        }
+        const std::vector<std::vector<cv::Point2f>> points = detector.getTransformationPoints();
+        const std::vector<float> scores = detector.getTransformationScores();
+        const float scaleX = (float)width / detectGray.cols;
+        const float scaleY = (float)height / detectGray.rows;
+        for(size_t i = 0; i < points.size() && candidateCount < MAX_CANDIDATES; i++){
+            if(scores[i] < minCandidateScore){
+                continue;
+            }
+            float *c = &candidateBuffer[candidateCount * CANDIDATE_FIELDS];
+            for(int k = 0; k < 4; k++){
+                c[k * 2 + 0] = points[i][k].x * scaleX;
+                c[k * 2 + 1] = points[i][k].y * scaleY;
+            }
+            c[8] = scores[i];
+            candidateCount++;
+        }
+    }
+
+    // Crop of the frame around a candidate. Even aligned for YUV, so the crop fed to the model and the mask region match.
+    cv::Rect candidateRegion(const float *c, int width, int height){
+        float minX = c[0], maxX = c[0], minY = c[1], maxY = c[1];
+        for(int k = 1; k < 4; k++){
+            minX = std::min(minX, c[k * 2 + 0]);
+            maxX = std::max(maxX, c[k * 2 + 0]);
+            minY = std::min(minY, c[k * 2 + 1]);
+            maxY = std::max(maxY, c[k * 2 + 1]);
+        }
+        const float marginX = (maxX - minX) * ROI_MARGIN;
+        const float marginY = (maxY - minY) * ROI_MARGIN;
+        int x0 = std::max(0, (int)std::floor(minX - marginX));
+        int y0 = std::max(0, (int)std::floor(minY - marginY));
+        int x1 = std::min(width, (int)std::ceil(maxX + marginX));
+        int y1 = std::min(height, (int)std::ceil(maxY + marginY));
+        if(isYUVFrameFormat(inputFormat)){
+            x0 &= ~1;
+            y0 &= ~1;
+            x1 = std::min(width, (x1 + 1) & ~1);
+            y1 = std::min(height, (y1 + 1) & ~1);
+        }
+        return cv::Rect(x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0));
+    }
+
+    ///// Quad tracking across frames (setTracking)
+    //// After a detection, the corners of the quads are followed with pyramidal Lucas-Kanade on the luma at detectSize,
+    //// and the model does not run. A tracked quad is kept while its region still has coherent edges
+    //// (Detect::coherenceScore) and its area does not jump. The model runs again as soon as a quad is lost, and at
+    //// least every trackInterval frames. The frame size mask (setMaskOutput) is updated on detection frames only.
+    bool tracking            = false;
+    int trackInterval        = 15;
+    float trackMinCoherence  = 0.6f;
+    const float TRACK_MIN_EDGE_RATIO = 0.05f;
+    const float TRACK_MAX_AREA_RATIO = 2.0f;    // area change of a quad between two frames, either way
+    const int TRACK_MIN_SIDE = 8;               // luma pixels
+    int trackCount = 0;                 // quads being tracked (in quadBuffer), 0: detect on the next frame
+    int trackAge   = 0;                 // frames since the last detection
+    cv::Size trackFrameSize;
+    cv::Mat trackLuma;                  // detectLuma of the previous frame
+    cv::barcode::Detect trackValidator;
+    std::vector<cv::Point2f> trackPoints;
+    std::vector<cv::Point2f> trackNextPoints;
+    std::vector<unsigned char> trackStatus;
+    std::vector<float> trackError;
+    int trackedFrames  = 0;
+    int detectedFrames = 0;
+
+    // Moves the quads of the previous frame to this one. false (quadBuffer untouched) when the model has to run.
+    bool trackQuads(int width, int height){
+        if(trackCount == 0 || trackAge + 1 >= trackInterval || trackFrameSize != cv::Size(width, height)){
+            return false;
+        }
+        detectLuma(width, height);
+        const float scaleX = (float)detectGray.cols / width;
+        const float scaleY = (float)detectGray.rows / height;
+        trackPoints.clear();
+        for(int i = 0; i < trackCount * 4; i++){
+            const float *q = &quadBuffer[(i / 4) * QUAD_FIELDS + (i % 4) * 2];
+            trackPoints.push_back(cv::Point2f(q[0] * scaleX, q[1] * scaleY));
+        }
+        cv::calcOpticalFlowPyrLK(trackLuma, detectGray, trackPoints, trackNextPoints, trackStatus, trackError, cv::Size(21, 21), 3);
+
+        const cv::Rect lumaRect(0, 0, detectGray.cols, detectGray.rows);
+        for(int i = 0; i < trackCount; i++){
+            const std::vector<cv::Point2f> before(trackPoints.begin() + i * 4, trackPoints.begin() + i * 4 + 4);
+            const std::vector<cv::Point2f> after(trackNextPoints.begin() + i * 4, trackNextPoints.begin() + i * 4 + 4);
+            if(trackStatus[i * 4] == 0 || trackStatus[i * 4 + 1] == 0 || trackStatus[i * 4 + 2] == 0 || trackStatus[i * 4 + 3] == 0){
+                return false;
+            }
+            const double areaBefore = cv::contourArea(before);
+            const double areaAfter  = cv::contourArea(after);
+            if(areaAfter * TRACK_MAX_AREA_RATIO < areaBefore || areaBefore * TRACK_MAX_AREA_RATIO < areaAfter){
+                return false;
+            }
+            const cv::Rect bound = cv::boundingRect(after) & lumaRect;
+            if(bound.width < TRACK_MIN_SIDE || bound.height < TRACK_MIN_SIDE){
+                return false;
+            }
+            if(trackValidator.coherenceScore(detectGray(bound), TRACK_MIN_EDGE_RATIO) < trackMinCoherence){
+                return false;
+            }
+        }
+
+        for(int i = 0; i < trackCount * 4; i++){
+            float *q = &quadBuffer[(i / 4) * QUAD_FIELDS + (i % 4) * 2];
+            q[0] = trackNextPoints[i].x / scaleX;
+            q[1] = trackNextPoints[i].y / scaleY;
+        }
+        quadCount = trackCount;
+        cv::swap(trackLuma, detectGray);
+        detectGrayFrame = -1;
+        trackAge++;
+        trackedFrames++;
+        return true;
+    }
+
+    // The quads of a detection become the tracks.
+    void startTracks(int width, int height){
+        detectedFrames++;
+        trackCount     = quadCount;
+        trackAge       = 0;
+        trackFrameSize = cv::Size(width, height);
+        if(trackCount == 0){
+            return;
+        }
+        //// no-op when trackQuads or findCandidates already computed it for this frame
+        detectLuma(width, height);
+        detectGray.copyTo(trackLuma);
+    }
 }
 
-using std::chrono::high_resolution_clock;
 std::unique_ptr<tflite::Interpreter> interpreter;
 
-auto start_time = high_resolution_clock::now();
-auto count = 0;
-
 extern "C"
 {
+    EMSCRIPTEN_KEEPALIVE
+    int initModelBuffer(int size){
+        modelBuffer = (char*)arena.reserve(SLOT_MODEL, size);
+        return modelBuffer != nullptr ? 0 : 1;
+    }
     EMSCRIPTEN_KEEPALIVE
     char *getModelBufferMemoryOffset(){
         return modelBuffer;
     }
 
+    EMSCRIPTEN_KEEPALIVE
+    int initInputImageBuffer(int width, int height){
+        inputImageBuffer         = arena.reserve(SLOT_INPUT_IMAGE, 4 * width * height);    // room for RGBA written as is from JS
+        resizedOutputImageBuffer = (float*)arena.reserve(SLOT_RESIZED_OUTPUT_IMAGE, sizeof(float) * width * height);
+        outputImageBuffer        = (float*)arena.reserve(SLOT_OUTPUT_IMAGE, sizeof(float) * width * height);
+        return inputImageBuffer != nullptr && resizedOutputImageBuffer != nullptr && outputImageBuffer != nullptr ? 0 : 1;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getReservedBufferSize(){
+        return arena.reserved();
+    }
+
     EMSCRIPTEN_KEEPALIVE
     unsigned char *getInputImageBufferOffset(){
         return inputImageBuffer;
@@ -70,168 +336,215 @@ extern "C"
 
 
 
+    // format: 3 RGB, 1 I420, 2 NV12 (see frame_format.hpp). Width and height must be even for I420 / NV12.
+    EMSCRIPTEN_KEEPALIVE
+    int setInputFormat(int format){
+        if(format != FRAME_FORMAT_RGB && isYUVFrameFormat(format) == false){
+            printf("[WASM] invalid input format %d\n", format);
+            return 1;
+        }
+        inputFormat = format;
+        trackCount  = 0;
+        return 0;
+    }
+
     EMSCRIPTEN_KEEPALIVE
     int exec(int width, int height){
+        STAGE_TIMER(timer);
+        size_t frameSize = frameBufferSize(inputFormat, width, height);
+        if(frameSize == 0 || arena.capacity(SLOT_INPUT_IMAGE) < frameSize){
+            printf("[WASM] frame (%d, %d) exceeds the buffer (or odd size for YUV). call initInputImageBuffer first.\n", width, height);
+            return 1;
+        }
         int tensorWidth  = interpreter->input_tensor(0)->dims->data[2];
         int tensorHeight = interpreter->input_tensor(0)->dims->data[1];
         int outTensorWidth  = interpreter->output_tensor(0)->dims->data[2];
         int outTensorHeight = interpreter->output_tensor(0)->dims->data[1];
-        printf("[WASM] TensorSize IN:(%d, %d) OUT:(%d, %d)\n", tensorWidth, tensorHeight, outTensorWidth, outTensorHeight);
-        // printf("[WASM] SCALE (%f, %f)\n", scaleW, scaleH);
-
-
-        //// Resize
-        cv::Mat inputImage(height, width, CV_8UC3, (unsigned char*)inputImageBuffer);
-        cv::Mat resizedImage(tensorHeight, tensorWidth, CV_8UC3, (unsigned char*)resizedImageBuffer);
-        cv::resize(inputImage, resizedImage, resizedImage.size(), 0, 0, cv::INTER_LINEAR);
-        printf("[WASM] resized\n");
-
-        //// input
-        printf("[WASM] resized1111\n");
-        unsigned char *input = interpreter->typed_input_tensor<unsigned char>(0);
-        printf("[WASM] resized222\n");
-        for(int i = 0; i < tensorHeight * tensorWidth; i++){
-            input[i * 3 + 0] = resizedImageBuffer[i * 3 + 0];
-            input[i * 3 + 1] = resizedImageBuffer[i * 3 + 1];
-            input[i * 3 + 2] = resizedImageBuffer[i * 3 + 2];
-            // if(i%10000 == 0){
-            //     printf("[WASM] resized3 %d\n", resizedImageBuffer[i]);
-            // }
+        execCount++;
+
+        //// Tracked quads, no model (setTracking)
+        if(tracking && trackQuads(width, height)){
+            candidateCount = 0;
+            STAGE_LAP(timer, STAGE_DECODE);
+            return 0;
         }
-        // printf("[WASM] input\n" );
-
-        // infer
-        CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
-        // printf("[WASM] invoke1\n");
-
-        // output
-        // long long *output = interpreter->typed_output_tensor<long long>(0);
-        printf("[WASM] resized222-1\n");
-        float *output = interpreter->typed_output_tensor<float>(0);
-        printf("[WASM] resized222-2\n");
-        // printf("[WASM] invoke2 %c %c %c\n", output[0], output[1] ,output[297*297*3-1]);
-        cv::Mat outputImage64FC2(outTensorHeight, outTensorWidth, CV_32FC2, output);
-        printf("[WASM] resized222-3\n");
-        cv::Mat resizedOutputImage64FC2(height, width, CV_32FC2, resizedOutputImageBuffer);
-        printf("[WASM] resized222-4\n");
-        cv::resize(outputImage64FC2, resizedOutputImage64FC2, resizedOutputImage64FC2.size(), 0, 0, cv::INTER_LINEAR);
-        printf("[WASM] resized222-5\n");
-
-
-
-        // printf("[WASM] invoke3\n");
-        // cv::Mat outputImage8FC1(height, width, CV_8UC1, outputImageBuffer);        
-        // resizedOutputImage64FC3.convertTo(outputImage8FC1, CV_8UC1);
-        // outputImage8FC1 = outputImage8FC1 * 255;
-        float num1 = 0;
-        float num2 = 0;
-        float num3 = 0;
-        float num4 = 0;
-        
-        long long res1 = 0;
-        long long res2 = 0;
-        float shift1 = 0;
-        float shift2 = 0;
-
-        float backgroundExp1 = 0;
-        float backgroundExp2 = 0;
-        float personExp1 = 0;
-        float personExp2 = 0;
-        unsigned char val1 = 0;
-        unsigned char val2 = 0;
-        float background1 = 0;
-        float background2 = 0;
-        float person1 = 0;
-        float person2 = 0;
-
-        int cond1 = 0;
-        int cond2 = 0;
-
-        int show1 = 0;
-        int show2 = 0;
-
-        int count0 = 0;
-        int count1 = 0;
-        // for(int i = 0; i<297*297; i++){
-        for(int i = 0; i<width*height; i++){
-
-            float background = resizedOutputImageBuffer[i*2];
-            float person      = resizedOutputImageBuffer[i*2 + 1];
-            float shift = background > person ? background : person;
-            float backgroundExp = std::exp(background - shift);
-            float personExp = std::exp(person - shift);
-            unsigned char val = (255 * personExp) / (backgroundExp + personExp);
-            float val2 = (personExp) / (backgroundExp + personExp);
-
-
-            outputImageBuffer[i] = val2;
-            // outputImageBuffer[i] = resizedOutputImageBuffer[i*2];
-            // if(resizedOutputImageBuffer[i*2+1] != 0){
-            if(outputImageBuffer[i] != 0){
-                res1 = outputImageBuffer[i];
-                num1 = resizedOutputImageBuffer[i*2];
-                num2 = resizedOutputImageBuffer[i*2+1];
-                shift1 = shift;
-                backgroundExp1 = backgroundExp;
-                personExp1 = personExp;
-                val1 = val;
-                background1 = background;
-                person1 = person;
-                if(background > person){
-                    cond1 = 0;
-                }else{
-                    cond1 = 1;
-                }
 
-                if(show1 < 3 && val2>0.5){
-                    printf("[WASM] 1------------------- %f %f %f %f %hhu,     %f \n", background, person, backgroundExp, personExp, val, val2);
-                    show1+=1;
+        //// Regions the model runs over: the whole frame, or the crops of the candidates (setPreFilter)
+        const cv::Rect frameRect(0, 0, width, height);
+        regions.clear();
+        candidateCount = 0;
+        if(preFilterMode == PREFILTER_NONE){
+            regions.push_back(frameRect);
+        }else{
+            findCandidates(width, height);
+            STAGE_LAP(timer, STAGE_PREPROCESS);
+            if(preFilterMode == PREFILTER_GATE && candidateCount > 0){
+                regions.push_back(frameRect);
+            }
+            for(int i = 0; i < candidateCount && preFilterMode == PREFILTER_ROI; i++){
+                cv::Rect roi = candidateRegion(&candidateBuffer[i * CANDIDATE_FIELDS], width, height);
+                if(roi.empty() == false){
+                    regions.push_back(roi);
                 }
+            }
+        }
+        quadCount = 0;
+        if(maskOutput && (regions.size() != 1 || regions[0] != frameRect)){
+            std::fill(outputImageBuffer, outputImageBuffer + width * height, 0.0f);
+        }
 
-                count1++;
+        for(const cv::Rect &roi : regions){
+            //// Resize (and convert YUV input at the tensor size) straight into the input tensor (uint8 RGB, no normalization)
+            unsigned char *input = interpreter->typed_input_tensor<unsigned char>(0);
+            cv::Mat resizedImage(tensorHeight, tensorWidth, CV_8UC3, input);
+            resizeFrame(inputFormat, inputImageBuffer, width, height, FRAME_FORMAT_RGB, resizedImage, cv::INTER_LINEAR, roi);
+            STAGE_LAP(timer, STAGE_PREPROCESS);
+
+            // infer
+            CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+            STAGE_LAP(timer, STAGE_INVOKE);
+
+            //// softmax of [background, barcode] at tensor resolution, single pass from the interleaved buffer, see softmax2.hpp
+            float *output = interpreter->typed_output_tensor<float>(0);
+            tensorProbability.create(outTensorHeight, outTensorWidth, CV_32FC1);
+            softmax2ToF32(output, (float*)tensorProbability.data, outTensorWidth * outTensorHeight);
+            extractQuads(roi);
+            STAGE_LAP(timer, STAGE_DECODE);
+
+            //// probability upscaled to the region
+            if(maskOutput == false){
+                continue;
+            }
+            if(roi == frameRect){
+                cv::Mat outputImage(height, width, CV_32FC1, outputImageBuffer);
+                cv::resize(tensorProbability, outputImage, outputImage.size(), 0, 0, cv::INTER_LINEAR);
             }else{
-                res2 = outputImageBuffer[i];
-                num3 = resizedOutputImageBuffer[i*2];
-                num4 = resizedOutputImageBuffer[i*2+1];
-                shift2 = shift;
-                backgroundExp2 =backgroundExp;
-                personExp2 = personExp;
-                val2 = val;
-                background2 = background;
-                person2 = person;
-                if(background > person){
-                    cond2 = 0;
-                }else{
-                    cond2 = 1;
+                //// crops may overlap, the higher probability wins
+                cv::Mat regionImage(roi.height, roi.width, CV_32FC1, resizedOutputImageBuffer);
+                cv::resize(tensorProbability, regionImage, regionImage.size(), 0, 0, cv::INTER_LINEAR);
+                for(int y = 0; y < roi.height; y++){
+                    const float *src = resizedOutputImageBuffer + y * roi.width;
+                    float *dst = outputImageBuffer + (roi.y + y) * width + roi.x;
+                    for(int x = 0; x < roi.width; x++){
+                        dst[x] = std::max(dst[x], src[x]);
+                    }
                 }
+            }
+            STAGE_LAP(timer, STAGE_OUTPUT);
+        }
 
-                if(show2 == 0){
-                    printf("[WASM] 2------------------- %f %f %f %f %hhu\n", background, person, backgroundExp, personExp, val);
-                    show2+=1;
-                }
+        if(tracking){
+            startTracks(width, height);
+        }
+        return 0;
+    }
+    
+    // mode: 0 none (model over the whole frame), 1 gate (whole frame only when Detect finds a candidate),
+    // 2 ROI (model over the candidate crops only). size: shorter side of the image Detect runs on (64 - 2048).
+    // minScore: candidates with a lower score (edge pixels / image pixels) are dropped.
+    EMSCRIPTEN_KEEPALIVE
+    int setPreFilter(int mode, int size, float minScore){
+        if(mode < PREFILTER_NONE || mode > PREFILTER_ROI || size < 64 || size > 2048 || minScore < 0.0f){
+            printf("[WASM] invalid prefilter (mode:%d, size:%d, minScore:%f)\n", mode, size, minScore);
+            return 1;
+        }
+        preFilterMode     = mode;
+        detectSize        = size;
+        minCandidateScore = minScore;
+        trackCount        = 0;
+        return 0;
+    }
 
-                count0++;
-            }
+    // Candidates of the last exec, CANDIDATE_FIELDS floats each: rotated box corners (x, y) x 4 in frame coordinates, score.
+    //// Filled only with a prefilter (setPreFilter).
+    EMSCRIPTEN_KEEPALIVE
+    float *getCandidateBufferAddress(){
+        return candidateBuffer;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getCandidateCount(){
+        return candidateCount;
+    }
 
+    // enable 1: outputImageBuffer gets the barcode probability at frame size (default), 0: quads only,
+    // no frame size work.
+    EMSCRIPTEN_KEEPALIVE
+    int setMaskOutput(int enable){
+        maskOutput = enable != 0;
+        return 0;
+    }
+
+    // threshold: barcode probability (0.0 - 1.0) of the pixels in a quad.
+    EMSCRIPTEN_KEEPALIVE
+    int setQuadThreshold(float threshold){
+        if(threshold < 0.0f || threshold >= 1.0f){
+            printf("[WASM] invalid quad threshold %f\n", threshold);
+            return 1;
         }
-        printf("[WASM] count: %d %d     %f %f %f %f [%lld, %lld]\n", count0, count1, num1, num2, num3, num4, res1, res2);
-        printf("[WASM] count: [%f, %f]  [%f, %f] [%f, %f] [%hhu, %hhu]\n", shift1, shift2, backgroundExp1, backgroundExp2, personExp1, personExp2, val1, val2);
-        printf("[WASM] count: [%f, %f]  [%f, %f] [%d, %d]\n", background1, background2, person1, person2, cond1, cond2);
-        // printf("[WASM] invoke4\n");
-        printf("[WASM] resized2\n");
+        quadThreshold = threshold;
+        return 0;
+    }
 
+    // Quads of the last exec, QUAD_FIELDS floats each: rotated box corners (x, y) x 4 in frame coordinates, mean probability.
+    EMSCRIPTEN_KEEPALIVE
+    float *getQuadBufferAddress(){
+        return quadBuffer;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getQuadCount(){
+        return quadCount;
+    }
+
+    // Tracking (the model runs on detection frames, the frames between follow the quads with optical flow)
+    //// interval: the model runs at least every N frames (1 - 120, 1: every frame)
+    //// minCoherence: coherence (0.0 - 1.0) of the gradients in a tracked quad below which the model runs again
+    EMSCRIPTEN_KEEPALIVE
+    int setTracking(int enable, int interval, float minCoherence){
+        if(interval < 1 || interval > 120 || minCoherence < 0.0f || minCoherence > 1.0f){
+            printf("[WASM] invalid tracking (%d, %f)\n", interval, minCoherence);
+            return 1;
+        }
+        tracking          = enable != 0;
+        trackInterval     = interval;
+        trackMinCoherence = minCoherence;
+        trackCount        = 0;
         return 0;
     }
-    
+    EMSCRIPTEN_KEEPALIVE
+    int getTrackingDetectedFrames(){
+        return detectedFrames;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getTrackingTrackedFrames(){
+        return trackedFrames;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int resetTrackingCounters(){
+        detectedFrames = 0;
+        trackedFrames  = 0;
+        return 0;
+    }
+
+    // Per-stage timing of exec. Records of [frame, stage, msec], see stage_timer.hpp.
+    //// nullptr / 0 unless built with --copt=-DENABLE_STAGE_TIMING
+    EMSCRIPTEN_KEEPALIVE
+    float *getTimingBufferAddress(){
+        return stageTimingRecords();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getTimingCount(){
+        return stageTimingCount();
+    }
+
     EMSCRIPTEN_KEEPALIVE
     int loadModel(int bufferSize){
         printf("[WASM] --------------------------------------------------------\n");
-        printf("[WASM] - TFLite Model Loader for meet segmentation            -\n");
+        printf("[WASM] - TFLite Model Loader for barcode segmentation         -\n");
         printf("[WASM] - Bug report:                                          -\n");
         printf("[WASM] -   https://github.com/w-okada/image-analyze-workers   -\n");
         printf("[WASM] --------------------------------------------------------\n");
         printf("[WASM] \n");
-        printf("[WASM] Loading model of sizeaa: %d\n", bufferSize);
+        printf("[WASM] Loading model of size: %d\n", bufferSize);
 
         // Load model
         std::unique_ptr<tflite::FlatBufferModel> model = tflite::FlatBufferModel::BuildFromBuffer(modelBuffer, bufferSize);
@@ -243,6 +556,7 @@ extern "C"
 
         CHECK_TFLITE_ERROR(interpreter != nullptr);
         CHECK_TFLITE_ERROR(interpreter->AllocateTensors() == kTfLiteOk);
+        trackCount = 0;
         // tflite::PrintInterpreterState(interpreter.get());
 
         int input_height  = interpreter->input_tensor(0)->dims->data[1];
@@ -252,11 +566,7 @@ extern "C"
         int output_width  = interpreter->output_tensor(0)->dims->data[2];
         int output_ch     = interpreter->output_tensor(0)->dims->data[3];
         printf("[WASM] input(%d, %d, %d), output(%d, %d, %d)\n", input_height, input_width, input_ch, output_height, output_width, output_ch);
-        unsigned char *input_ptr = interpreter->typed_input_tensor<unsigned char>(0);
-        long long *output_ptr = interpreter->typed_output_tensor<long long>(0);
-        printf("[WASM] ptr(%p, %p)\n", input_ptr, output_ptr);
-        // CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
-        // printf("[WASM] invoke pre1\n" );
+        printf("[WASM] Reserved buffer size: %zu\n", arena.reserved());
         return 0;
     }
 }
\ No newline at end of file
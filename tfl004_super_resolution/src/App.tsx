@@ -198,6 +198,7 @@ const App = () => {
                     const start = performance.now();                
 
                     const imageData = tmpCtx.getImageData(0, 0, tmp.width, tmp.height)
+                    currentTFLite._initInputImageBuffer(tmp.width, tmp.height, scaleFactor)
                     const inputImageBufferOffset = currentTFLite._getInputImageBufferOffset()
                     currentTFLite.HEAPU8.set(imageData.data, inputImageBufferOffset)
                     currentTFLite._extractY(tmp.width, tmp.height)
@@ -257,6 +258,7 @@ const App = () => {
                 }else{
                     /// Input data
                     const imageData = tmpCtx.getImageData(0, 0, tmp.width, tmp.height)
+                    currentTFLite._initInputImageBuffer(tmp.width, tmp.height, scaleFactor)
                     const inputImageBufferOffset = currentTFLite._getInputImageBufferOffset()
                     currentTFLite.HEAPU8.set(imageData.data, inputImageBufferOffset)
                     // console.log(imageData.data)
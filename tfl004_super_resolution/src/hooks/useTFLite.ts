@@ -5,17 +5,31 @@ declare function createTFLiteModule(): Promise<TFLite>
 declare function createTFLiteSIMDModule(): Promise<TFLite>
 
 export interface TFLite extends EmscriptenModule {
+    _initModelBuffer(size: number): number
     _getModelBufferMemoryOffset(): number
+    _initInputImageBuffer(width: number, height: number, scale: number): number
+    _getReservedBufferSize(): number
     _getInputImageBufferOffset(): number
     _getOutputImageBufferOffset(): number
     _loadModel(bufferSize: number): number
     _exec(widht: number, height: number, interpolationType: number): number
+    _setTileSize(tileSize: number, overlap: number): number
+    _setInterpreterCacheSize(size: number): number
+    _getInterpreterCacheHits(): number
+    _getInterpreterCacheMisses(): number
+    _getTensorType(): number // 1: float32, 3: uint8, 9: int8
+    _getEspcnThroughput(): number // output Mpixel/s
+    _resetEspcnThroughput(): number
+    _setInputFormat(format: number): number // 0: RGBA, 1: I420, 2: NV12
 
     _extractY(width:number, height:number):number
     _mergeY(width:number, height:number, scaled_width:number, scaled_height:number):number
     _getYBufferOffset():number
     _getScaledYBufferOffset():number
-    
+
+    /// Stage timing ([frame, stage, msec] records, build with -DENABLE_STAGE_TIMING)
+    _getTimingBufferAddress(): number
+    _getTimingCount(): number
 }
 
 function useTFLite() {
@@ -27,6 +41,7 @@ function useTFLite() {
         const modelResponse = await fetch(modelPath)
         const model = await modelResponse.arrayBuffer()
         console.log('[useTFLite Hook] [loadMeetModel] Model buffer size:', model.byteLength);
+        t._initModelBuffer(model.byteLength)
         const modelBufferOffset = t._getModelBufferMemoryOffset()
         console.log('[useTFLite] [loadMeetModel] Model buffer memory offset:', modelBufferOffset)
         console.log('[useTFLite] [loadMeetModel] Loading model buffer...')
@@ -0,0 +1,71 @@
+#ifndef __BUFFER_ARENA_HPP__
+#define __BUFFER_ARENA_HPP__
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+// Buffers sized on demand, replacing the fixed size static arrays.
+// Each slot keeps its largest allocation. A slot grows only when a larger size is requested,
+// so a steady stream of same (or smaller) sized frames never reallocates.
+// The content is NOT preserved when a slot grows.
+class BufferArena
+{
+public:
+    static const int MAX_SLOTS = 16;
+
+    ~BufferArena()
+    {
+        for (int i = 0; i < MAX_SLOTS; i++)
+        {
+            free(buffers[i]);
+        }
+    }
+
+    // Returns the buffer of the slot with at least size bytes. nullptr on failure.
+    unsigned char *reserve(int slot, size_t size)
+    {
+        if (slot < 0 || slot >= MAX_SLOTS)
+        {
+            return nullptr;
+        }
+        if (size > capacities[slot])
+        {
+            free(buffers[slot]);
+            buffers[slot] = (unsigned char *)malloc(size);
+            capacities[slot] = buffers[slot] != nullptr ? size : 0;
+            if (buffers[slot] == nullptr)
+            {
+                printf("[WASM] BufferArena: failed to allocate %zu bytes for slot %d\n", size, slot);
+            }
+        }
+        return buffers[slot];
+    }
+
+    unsigned char *get(int slot)
+    {
+        return buffers[slot];
+    }
+
+    size_t capacity(int slot)
+    {
+        return capacities[slot];
+    }
+
+    // Total bytes currently held by all slots.
+    size_t reserved()
+    {
+        size_t total = 0;
+        for (int i = 0; i < MAX_SLOTS; i++)
+        {
+            total += capacities[i];
+        }
+        return total;
+    }
+
+private:
+    unsigned char *buffers[MAX_SLOTS] = {};
+    size_t capacities[MAX_SLOTS] = {};
+};
+
+#endif // __BUFFER_ARENA_HPP__
@@ -0,0 +1,184 @@
+#ifndef __FRAME_FORMAT_HPP__
+#define __FRAME_FORMAT_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include "opencv2/opencv.hpp"
+
+// Layout of the frame written into the input buffer (setInputFormat).
+// Each module has a native layout (RGBA, or RGB for cartoonization / barcode) and also accepts I420 / NV12.
+// I420 / NV12 are what camera and VideoFrame sources produce, BT.601 limited range (same as cv::COLOR_YUV2RGBA_I420).
+// Width and height must be even for I420 / NV12.
+const int FRAME_FORMAT_RGBA = 0; // width x height x 4
+const int FRAME_FORMAT_I420 = 1; // Y (width x height), U (width/2 x height/2), V (width/2 x height/2)
+const int FRAME_FORMAT_NV12 = 2; // Y (width x height), interleaved UV (width/2 x height/2 pairs)
+const int FRAME_FORMAT_RGB  = 3; // width x height x 3
+
+inline bool isValidFrameFormat(int format)
+{
+    return format == FRAME_FORMAT_RGBA || format == FRAME_FORMAT_I420 || format == FRAME_FORMAT_NV12 || format == FRAME_FORMAT_RGB;
+}
+
+inline bool isYUVFrameFormat(int format)
+{
+    return format == FRAME_FORMAT_I420 || format == FRAME_FORMAT_NV12;
+}
+
+// Bytes of one frame. 0 when the size can not be used with the format.
+inline size_t frameBufferSize(int format, int width, int height)
+{
+    if (format == FRAME_FORMAT_RGBA)
+    {
+        return (size_t)width * height * 4;
+    }
+    if (format == FRAME_FORMAT_RGB)
+    {
+        return (size_t)width * height * 3;
+    }
+    if (width % 2 != 0 || height % 2 != 0)
+    {
+        return 0;
+    }
+    return (size_t)width * height * 3 / 2;
+}
+
+// Planes of an I420 / NV12 frame. chromaStep is the distance between two U (or V) samples in a row: 1 for I420, 2 for NV12.
+typedef struct PlanarFrame
+{
+    const unsigned char *y;
+    const unsigned char *u;
+    const unsigned char *v;
+    int chromaWidth;
+    int chromaHeight;
+    int chromaStride;
+    int chromaStep;
+} PlanarFrame;
+
+inline PlanarFrame planarFrame(int format, const unsigned char *buffer, int width, int height)
+{
+    PlanarFrame frame;
+    frame.y = buffer;
+    frame.chromaWidth = width / 2;
+    frame.chromaHeight = height / 2;
+    const unsigned char *chroma = buffer + width * height;
+    if (format == FRAME_FORMAT_NV12)
+    {
+        frame.u = chroma;
+        frame.v = chroma + 1;
+        frame.chromaStride = width;
+        frame.chromaStep = 2;
+    }
+    else
+    {
+        frame.u = chroma;
+        frame.v = chroma + frame.chromaWidth * frame.chromaHeight;
+        frame.chromaStride = frame.chromaWidth;
+        frame.chromaStep = 1;
+    }
+    return frame;
+}
+
+// Whole frame -> RGBA or RGB (dstFormat), for the stages that need full resolution color (crops, composite).
+// Luma only stages should read the Y plane (planarFrame(...).y) instead.
+inline void convertFrame(int format, const unsigned char *src, int width, int height, int dstFormat, unsigned char *dst)
+{
+    const int dstType = dstFormat == FRAME_FORMAT_RGB ? CV_8UC3 : CV_8UC4;
+    cv::Mat out(height, width, dstType, dst);
+    if (format == dstFormat)
+    {
+        cv::Mat(height, width, dstType, (void *)src).copyTo(out);
+        return;
+    }
+    if (format == FRAME_FORMAT_RGBA || format == FRAME_FORMAT_RGB)
+    {
+        cv::Mat in(height, width, format == FRAME_FORMAT_RGB ? CV_8UC3 : CV_8UC4, (void *)src);
+        cv::cvtColor(in, out, format == FRAME_FORMAT_RGB ? cv::COLOR_RGB2RGBA : cv::COLOR_RGBA2RGB);
+        return;
+    }
+    cv::Mat yuv(height * 3 / 2, width, CV_8UC1, (void *)src);
+    int code = 0;
+    if (format == FRAME_FORMAT_NV12)
+    {
+        code = dstFormat == FRAME_FORMAT_RGB ? cv::COLOR_YUV2RGB_NV12 : cv::COLOR_YUV2RGBA_NV12;
+    }
+    else
+    {
+        code = dstFormat == FRAME_FORMAT_RGB ? cv::COLOR_YUV2RGB_I420 : cv::COLOR_YUV2RGBA_I420;
+    }
+    cv::cvtColor(yuv, out, code);
+}
+
+// Frame -> RGB or RGBA (dstFormat) resized to dst.size(). dst must be allocated (CV_8UC3 / CV_8UC4).
+// YUV frames are resized plane by plane and converted at the destination size, so the color conversion costs the
+// destination pixels only (for example a detector input), not the whole frame.
+// roi: region of the frame to resize (a crop), the whole frame when empty. Aligned outwards to even for YUV.
+inline void resizeFrame(int format, const unsigned char *src, int width, int height, int dstFormat, cv::Mat &dst, int interpolation,
+                        cv::Rect roi = cv::Rect())
+{
+    if (roi.empty())
+    {
+        roi = cv::Rect(0, 0, width, height);
+    }
+    if (format == FRAME_FORMAT_RGBA || format == FRAME_FORMAT_RGB)
+    {
+        cv::Mat in = cv::Mat(height, width, format == FRAME_FORMAT_RGB ? CV_8UC3 : CV_8UC4, (void *)src)(roi);
+        if (format == dstFormat)
+        {
+            cv::resize(in, dst, dst.size(), 0, 0, interpolation);
+            return;
+        }
+        cv::Mat resized;
+        cv::resize(in, resized, dst.size(), 0, 0, interpolation);
+        cv::cvtColor(resized, dst, format == FRAME_FORMAT_RGB ? cv::COLOR_RGB2RGBA : cv::COLOR_RGBA2RGB);
+        return;
+    }
+
+    PlanarFrame frame = planarFrame(format, src, width, height);
+    const int x0 = roi.x & ~1;
+    const int y0 = roi.y & ~1;
+    const int x1 = std::min((roi.x + roi.width + 1) & ~1, width);
+    const int y1 = std::min((roi.y + roi.height + 1) & ~1, height);
+    const cv::Rect lumaROI(x0, y0, x1 - x0, y1 - y0);
+    const cv::Rect chromaROI(x0 / 2, y0 / 2, (x1 - x0) / 2, (y1 - y0) / 2);
+    cv::Mat luma, u, v;
+    cv::resize(cv::Mat(height, width, CV_8UC1, (void *)frame.y)(lumaROI), luma, dst.size(), 0, 0, interpolation);
+    if (frame.chromaStep == 2)
+    {
+        cv::Mat uv;
+        cv::resize(cv::Mat(frame.chromaHeight, frame.chromaWidth, CV_8UC2, (void *)frame.u)(chromaROI), uv, dst.size(), 0, 0, interpolation);
+        cv::Mat planes[2];
+        cv::split(uv, planes);
+        u = planes[0];
+        v = planes[1];
+    }
+    else
+    {
+        cv::resize(cv::Mat(frame.chromaHeight, frame.chromaWidth, CV_8UC1, (void *)frame.u)(chromaROI), u, dst.size(), 0, 0, interpolation);
+        cv::resize(cv::Mat(frame.chromaHeight, frame.chromaWidth, CV_8UC1, (void *)frame.v)(chromaROI), v, dst.size(), 0, 0, interpolation);
+    }
+
+    // BT.601 limited range, same as cv::COLOR_YUV2RGB_I420
+    const int channel = dstFormat == FRAME_FORMAT_RGB ? 3 : 4;
+    for (int j = 0; j < dst.rows; j++)
+    {
+        const unsigned char *yRow = luma.ptr<unsigned char>(j);
+        const unsigned char *uRow = u.ptr<unsigned char>(j);
+        const unsigned char *vRow = v.ptr<unsigned char>(j);
+        unsigned char *out = dst.ptr<unsigned char>(j);
+        for (int i = 0; i < dst.cols; i++, out += channel)
+        {
+            float l = 1.164f * (yRow[i] - 16);
+            float du = uRow[i] - 128.0f;
+            float dv = vRow[i] - 128.0f;
+            out[0] = cv::saturate_cast<unsigned char>(l + 1.596f * dv);
+            out[1] = cv::saturate_cast<unsigned char>(l - 0.391f * du - 0.813f * dv);
+            out[2] = cv::saturate_cast<unsigned char>(l + 2.018f * du);
+            if (channel == 4)
+            {
+                out[3] = 255;
+            }
+        }
+    }
+}
+
+#endif // __FRAME_FORMAT_HPP__
@@ -0,0 +1,375 @@
+#ifndef __FUSED_RESIZE_HPP__
+#define __FUSED_RESIZE_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+// Interpolation ids. Values are the same as cv::InterpolationFlags, so cv_interpolation can be passed as is.
+const int RESIZE_NEAREST  = 0;
+const int RESIZE_LINEAR   = 1;
+const int RESIZE_CUBIC    = 2;
+const int RESIZE_AREA     = 3;
+const int RESIZE_LANCZOS4 = 4;
+
+// Source indices and weights of one axis. (taps entries per destination pixel)
+typedef struct AxisTaps
+{
+    int taps;
+    std::vector<int> index;
+    std::vector<float> weight;
+} AxisTaps;
+
+// areaZoom: RESIZE_AREA when either axis of the image is enlarged. As in cv::resize, both axes then use two taps
+// weighted by the fractional coverage of the destination pixel instead of the box filter.
+inline void buildAxisTaps(int src, int dst, int interpolation, bool areaZoom, AxisTaps &out)
+{
+    const float scale = (float)src / dst;
+    if (interpolation == RESIZE_AREA && areaZoom)
+    {
+        out.taps = 2;
+        out.index.assign(dst * out.taps, 0);
+        out.weight.assign(dst * out.taps, 0.0f);
+        const double invScale = (double)dst / src;
+        const double areaScale = 1.0 / invScale;
+        for (int d = 0; d < dst; d++)
+        {
+            int sx = (int)std::floor(d * areaScale);
+            float f = (float)((d + 1) - (sx + 1) * invScale);
+            f = f <= 0 ? 0.0f : f - std::floor(f);
+            if (sx >= src - 1)
+            {
+                sx = src - 1;
+                f = 0;
+            }
+            out.index[d * 2 + 0] = sx;
+            out.index[d * 2 + 1] = std::min(sx + 1, src - 1);
+            out.weight[d * 2 + 0] = 1.0f - f;
+            out.weight[d * 2 + 1] = f;
+        }
+        return;
+    }
+
+    switch (interpolation)
+    {
+    case RESIZE_NEAREST:
+        out.taps = 1;
+        break;
+    case RESIZE_CUBIC:
+        out.taps = 4;
+        break;
+    case RESIZE_LANCZOS4:
+        out.taps = 8;
+        break;
+    case RESIZE_AREA:
+        out.taps = (int)std::ceil(scale) + 1;
+        break;
+    default:
+        interpolation = RESIZE_LINEAR;
+        out.taps = 2;
+    }
+    out.index.assign(dst * out.taps, 0);
+    out.weight.assign(dst * out.taps, 0.0f);
+
+    for (int d = 0; d < dst; d++)
+    {
+        int *index = &out.index[d * out.taps];
+        float *weight = &out.weight[d * out.taps];
+
+        if (interpolation == RESIZE_NEAREST)
+        {
+            index[0] = std::min((int)std::floor(d * scale), src - 1);
+            weight[0] = 1.0f;
+            continue;
+        }
+
+        if (interpolation == RESIZE_AREA)
+        {
+            // box filter: weight is the coverage of each source pixel
+            float begin = d * scale;
+            float end = begin + scale;
+            int s = (int)std::floor(begin);
+            for (int t = 0; t < out.taps; t++, s++)
+            {
+                float overlap = std::min(end, (float)(s + 1)) - std::max(begin, (float)s);
+                index[t] = std::min(s, src - 1);
+                weight[t] = overlap > 0 ? overlap / scale : 0.0f;
+            }
+            continue;
+        }
+
+        float fx = (d + 0.5f) * scale - 0.5f;
+        int sx = (int)std::floor(fx);
+        float f = fx - sx;
+
+        if (interpolation == RESIZE_LINEAR)
+        {
+            if (sx < 0)
+            {
+                sx = 0;
+                f = 0;
+            }
+            if (sx >= src - 1)
+            {
+                sx = src - 1;
+                f = 0;
+            }
+            index[0] = sx;
+            index[1] = std::min(sx + 1, src - 1);
+            weight[0] = 1.0f - f;
+            weight[1] = f;
+        }
+        else if (interpolation == RESIZE_CUBIC)
+        {
+            const float A = -0.75f;
+            weight[0] = ((A * (f + 1) - 5 * A) * (f + 1) + 8 * A) * (f + 1) - 4 * A;
+            weight[1] = ((A + 2) * f - (A + 3)) * f * f + 1;
+            weight[2] = ((A + 2) * (1 - f) - (A + 3)) * (1 - f) * (1 - f) + 1;
+            weight[3] = 1.0f - weight[0] - weight[1] - weight[2];
+            for (int t = 0; t < 4; t++)
+            {
+                index[t] = std::min(std::max(sx - 1 + t, 0), src - 1);
+            }
+        }
+        else // RESIZE_LANCZOS4
+        {
+            float sum = 0;
+            for (int t = 0; t < 8; t++)
+            {
+                float x = (f + 3 - t) * (float)M_PI;
+                weight[t] = std::fabs(x) < 1e-6f ? 1.0f : 4.0f * std::sin(x) * std::sin(x / 4) / (x * x);
+                sum += weight[t];
+                index[t] = std::min(std::max(sx - 3 + t, 0), src - 1);
+            }
+            for (int t = 0; t < 8; t++)
+            {
+                weight[t] /= sum;
+            }
+        }
+    }
+}
+
+// RGBA8 image -> interleaved RGB float (value * scale). Alpha is dropped.
+// Only the destination pixels are visited, so the cost follows the destination (tensor) size.
+inline void resizeRGBA8ToRGB32F(const unsigned char *src, int srcWidth, float *dst, int dstWidth, int dstHeight,
+                                const AxisTaps &xTaps, const AxisTaps &yTaps, float scale)
+{
+    const int xn = xTaps.taps;
+    const int yn = yTaps.taps;
+    for (int dy = 0; dy < dstHeight; dy++)
+    {
+        const int *yIndex = &yTaps.index[dy * yn];
+        const float *yWeight = &yTaps.weight[dy * yn];
+        float *dstRow = dst + dy * dstWidth * 3;
+        for (int dx = 0; dx < dstWidth; dx++)
+        {
+            const int *xIndex = &xTaps.index[dx * xn];
+            const float *xWeight = &xTaps.weight[dx * xn];
+            float r = 0, g = 0, b = 0;
+            for (int j = 0; j < yn; j++)
+            {
+                const unsigned char *srcRow = src + yIndex[j] * srcWidth * 4;
+                float rowR = 0, rowG = 0, rowB = 0;
+                for (int i = 0; i < xn; i++)
+                {
+                    const unsigned char *p = srcRow + xIndex[i] * 4;
+                    rowR += p[0] * xWeight[i];
+                    rowG += p[1] * xWeight[i];
+                    rowB += p[2] * xWeight[i];
+                }
+                r += rowR * yWeight[j];
+                g += rowG * yWeight[j];
+                b += rowB * yWeight[j];
+            }
+            dstRow[dx * 3 + 0] = r * scale;
+            dstRow[dx * 3 + 1] = g * scale;
+            dstRow[dx * 3 + 2] = b * scale;
+        }
+    }
+}
+
+// Planar YUV 4:2:0 image -> interleaved RGB float (value * scale), converting after the interpolation.
+// The conversion is linear, so interpolating Y, U, V and converting once per destination pixel gives the same
+// result as converting the whole frame first, at the cost of the destination size only.
+// BT.601 limited range, same as cv::COLOR_YUV2RGB_I420. chromaStep: 1 (I420) or 2 (NV12, u / v interleaved).
+inline void resizeYUV420ToRGB32F(const unsigned char *y, int yStride, const unsigned char *u, const unsigned char *v,
+                                 int chromaStride, int chromaStep, float *dst, int dstWidth, int dstHeight,
+                                 const AxisTaps &xTaps, const AxisTaps &yTaps, const AxisTaps &xChromaTaps, const AxisTaps &yChromaTaps, float scale)
+{
+    const int xn = xTaps.taps;
+    const int yn = yTaps.taps;
+    const int xcn = xChromaTaps.taps;
+    const int ycn = yChromaTaps.taps;
+    for (int dy = 0; dy < dstHeight; dy++)
+    {
+        const int *yIndex = &yTaps.index[dy * yn];
+        const float *yWeight = &yTaps.weight[dy * yn];
+        const int *ycIndex = &yChromaTaps.index[dy * ycn];
+        const float *ycWeight = &yChromaTaps.weight[dy * ycn];
+        float *dstRow = dst + dy * dstWidth * 3;
+        for (int dx = 0; dx < dstWidth; dx++)
+        {
+            const int *xIndex = &xTaps.index[dx * xn];
+            const float *xWeight = &xTaps.weight[dx * xn];
+            const int *xcIndex = &xChromaTaps.index[dx * xcn];
+            const float *xcWeight = &xChromaTaps.weight[dx * xcn];
+            float luma = 0;
+            for (int j = 0; j < yn; j++)
+            {
+                const unsigned char *srcRow = y + yIndex[j] * yStride;
+                float row = 0;
+                for (int i = 0; i < xn; i++)
+                {
+                    row += srcRow[xIndex[i]] * xWeight[i];
+                }
+                luma += row * yWeight[j];
+            }
+            float du = 0, dv = 0;
+            for (int j = 0; j < ycn; j++)
+            {
+                const unsigned char *rowU = u + ycIndex[j] * chromaStride;
+                const unsigned char *rowV = v + ycIndex[j] * chromaStride;
+                float sumU = 0, sumV = 0;
+                for (int i = 0; i < xcn; i++)
+                {
+                    sumU += rowU[xcIndex[i] * chromaStep] * xcWeight[i];
+                    sumV += rowV[xcIndex[i] * chromaStep] * xcWeight[i];
+                }
+                du += sumU * ycWeight[j];
+                dv += sumV * ycWeight[j];
+            }
+            luma = 1.164f * (luma - 16.0f);
+            du -= 128.0f;
+            dv -= 128.0f;
+            float r = luma + 1.596f * dv;
+            float g = luma - 0.391f * du - 0.813f * dv;
+            float b = luma + 2.018f * du;
+            dstRow[dx * 3 + 0] = std::min(std::max(r, 0.0f), 255.0f) * scale;
+            dstRow[dx * 3 + 1] = std::min(std::max(g, 0.0f), 255.0f) * scale;
+            dstRow[dx * 3 + 2] = std::min(std::max(b, 0.0f), 255.0f) * scale;
+        }
+    }
+}
+
+// Index and weight tables of both axes for one (src size, dst size, interpolation).
+typedef struct ResizePlan
+{
+    int srcWidth;
+    int srcHeight;
+    int dstWidth;
+    int dstHeight;
+    int interpolation;
+    AxisTaps xTaps;
+    AxisTaps yTaps;
+} ResizePlan;
+
+// Plans are built on the first request of a key and reused after that. Frame and tensor sizes rarely change,
+// so a few entries are enough. Least recently used first: a hit moves the plan to the back, and when full the front
+// plan is dropped from the cache. A caller holding a plan keeps it alive, so several plans can be held across get calls.
+class ResizePlanCache
+{
+public:
+    static const int MAX_PLANS = 8;
+
+    std::shared_ptr<const ResizePlan> get(int srcWidth, int srcHeight, int dstWidth, int dstHeight, int interpolation)
+    {
+        for (size_t i = 0; i < plans.size(); i++)
+        {
+            const ResizePlan &p = *plans[i];
+            if (p.srcWidth == srcWidth && p.srcHeight == srcHeight && p.dstWidth == dstWidth && p.dstHeight == dstHeight && p.interpolation == interpolation)
+            {
+                std::shared_ptr<const ResizePlan> hit = plans[i];
+                plans.erase(plans.begin() + i);
+                plans.push_back(hit);
+                return hit;
+            }
+        }
+        if (plans.size() >= MAX_PLANS)
+        {
+            plans.erase(plans.begin());
+        }
+        std::shared_ptr<ResizePlan> plan = std::make_shared<ResizePlan>();
+        plan->srcWidth = srcWidth;
+        plan->srcHeight = srcHeight;
+        plan->dstWidth = dstWidth;
+        plan->dstHeight = dstHeight;
+        plan->interpolation = interpolation;
+        const bool areaZoom = srcWidth < dstWidth || srcHeight < dstHeight;
+        buildAxisTaps(srcWidth, dstWidth, interpolation, areaZoom, plan->xTaps);
+        buildAxisTaps(srcHeight, dstHeight, interpolation, areaZoom, plan->yTaps);
+        plans.push_back(plan);
+        return plan;
+    }
+
+private:
+    std::vector<std::shared_ptr<const ResizePlan>> plans;
+};
+
+// Output format of resizeMask8.
+const int MASK_WRITE_RGBA  = 0; // (255, 255, 255, mask), 4 bytes per pixel
+const int MASK_WRITE_ALPHA = 1; // mask only, 1 byte per pixel
+
+// uint8 mask (plan.srcWidth x plan.srcHeight) -> resized mask, in a single streaming write of the destination.
+// Per destination row the vertical taps are applied once into rowBuffer (src width), then the horizontal taps per pixel.
+inline void resizeMask8(const unsigned char *src, unsigned char *dst, const ResizePlan &plan, int writeMode, std::vector<float> &rowBuffer)
+{
+    const int srcWidth = plan.srcWidth;
+    const int xn = plan.xTaps.taps;
+    const int yn = plan.yTaps.taps;
+    rowBuffer.resize(srcWidth);
+    float *row = rowBuffer.data();
+    for (int dy = 0; dy < plan.dstHeight; dy++)
+    {
+        const int *yIndex = &plan.yTaps.index[dy * yn];
+        const float *yWeight = &plan.yTaps.weight[dy * yn];
+        const unsigned char *srcRow = src + yIndex[0] * srcWidth;
+        for (int sx = 0; sx < srcWidth; sx++)
+        {
+            row[sx] = srcRow[sx] * yWeight[0];
+        }
+        for (int j = 1; j < yn; j++)
+        {
+            srcRow = src + yIndex[j] * srcWidth;
+            const float w = yWeight[j];
+            for (int sx = 0; sx < srcWidth; sx++)
+            {
+                row[sx] += srcRow[sx] * w;
+            }
+        }
+
+        const int *xIndex = plan.xTaps.index.data();
+        const float *xWeight = plan.xTaps.weight.data();
+        if (writeMode == MASK_WRITE_ALPHA)
+        {
+            unsigned char *dstRow = dst + dy * plan.dstWidth;
+            for (int dx = 0; dx < plan.dstWidth; dx++, xIndex += xn, xWeight += xn)
+            {
+                float v = 0.5f;
+                for (int i = 0; i < xn; i++)
+                {
+                    v += row[xIndex[i]] * xWeight[i];
+                }
+                dstRow[dx] = v < 0.0f ? 0 : (v > 255.0f ? 255 : (unsigned char)v);
+            }
+        }
+        else
+        {
+            unsigned char *dstRow = dst + dy * plan.dstWidth * 4;
+            for (int dx = 0; dx < plan.dstWidth; dx++, xIndex += xn, xWeight += xn)
+            {
+                float v = 0.5f;
+                for (int i = 0; i < xn; i++)
+                {
+                    v += row[xIndex[i]] * xWeight[i];
+                }
+                dstRow[dx * 4 + 0] = 255;
+                dstRow[dx * 4 + 1] = 255;
+                dstRow[dx * 4 + 2] = 255;
+                dstRow[dx * 4 + 3] = v < 0.0f ? 0 : (v > 255.0f ? 255 : (unsigned char)v);
+            }
+        }
+    }
+}
+
+#endif // __FUSED_RESIZE_HPP__
@@ -0,0 +1,110 @@
+#ifndef __INTERPRETER_CACHE_HPP__
+#define __INTERPRETER_CACHE_HPP__
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/model.h"
+
+// Interpreters of one model, prepared (ResizeInputTensor + AllocateTensors) per input shape.
+// A request with the shape of a cached entry returns it as is, without re-planning the tensor arena.
+// The last few shapes are kept (most recently used first), so a client switching between resolutions stays warm.
+// Each entry owns its own tensor arena: memory grows with the capacity, keep it small.
+class InterpreterCache
+{
+public:
+    static const int MAX_CAPACITY = 8;
+
+    // New model. Drops all entries and the counters. The model must outlive the cache entries.
+    void reset(const tflite::FlatBufferModel *m)
+    {
+        model = m;
+        entries.clear();
+        hitCount = 0;
+        missCount = 0;
+    }
+
+    int setCapacity(int n)
+    {
+        if (n < 1 || n > MAX_CAPACITY)
+        {
+            return 1;
+        }
+        capacity = n;
+        while ((int)entries.size() > capacity)
+        {
+            entries.pop_back();
+        }
+        return 0;
+    }
+
+    // Interpreter with the first input resized to shape. nullptr on failure.
+    tflite::Interpreter *get(const std::vector<int> &shape)
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].shape == shape)
+            {
+                hitCount++;
+                if (i > 0)
+                {
+                    Entry entry = std::move(entries[i]);
+                    entries.erase(entries.begin() + i);
+                    entries.insert(entries.begin(), std::move(entry));
+                }
+                return entries[0].interpreter.get();
+            }
+        }
+
+        missCount++;
+        if (model == nullptr)
+        {
+            return nullptr;
+        }
+        Entry entry;
+        entry.shape = shape;
+        tflite::ops::builtin::BuiltinOpResolver resolver;
+        tflite::InterpreterBuilder builder(*model, resolver);
+        builder(&entry.interpreter);
+        if (entry.interpreter == nullptr ||
+            entry.interpreter->ResizeInputTensor(entry.interpreter->inputs()[0], shape) != kTfLiteOk ||
+            entry.interpreter->AllocateTensors() != kTfLiteOk)
+        {
+            printf("[WASM] InterpreterCache: failed to prepare the interpreter\n");
+            return nullptr;
+        }
+        if ((int)entries.size() >= capacity)
+        {
+            entries.pop_back();
+        }
+        entries.insert(entries.begin(), std::move(entry));
+        return entries[0].interpreter.get();
+    }
+
+    int hits()
+    {
+        return hitCount;
+    }
+
+    int misses()
+    {
+        return missCount;
+    }
+
+private:
+    typedef struct Entry
+    {
+        std::vector<int> shape;
+        std::unique_ptr<tflite::Interpreter> interpreter;
+    } Entry;
+
+    const tflite::FlatBufferModel *model = nullptr;
+    std::vector<Entry> entries;
+    int capacity = 3;
+    int hitCount = 0;
+    int missCount = 0;
+};
+
+#endif // __INTERPRETER_CACHE_HPP__
@@ -0,0 +1,78 @@
+#include <cstring>
+#include "replay_util.hpp"
+
+// Native frame replay for super resolution. Reports the latency of exec per frame.
+//// bazel build -c opt :replay && bazel-bin/replay --model <tflite> --frames <dir> [--size WxH]
+//// --interpolation <(100: espcn)> --scale <scale factor of the model(2)>
+//// --tile <tile size, 0: whole frame(0)> --overlap <tile overlap(8)>
+extern "C"
+{
+    int initModelBuffer(int size);
+    char *getModelBufferMemoryOffset();
+    int loadModel(int bufferSize);
+    int initInputImageBuffer(int width, int height, int scale);
+    unsigned char *getInputImageBufferOffset();
+    int exec(int width, int height, int interpolationType);
+    int setTileSize(int size, int overlap);
+    int getInterpreterCacheHits();
+    int getInterpreterCacheMisses();
+    int setInputFormat(int format);
+    int getTensorType();
+    float getEspcnThroughput();
+}
+
+int main(int argc, char **argv){
+    ReplayOptions opt;
+    if(parseReplayOptions(argc, argv, opt) == false){
+        return 1;
+    }
+    int interpolation = intParam(opt, "interpolation", 100);
+    int scale         = intParam(opt, "scale", 2);
+    int tile          = intParam(opt, "tile", 0);
+    int overlap       = intParam(opt, "overlap", 8);
+
+    // (1) Load model
+    std::vector<char> model;
+    if(readFile(opt.model, model) == false){
+        return 1;
+    }
+    initModelBuffer(model.size());
+    memcpy(getModelBufferMemoryOffset(), model.data(), model.size());
+    if(loadModel(model.size()) != 0){
+        return 1;
+    }
+    if(setTileSize(tile, overlap) != 0){
+        return 1;
+    }
+
+    int format = replayFormat(opt, FRAME_FORMAT_RGBA);
+    if(setInputFormat(format) != 0){
+        return 1;
+    }
+
+    // (2) Replay frames
+    std::vector<std::string> frames = listFrames(opt.frameDir);
+    std::vector<unsigned char> encoded;
+    LatencyRecorder recorder;
+    for(int r = 0; r < opt.repeat; r++){
+        for(const std::string &path : frames){
+            cv::Mat frame;
+            if(loadFrame(path, opt, 4, frame) == false || encodeFrame(frame, format, encoded) == false){
+                continue;
+            }
+            initInputImageBuffer(frame.cols, frame.rows, scale);
+            memcpy(getInputImageBufferOffset(), encoded.data(), encoded.size());
+            recorder.start();
+            int ret = exec(frame.cols, frame.rows, interpolation);
+            recorder.stop(path);
+            if(ret != 0){
+                printf("[REPLAY] exec failed (%d) at %s\n", ret, path.c_str());
+                return 1;
+            }
+        }
+    }
+    recorder.summary();
+    printf("[REPLAY] interpreter cache: %d hits, %d misses\n", getInterpreterCacheHits(), getInterpreterCacheMisses());
+    printf("[REPLAY] espcn: tensor type %d, %.2f Mpixel/s\n", getTensorType(), getEspcnThroughput());
+    return 0;
+}
@@ -0,0 +1,137 @@
+#ifndef __TENSOR_FEEDER_HPP__
+#define __TENSOR_FEEDER_HPP__
+
+#include <cstring>
+
+// Per-element conversion between uint8 images and float tensors, in place (no cv::Mat temporaries).
+//   feedU8ToF32: dst = src * scale + offset                       (image -> input tensor)
+//   readF32ToU8: dst = saturate(round(src * scale + offset))      (output tensor -> image)
+// Interleaved channels are just more elements, so a 3 channel image is fed as pixelNum * 3 elements.
+// 4 elements at a time with wasm SIMD (-msimd128), SSE2 or NEON. Otherwise (and for the tail) scalar.
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define TENSOR_FEEDER_SIMD 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TENSOR_FEEDER_SIMD 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TENSOR_FEEDER_SIMD 1
+#endif
+
+namespace tensor_feeder
+{
+    inline unsigned char saturate(float v)
+    {
+        v = v + 0.5f;
+        return v < 0.5f ? 0 : (v > 255.0f ? 255 : (unsigned char)v);
+    }
+
+#ifdef TENSOR_FEEDER_SIMD
+#if defined(__wasm_simd128__)
+    typedef v128_t vf;
+    inline vf set1(float x) { return wasm_f32x4_splat(x); }
+    inline vf madd(vf a, vf b, vf c) { return wasm_f32x4_add(wasm_f32x4_mul(a, b), c); }
+    inline vf load(const float *p) { return wasm_v128_load(p); }
+    inline void store(vf v, float *p) { wasm_v128_store(p, v); }
+    inline vf loadU8(const unsigned char *p)
+    {
+        int packed;
+        memcpy(&packed, p, 4);
+        v128_t u16 = wasm_u16x8_extend_low_u8x16(wasm_i32x4_make(packed, 0, 0, 0));
+        return wasm_f32x4_convert_i32x4(wasm_u32x4_extend_low_u16x8(u16));
+    }
+    // v must be in 0.0 - 255.0 (truncated)
+    inline void storeU8(vf v, unsigned char *p)
+    {
+        v128_t i32 = wasm_i32x4_trunc_sat_f32x4(v);
+        v128_t i16 = wasm_i16x8_narrow_i32x4(i32, i32);
+        int packed = wasm_i32x4_extract_lane(wasm_u8x16_narrow_i16x8(i16, i16), 0);
+        memcpy(p, &packed, 4);
+    }
+    inline vf clamp(vf v, float lo, float hi) { return wasm_f32x4_min(wasm_f32x4_max(v, set1(lo)), set1(hi)); }
+#elif defined(__SSE2__)
+    typedef __m128 vf;
+    inline vf set1(float x) { return _mm_set1_ps(x); }
+    inline vf madd(vf a, vf b, vf c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    inline vf load(const float *p) { return _mm_loadu_ps(p); }
+    inline void store(vf v, float *p) { _mm_storeu_ps(p, v); }
+    inline vf loadU8(const unsigned char *p)
+    {
+        int packed;
+        memcpy(&packed, p, 4);
+        __m128i zero = _mm_setzero_si128();
+        __m128i u16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(u16, zero));
+    }
+    inline void storeU8(vf v, unsigned char *p)
+    {
+        __m128i i32 = _mm_cvttps_epi32(v);
+        __m128i i16 = _mm_packs_epi32(i32, i32);
+        int packed = _mm_cvtsi128_si32(_mm_packus_epi16(i16, i16));
+        memcpy(p, &packed, 4);
+    }
+    inline vf clamp(vf v, float lo, float hi) { return _mm_min_ps(_mm_max_ps(v, set1(lo)), set1(hi)); }
+#else // __ARM_NEON
+    typedef float32x4_t vf;
+    inline vf set1(float x) { return vdupq_n_f32(x); }
+    inline vf madd(vf a, vf b, vf c) { return vmlaq_f32(c, a, b); }
+    inline vf load(const float *p) { return vld1q_f32(p); }
+    inline void store(vf v, float *p) { vst1q_f32(p, v); }
+    inline vf loadU8(const unsigned char *p)
+    {
+        uint32_t packed;
+        memcpy(&packed, p, 4);
+        uint16x8_t u16 = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(packed)));
+        return vcvtq_f32_u32(vmovl_u16(vget_low_u16(u16)));
+    }
+    inline void storeU8(vf v, unsigned char *p)
+    {
+        uint16x4_t u16 = vmovn_u32(vcvtq_u32_f32(v));
+        uint8x8_t u8 = vqmovn_u16(vcombine_u16(u16, u16));
+        vst1_lane_u32((uint32_t *)p, vreinterpret_u32_u8(u8), 0);
+    }
+    inline vf clamp(vf v, float lo, float hi) { return vminq_f32(vmaxq_f32(v, set1(lo)), set1(hi)); }
+#endif
+#endif
+}
+
+// uint8 -> float tensor. For example scale 1/255, offset 0 for [0, 1], or scale 1/127.5, offset -1 for [-1, 1].
+inline void feedU8ToF32(const unsigned char *src, float *dst, int n, float scale, float offset)
+{
+    int i = 0;
+#ifdef TENSOR_FEEDER_SIMD
+    const tensor_feeder::vf s = tensor_feeder::set1(scale);
+    const tensor_feeder::vf o = tensor_feeder::set1(offset);
+    for (; i + 4 <= n; i += 4)
+    {
+        tensor_feeder::store(tensor_feeder::madd(tensor_feeder::loadU8(src + i), s, o), dst + i);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        dst[i] = src[i] * scale + offset;
+    }
+}
+
+// float tensor -> uint8, rounded and saturated. Same result as cv::Mat::convertTo(CV_8U, scale, offset) except ties.
+inline void readF32ToU8(const float *src, unsigned char *dst, int n, float scale, float offset)
+{
+    int i = 0;
+#ifdef TENSOR_FEEDER_SIMD
+    const tensor_feeder::vf s = tensor_feeder::set1(scale);
+    const tensor_feeder::vf o = tensor_feeder::set1(offset + 0.5f);
+    for (; i + 4 <= n; i += 4)
+    {
+        tensor_feeder::vf v = tensor_feeder::madd(tensor_feeder::load(src + i), s, o);
+        tensor_feeder::storeU8(tensor_feeder::clamp(v, 0.0f, 255.0f), dst + i);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        dst[i] = tensor_feeder::saturate(src[i] * scale + offset);
+    }
+}
+
+#endif // __TENSOR_FEEDER_HPP__
@@ -1,11 +1,20 @@
-#include <SDL/SDL.h>
 #include <cstdio>
-#include <emscripten.h>
+#include "platform.hpp"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/model.h"
+#include "tensorflow/lite/schema/schema_generated.h"
 #include "opencv2/opencv.hpp"
 #include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
 #include <chrono>
+#include "buffer_arena.hpp"
+#include "stage_timer.hpp"
+#include "interpreter_cache.hpp"
+#include "yuv_session.hpp"
+#include "frame_format.hpp"
+#include "tensor_feeder.hpp"
 
 #define CHECK_TFLITE_ERROR(x)                                    \
     if (!(x))                                                    \
@@ -16,16 +25,25 @@
 
 
 namespace{
-    const int MAX_WIDTH   = 1024 *2;
-    const int MAX_HEIGHT  = 1024 *2;
-    char modelBuffer[1024*1024*256]; 
+    ///// Buffers, sized on demand
+    //// model: initModelBuffer(size), frame: initInputImageBuffer(width, height, scale)
+    BufferArena arena;
+    const int SLOT_MODEL          = 0;
+    const int SLOT_INPUT_IMAGE    = 1;
+    const int SLOT_OUTPUT_IMAGE   = 2;
+    const int SLOT_Y              = 3;
+    const int SLOT_SCALED_Y       = 4;
+    const int SLOT_TILE_ACC       = 5;
+    const int SLOT_TILE_WEIGHT    = 6;
+
+    char *modelBuffer = nullptr;
     
     ///// Buffer for image processing
-    unsigned char inputImageBuffer[4 * MAX_WIDTH * MAX_HEIGHT]; 
-    unsigned char outputImageBuffer[4 * MAX_WIDTH * MAX_HEIGHT];  
+    unsigned char *inputImageBuffer  = nullptr;     // frame size
+    unsigned char *outputImageBuffer = nullptr;     // scaled size
 
-    unsigned char Y[1 * MAX_WIDTH * MAX_HEIGHT]; 
-    unsigned char scaledY[1 * MAX_WIDTH * MAX_HEIGHT];  
+    unsigned char *Y       = nullptr;               // frame size
+    unsigned char *scaledY = nullptr;               // scaled size
 
     const int INTER_NEAREST  = 0;
     const int INTER_LINEAR   = 1;
@@ -33,21 +51,265 @@ namespace{
     const int INTER_CUBIC    = 3;
     const int INTER_LANCZOS4 = 4;
     const int INTER_ESPCN    = 100;
-}
 
-using std::chrono::high_resolution_clock;
-std::unique_ptr<tflite::Interpreter> interpreter;
+    ///// Layout of inputImageBuffer (setInputFormat). FRAME_FORMAT_RGBA, FRAME_FORMAT_I420 or FRAME_FORMAT_NV12.
+    //// YUV input: ESPCN reads the Y plane without color conversion, expanded from limited (16 - 235) to full range like the
+    //// luma of RGBA input (YUVSession::extractPlanar). Normal interpolation converts at the output size.
+    int inputFormat = FRAME_FORMAT_RGBA;
+
+    ///// U, V of the last extracted frame, for mergeY / exec
+    YUVSession yuv;
+
+    bool frameFits(int width, int height){
+        size_t frameSize = frameBufferSize(inputFormat, width, height);
+        return frameSize != 0 && arena.capacity(SLOT_INPUT_IMAGE) >= frameSize;
+    }
+
+    // Y of the frame into the Y buffer. U, V are kept in the session.
+    void extractFrame(int width, int height){
+        if(inputFormat == FRAME_FORMAT_RGBA){
+            yuv.extract(inputImageBuffer, width, height, Y);
+        }else{
+            yuv.extractPlanar(inputFormat, inputImageBuffer, width, height, Y);
+        }
+    }
+
+    ///// Model and its interpreters, one per input shape (whole frame size, or tile size)
+    std::unique_ptr<tflite::FlatBufferModel> model;
+    InterpreterCache interpreters;
+
+    ///// Tensor type of the model, read from the flatbuffer at loadModel
+    //// kTfLiteFloat32: Y / 255 in, output x 255 back.
+    //// kTfLiteUInt8 / kTfLiteInt8 (quantized): Y bytes go into the input tensor through feedLUT and the output bytes come
+    //// back through readLUT, no float plane on either side. With the usual quantization (uint8, scale 1/255, zero point 0)
+    //// both tables are the identity and the planes are copied as is.
+    TfLiteType tensorType = kTfLiteFloat32;
+    unsigned char feedLUT[256];     // Y -> input tensor byte
+    unsigned char readLUT[256];     // output tensor byte -> Y
+    float readLUTF[256];            // output tensor byte -> 0.0 - 1.0, for the tile blending
+    bool feedIdentity = false;
+    bool readIdentity = false;
+
+    ///// Throughput of the ESPCN path (feed + invoke + readback), since loadModel / resetEspcnThroughput
+    double espcnMsec   = 0;
+    double espcnPixels = 0;
+
+    // Per-tensor scale and zero point of a quantized tensor. false without them.
+    bool tensorQuantization(const tflite::Tensor *tensor, TfLiteQuantizationParams &params){
+        const tflite::QuantizationParameters *q = tensor->quantization();
+        if(q == nullptr || q->scale() == nullptr || q->scale()->size() == 0 || q->scale()->Get(0) <= 0.0f){
+            return false;
+        }
+        params.scale      = q->scale()->Get(0);
+        params.zero_point = q->zero_point() != nullptr && q->zero_point()->size() > 0 ? (int)q->zero_point()->Get(0) : 0;
+        return true;
+    }
+
+    // Tensor type and quantization of the model, read from its first subgraph (no interpreter is built for it).
+    int prepareTensorType(const tflite::FlatBufferModel &flatBufferModel){
+        const tflite::Model *m = flatBufferModel.GetModel();
+        const tflite::SubGraph *subgraph = m->subgraphs() != nullptr && m->subgraphs()->size() > 0 ? m->subgraphs()->Get(0) : nullptr;
+        if(subgraph == nullptr || subgraph->tensors() == nullptr || subgraph->inputs() == nullptr || subgraph->inputs()->size() == 0 ||
+           subgraph->outputs() == nullptr || subgraph->outputs()->size() == 0){
+            printf("[WASM] model without input / output tensor\n");
+            return 1;
+        }
+        const tflite::Tensor *input  = subgraph->tensors()->Get(subgraph->inputs()->Get(0));
+        const tflite::Tensor *output = subgraph->tensors()->Get(subgraph->outputs()->Get(0));
+        const tflite::TensorType type = input->type();
+        if(type != output->type() || (type != tflite::TensorType_FLOAT32 && type != tflite::TensorType_UINT8 && type != tflite::TensorType_INT8)){
+            printf("[WASM] unsupported tensor type (input:%s, output:%s)\n", tflite::EnumNameTensorType(type), tflite::EnumNameTensorType(output->type()));
+            return 1;
+        }
+        tensorType = type == tflite::TensorType_FLOAT32 ? kTfLiteFloat32 : (type == tflite::TensorType_UINT8 ? kTfLiteUInt8 : kTfLiteInt8);
+        if(tensorType == kTfLiteFloat32){
+            return 0;
+        }
+        TfLiteQuantizationParams inParams;
+        TfLiteQuantizationParams outParams;
+        if(tensorQuantization(input, inParams) == false || tensorQuantization(output, outParams) == false){
+            printf("[WASM] quantized model without quantization parameters\n");
+            return 1;
+        }
+
+        const int qmin = tensorType == kTfLiteInt8 ? -128 : 0;
+        const int qmax = qmin + 255;
+        feedIdentity = true;
+        readIdentity = true;
+        for(int v = 0; v < 256; v++){
+            int q = (int)std::lround(v / 255.0f / inParams.scale) + inParams.zero_point;
+            feedLUT[v] = (unsigned char)std::min(std::max(q, qmin), qmax);    // int8 as its two's complement byte
+            feedIdentity = feedIdentity && feedLUT[v] == v;
+
+            int raw = tensorType == kTfLiteInt8 ? (int)(signed char)v : v;
+            readLUTF[v] = (raw - outParams.zero_point) * outParams.scale;
+            float p = readLUTF[v] * 255.0f + 0.5f;
+            readLUT[v] = p < 0.0f ? 0 : (p > 255.0f ? 255 : (unsigned char)p);
+            readIdentity = readIdentity && readLUT[v] == v;
+        }
+        printf("[WASM] quantized model (%s) input:%f/%d output:%f/%d\n", tensorType == kTfLiteInt8 ? "int8" : "uint8",
+               inParams.scale, inParams.zero_point, outParams.scale, outParams.zero_point);
+        return 0;
+    }
+
+    ///// Tiled ESPCN (setTileSize)
+    //// The Y plane is cut into tileSize x tileSize tiles overlapping by tileOverlap, and each tile goes through
+    //// the interpreter of the tile shape. The seams are blended with linear ramps over the overlap.
+    //// Tensor memory does not depend on the frame size.
+    int tileSize    = 0;                // 0: whole frame in one shot
+    int tileOverlap = 8;
+    std::vector<float> tileRampX;
+    std::vector<float> tileRampY;
+
+    // Tile origins covering the length, stepping (tile - overlap). The last tile is aligned to the end.
+    void tileOrigins(int length, int tile, int overlap, std::vector<int> &origins){
+        origins.clear();
+        if(length <= tile){
+            origins.push_back(0);
+            return;
+        }
+        for(int o = 0; ; o += tile - overlap){
+            if(o + tile >= length){
+                origins.push_back(length - tile);
+                break;
+            }
+            origins.push_back(o);
+        }
+    }
+
+    // Blend weight along one axis of a tile. Ramps up / down over the overlap on the sides shared with a neighbor.
+    void tileRamp(int length, int ramp, bool head, bool tail, std::vector<float> &weight){
+        weight.assign(length, 1.0f);
+        for(int i = 0; i < ramp && i < length; i++){
+            float w = (i + 0.5f) / ramp;
+            if(head){
+                weight[i] = std::min(weight[i], w);
+            }
+            if(tail){
+                weight[length - 1 - i] = std::min(weight[length - 1 - i], w);
+            }
+        }
+    }
+
+    // Y plane -> upscaled Y plane (scaledY size), tile by tile.
+    int upscaleTiled(tflite::Interpreter *tileInterpreter, const cv::Mat &y, cv::Mat &scaledY){
+        const int width     = y.cols;
+        const int height    = y.rows;
+        const int outWidth  = scaledY.cols;
+        const int outHeight = scaledY.rows;
+        const int scale     = outWidth / width;
+        const int tileOut   = tileSize * scale;
+        const int overlap   = std::min(tileOverlap, tileSize / 2);
+
+        float *acc    = (float*)arena.reserve(SLOT_TILE_ACC,    sizeof(float) * outWidth * outHeight);
+        float *weight = (float*)arena.reserve(SLOT_TILE_WEIGHT, sizeof(float) * outWidth * outHeight);
+        if(acc == nullptr || weight == nullptr){
+            return 1;
+        }
+        memset(acc,    0, sizeof(float) * outWidth * outHeight);
+        memset(weight, 0, sizeof(float) * outWidth * outHeight);
+
+        std::vector<int> xs, ys;
+        tileOrigins(width,  tileSize, overlap, xs);
+        tileOrigins(height, tileSize, overlap, ys);
+        const bool quantized = tensorType != kTfLiteFloat32;
+        float *input          = quantized ? nullptr : tileInterpreter->typed_input_tensor<float>(0);
+        unsigned char *inputQ = quantized ? tileInterpreter->input_tensor(0)->data.uint8 : nullptr;
+        std::vector<float> outputRow(quantized ? tileOut : 0);
+        for(size_t ty = 0; ty < ys.size(); ty++){
+            tileRamp(tileOut, overlap * scale, ty > 0, ty + 1 < ys.size(), tileRampY);
+            for(size_t tx = 0; tx < xs.size(); tx++){
+                tileRamp(tileOut, overlap * scale, tx > 0, tx + 1 < xs.size(), tileRampX);
+                const int x0 = xs[tx];
+                const int y0 = ys[ty];
+
+                // (a) tile input. Edge pixels are repeated when the frame is smaller than the tile.
+                for(int j = 0; j < tileSize; j++){
+                    const unsigned char *src = y.ptr<unsigned char>(std::min(y0 + j, height - 1));
+                    if(quantized){
+                        for(int i = 0; i < tileSize; i++){
+                            inputQ[j * tileSize + i] = feedLUT[src[std::min(x0 + i, width - 1)]];
+                        }
+                    }else{
+                        const int valid = std::min(tileSize, width - x0);
+                        feedU8ToF32(src + x0, input + j * tileSize, valid, 1.0f / 255.0f, 0.0f);
+                        for(int i = valid; i < tileSize; i++){
+                            input[j * tileSize + i] = input[j * tileSize + valid - 1];
+                        }
+                    }
+                }
+
+                // (b) infer
+                CHECK_TFLITE_ERROR(tileInterpreter->Invoke() == kTfLiteOk);
+
+                // (c) accumulate the weighted tile
+                const float *output         = quantized ? nullptr : tileInterpreter->typed_output_tensor<float>(0);
+                const unsigned char *outputQ = quantized ? tileInterpreter->output_tensor(0)->data.uint8 : nullptr;
+                const int ox0 = x0 * scale;
+                const int oy0 = y0 * scale;
+                const int validWidth  = std::min(tileOut, outWidth  - ox0);
+                const int validHeight = std::min(tileOut, outHeight - oy0);
+                for(int j = 0; j < validHeight; j++){
+                    if(quantized){
+                        for(int i = 0; i < validWidth; i++){
+                            outputRow[i] = readLUTF[outputQ[j * tileOut + i]];
+                        }
+                    }
+                    const float *src = quantized ? outputRow.data() : output + j * tileOut;
+                    float *a = acc    + (oy0 + j) * outWidth + ox0;
+                    float *w = weight + (oy0 + j) * outWidth + ox0;
+                    for(int i = 0; i < validWidth; i++){
+                        float tw = tileRampX[i] * tileRampY[j];
+                        a[i] += src[i] * tw;
+                        w[i] += tw;
+                    }
+                }
+            }
+        }
+
+        // (d) normalize
+        for(int j = 0; j < outHeight; j++){
+            unsigned char *dst = scaledY.ptr<unsigned char>(j);
+            const float *a = acc    + j * outWidth;
+            const float *w = weight + j * outWidth;
+            for(int i = 0; i < outWidth; i++){
+                float v = a[i] / w[i] * 255.0f + 0.5f;
+                dst[i] = v < 0.0f ? 0 : (v > 255.0f ? 255 : (unsigned char)v);
+            }
+        }
+        return 0;
+    }
+}
 
-auto start_time = high_resolution_clock::now();
-auto count = 0;
 
 extern "C"
 {
+    EMSCRIPTEN_KEEPALIVE
+    int initModelBuffer(int size){
+        modelBuffer = (char*)arena.reserve(SLOT_MODEL, size);
+        return modelBuffer != nullptr ? 0 : 1;
+    }
     EMSCRIPTEN_KEEPALIVE
     char *getModelBufferMemoryOffset(){
         return modelBuffer;
     }
 
+    // scale: scale factor of the model. output and scaledY are reserved for (width * scale, height * scale).
+    EMSCRIPTEN_KEEPALIVE
+    int initInputImageBuffer(int width, int height, int scale){
+        int pixelNum       = width * height;
+        int scaledPixelNum = width * scale * height * scale;
+        inputImageBuffer  = arena.reserve(SLOT_INPUT_IMAGE,  4 * pixelNum);
+        Y                 = arena.reserve(SLOT_Y,            1 * pixelNum);
+        outputImageBuffer = arena.reserve(SLOT_OUTPUT_IMAGE, 4 * scaledPixelNum);
+        scaledY           = arena.reserve(SLOT_SCALED_Y,     1 * scaledPixelNum);
+        return inputImageBuffer != nullptr && Y != nullptr && outputImageBuffer != nullptr && scaledY != nullptr ? 0 : 1;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getReservedBufferSize(){
+        return arena.reserved();
+    }
+
     EMSCRIPTEN_KEEPALIVE
     unsigned char *getInputImageBufferOffset(){
         return inputImageBuffer;
@@ -70,44 +332,33 @@ extern "C"
 
     EMSCRIPTEN_KEEPALIVE
     int extractY(int width, int height){
-        // (1) Generate InputImage and OutputImage Mat
-        cv::Mat inputImage(height, width, CV_8UC4, inputImageBuffer);
-        cv::Mat y(height, width, CV_8UC1, Y);
-        cv::Mat u,v;
-        // (2) Extract Y
-        std::vector<cv::Mat> inputPlanes= {y, u, v};
-        cv::Mat inputYUV;
-        cv::cvtColor(inputImage, inputYUV, cv::COLOR_RGB2YUV);
-        cv::split(inputYUV, inputPlanes);
+        STAGE_TIMER(timer);
+        if(frameFits(width, height) == false){
+            printf("[WASM] frame (%d, %d) exceeds the buffer (or odd size for YUV). call initInputImageBuffer first.\n", width, height);
+            return 1;
+        }
+        // (1) Extract Y. U and V are kept for mergeY.
+        extractFrame(width, height);
+        STAGE_LAP(timer, STAGE_PREPROCESS);
         return 0;
     }
 
     EMSCRIPTEN_KEEPALIVE
     int mergeY(int width, int height, int scaled_width, int scaled_height){
-        // (1) Generate InputImage and OutputImage Mat
-        cv::Mat inputImage(height, width, CV_8UC4, inputImageBuffer);
-        cv::Mat y(scaled_height, scaled_width, CV_8UC1, scaledY);
-        cv::Mat outputImage(scaled_height, scaled_width, CV_8UC4, outputImageBuffer);
-
-        // (2) convert to YUV
-        std::vector<cv::Mat> inputPlanes;
-        cv::Mat inputYUV;
-        cv::cvtColor(inputImage, inputYUV, cv::COLOR_RGB2YUV);
-        cv::split(inputYUV, inputPlanes);
-
-        // (3) resize original for output
-        cv::Mat resizedInputImageU(scaled_height, scaled_width, CV_8UC1);
-        cv::Mat resizedInputImageV(scaled_height, scaled_width, CV_8UC1);
-        cv::resize(inputPlanes[1], resizedInputImageU, resizedInputImageU.size(), 0, 0, cv::INTER_CUBIC);
-        cv::resize(inputPlanes[2], resizedInputImageV, resizedInputImageV.size(), 0, 0, cv::INTER_CUBIC);
-
-        // (4) merge result and input to output
-        cv::Mat channels[] = {y, resizedInputImageU, resizedInputImageV};
-        // cv::Mat channels[] = {resizedInputImageU, resizedInputImageU, resizedInputImageV};
-        // cv::Mat channels[] = {y, y, y};
-        cv::Mat outputYUV;
-        cv::merge(channels, 3, outputYUV);
-        cv::cvtColor(outputYUV, outputImage, cv::COLOR_YUV2RGB, 4); // 4 is required!
+        STAGE_TIMER(timer);
+        if(arena.capacity(SLOT_SCALED_Y) < (size_t)(scaled_width * scaled_height)){
+            printf("[WASM] scaled frame (%d, %d) exceeds the buffer. call initInputImageBuffer first.\n", scaled_width, scaled_height);
+            return 1;
+        }
+        // (1) U, V of the frame. Normally kept by extractY, recomputed only when it was not called for this size.
+        if(yuv.matches(inputFormat, width, height) == false){
+            extractFrame(width, height);
+            STAGE_LAP(timer, STAGE_PREPROCESS);
+        }
+
+        // (2) chroma upsample + merge with the scaled Y, straight into the output
+        yuv.merge(scaledY, scaled_width, scaled_height, outputImageBuffer);
+        STAGE_LAP(timer, STAGE_OUTPUT);
         return 0;
     }
 
@@ -139,67 +390,180 @@ extern "C"
     EMSCRIPTEN_KEEPALIVE
     int exec(int width, int height, int interpolationType){
         //interpolationType => 0: espcn, 1:cubic
+        STAGE_TIMER(timer);
+        if(frameFits(width, height) == false){
+            printf("[WASM] frame (%d, %d) exceeds the buffer (or odd size for YUV). call initInputImageBuffer first.\n", width, height);
+            return 1;
+        }
 
         // (0) setup interpretter
-        std::vector<int> sizes = {1, height, width, 1};
-        CHECK_TFLITE_ERROR(interpreter->ResizeInputTensor(0, sizes) == kTfLiteOk);
-        CHECK_TFLITE_ERROR(interpreter->AllocateTensors() == kTfLiteOk);
-
-        int outHeight = interpreter->output_tensor(0)->dims->data[1];
-        int outWidth  = interpreter->output_tensor(0)->dims->data[2];
-
+        //// tiled: interpreter of the tile shape. whole frame: interpreter of the frame shape.
+        //// Both come from the cache, so the tensor arena is planned only for a new shape.
+        tflite::Interpreter *interpreter = nullptr;
+        int outHeight = 0;
+        int outWidth  = 0;
+        if(tileSize > 0){
+            interpreter = interpreters.get({1, tileSize, tileSize, 1});
+            CHECK_TFLITE_ERROR(interpreter != nullptr);
+            int scale = interpreter->output_tensor(0)->dims->data[1] / tileSize;
+            outHeight = height * scale;
+            outWidth  = width  * scale;
+        }else{
+            interpreter = interpreters.get({1, height, width, 1});
+            CHECK_TFLITE_ERROR(interpreter != nullptr);
+            outHeight = interpreter->output_tensor(0)->dims->data[1];
+            outWidth  = interpreter->output_tensor(0)->dims->data[2];
+        }
+        outputImageBuffer = arena.reserve(SLOT_OUTPUT_IMAGE, 4 * outWidth * outHeight);
 
 
-        // (1) Generate InputImage and OutputImage Mat
-        cv::Mat inputImage(height, width, CV_8UC4, inputImageBuffer);
+        // (1) Generate OutputImage Mat
         cv::Mat outputImage(outHeight, outWidth, CV_8UC4, outputImageBuffer);
         
         // (1.5) normal interpolatiopn.
         if( interpolationType != INTER_ESPCN){
             // early return when normal interpolation is selected
             int code = getOpenCVInterpolationCode(interpolationType);
-            cv::resize(inputImage, outputImage, outputImage.size(), 0, 0, code);
+            resizeFrame(inputFormat, inputImageBuffer, width, height, FRAME_FORMAT_RGBA, outputImage, code);
+            STAGE_LAP(timer, STAGE_OUTPUT);
             return 0;
         }
 
-        // (2) Extract Y of YUV
-        std::vector<cv::Mat> inputPlanes;
-        cv::Mat inputYUV;
-        cv::cvtColor(inputImage, inputYUV, cv::COLOR_RGB2YUV);
-        cv::split(inputYUV, inputPlanes);
+        // (2) Extract Y of YUV (U, V are kept in the session for (7))
+        extractFrame(width, height);
+        cv::Mat inputY(height, width, CV_8UC1, Y);
+        scaledY = arena.reserve(SLOT_SCALED_Y, outWidth * outHeight);
+        cv::Mat intepreterOutputMatUC8(outHeight, outWidth, CV_8UC1, scaledY);
+        auto espcnStart = std::chrono::high_resolution_clock::now();
+        if(tileSize > 0){
+            // (3)-(6) tile by tile
+            STAGE_LAP(timer, STAGE_PREPROCESS);
+            CHECK_TFLITE_ERROR(upscaleTiled(interpreter, inputY, intepreterOutputMatUC8) == 0);
+            STAGE_LAP(timer, STAGE_INVOKE);
+        }else if(tensorType != kTfLiteFloat32){
+            // (3) input: Y bytes straight into the quantized tensor
+            unsigned char *input = interpreter->input_tensor(0)->data.uint8;
+            if(feedIdentity){
+                memcpy(input, Y, width * height);
+            }else{
+                for(int i = 0; i < width * height; i++){
+                    input[i] = feedLUT[Y[i]];
+                }
+            }
+            STAGE_LAP(timer, STAGE_PREPROCESS);
+
+            // (4) infer
+            CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+            STAGE_LAP(timer, STAGE_INVOKE);
+
+            // (5), (6) output bytes back to Y
+            const unsigned char *output = interpreter->output_tensor(0)->data.uint8;
+            if(readIdentity){
+                memcpy(scaledY, output, outWidth * outHeight);
+            }else{
+                for(int i = 0; i < outWidth * outHeight; i++){
+                    scaledY[i] = readLUT[output[i]];
+                }
+            }
+            STAGE_LAP(timer, STAGE_DECODE);
+        }else{
+            // (3) input
+            float *input = interpreter->typed_input_tensor<float>(0);
+            feedU8ToF32(Y, input, width * height, 1.0f / 255.0f, 0.0f);
+            STAGE_LAP(timer, STAGE_PREPROCESS);
+
+            // (4) infer
+            CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+            STAGE_LAP(timer, STAGE_INVOKE);
+
+            // (5) output
+            float *output = interpreter->typed_output_tensor<float>(0);
+
+            // (6) convert output to uint8
+            readF32ToU8(output, scaledY, outWidth * outHeight, 255.0f, 0.0f);
+            STAGE_LAP(timer, STAGE_DECODE);
+        }
+        espcnMsec   += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - espcnStart).count();
+        espcnPixels += (double)outWidth * outHeight;
 
-        // (3) input
-        float *input = interpreter->typed_input_tensor<float>(0);
-        cv::Mat intepreterInputMat(height, width, CV_32FC1, input);
-        inputPlanes[0].convertTo(intepreterInputMat, CV_32F, 1.0f / 255.0f);
+        // (7) chroma upsample + merge with the result, straight into the output
+        yuv.merge(scaledY, outWidth, outHeight, outputImageBuffer);
+        STAGE_LAP(timer, STAGE_OUTPUT);
 
-        // (4) infer       
-        CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
 
-        // (5) output
-        float *output = interpreter->typed_output_tensor<float>(0);
-        cv::Mat intepreterOutputMat(outHeight, outWidth, CV_32FC1, output);
+        return 0;
+    }
+    
+    // Input format
+    //// format: 0 RGBA, 1 I420, 2 NV12 (see frame_format.hpp). Width and height must be even for I420 / NV12.
+    //// initInputImageBuffer reserves 4 bytes per pixel, enough for every format.
+    EMSCRIPTEN_KEEPALIVE
+    int setInputFormat(int format){
+        if(format != FRAME_FORMAT_RGBA && isYUVFrameFormat(format) == false){
+            printf("[WASM] invalid input format %d\n", format);
+            return 1;
+        }
+        inputFormat = format;
+        return 0;
+    }
 
-        // (6) convert output to uint8
-        cv::Mat intepreterOutputMatUC8(outHeight, outWidth, CV_8UC1);
-        intepreterOutputMat.convertTo(intepreterOutputMatUC8, CV_8U, 255.0f);
+    // Tiled ESPCN for exec. tileSize: 0 (whole frame in one shot) or >= 16, overlap: 0 - tileSize / 2 (pixels of the input)
+    EMSCRIPTEN_KEEPALIVE
+    int setTileSize(int size, int overlap){
+        if(size != 0 && (size < 16 || overlap < 0 || overlap > size / 2)){
+            printf("[WASM] invalid tile (%d, %d)\n", size, overlap);
+            return 1;
+        }
+        tileSize    = size;
+        tileOverlap = overlap;
+        return 0;
+    }
 
-        // (7) resize original for output
-        cv::Mat resizedInputImageU(outHeight, outWidth, CV_8UC1);
-        cv::Mat resizedInputImageV(outHeight, outWidth, CV_8UC1);
-        cv::resize(inputPlanes[1], resizedInputImageU, resizedInputImageU.size(), 0, 0, cv::INTER_CUBIC);
-        cv::resize(inputPlanes[2], resizedInputImageV, resizedInputImageV.size(), 0, 0, cv::INTER_CUBIC);
+    // Interpreter cache. size: number of input shapes kept prepared (1 - 8, default 3)
+    EMSCRIPTEN_KEEPALIVE
+    int setInterpreterCacheSize(int size){
+        return interpreters.setCapacity(size);
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    int getInterpreterCacheHits(){
+        return interpreters.hits();
+    }
 
-        // (8) merge result and input to output
-        cv::Mat channels[] = {intepreterOutputMatUC8, resizedInputImageU, resizedInputImageV};
-        cv::Mat outputYUV;
-        cv::merge(channels, 3, outputYUV);
-        cv::cvtColor(outputYUV, outputImage, cv::COLOR_YUV2RGB, 4); // 4 is required!
+    EMSCRIPTEN_KEEPALIVE
+    int getInterpreterCacheMisses(){
+        return interpreters.misses();
+    }
 
+    // Tensor type of the loaded model (TfLiteType). 1: float32, 3: uint8, 9: int8
+    EMSCRIPTEN_KEEPALIVE
+    int getTensorType(){
+        return tensorType;
+    }
 
+    // ESPCN throughput (output megapixels per second of feed + invoke + readback), for comparing float and quantized models
+    EMSCRIPTEN_KEEPALIVE
+    float getEspcnThroughput(){
+        return espcnMsec > 0 ? (float)(espcnPixels / 1000.0 / espcnMsec) : 0.0f;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int resetEspcnThroughput(){
+        espcnMsec   = 0;
+        espcnPixels = 0;
         return 0;
     }
-    
+
+    // Per-stage timing of extractY / mergeY / exec. Records of [frame, stage, msec], see stage_timer.hpp.
+    //// nullptr / 0 unless built with --copt=-DENABLE_STAGE_TIMING
+    EMSCRIPTEN_KEEPALIVE
+    float *getTimingBufferAddress(){
+        return stageTimingRecords();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getTimingCount(){
+        return stageTimingCount();
+    }
+
     EMSCRIPTEN_KEEPALIVE
     int loadModel(int bufferSize){
         printf("[WASM] --------------------------------------------------------\n");
@@ -211,37 +575,17 @@ extern "C"
         printf("[WASM] Loading model of size: %d\n", bufferSize);
 
         // Load model
-        std::unique_ptr<tflite::FlatBufferModel> model = tflite::FlatBufferModel::BuildFromBuffer(modelBuffer, bufferSize);
-        CHECK_TFLITE_ERROR(model != nullptr);
-
-        tflite::ops::builtin::BuiltinOpResolver resolver;
-        tflite::InterpreterBuilder builder(*model, resolver);
-        builder(&interpreter);
-        CHECK_TFLITE_ERROR(interpreter != nullptr);
-        // CHECK_TFLITE_ERROR(interpreter->AllocateTensors() == kTfLiteOk);
-
-
-
-        // int s1 = interpreter->tensors_size();
-        // int s2 = interpreter->nodes_size();
-        // int s3 = interpreter->inputs().size();
-        // const char * s4 = interpreter->GetInputName(0);
-        // printf(">>>>>>>>>>> %d, %d, %d, %s\n", s1, s2, s3, s4);
-        // for (int indxInput=0; indxInput < interpreter->inputs().size(); ++indxInput){
-        //     for (int indxDim=0; indxDim < interpreter->input_tensor(indxInput)->dims->size; ++indxDim){
-        //         printf(">>  %d, %d, %d\n", indxInput, indxDim, interpreter->tensor(indxInput)->dims->data[indxDim]);
-        //     }
-        // }
-
-        // int s5 = interpreter->outputs().size();
-        // const char * s6 = interpreter->GetOutputName(0);
-        // printf(">>>>>>>>>>> %d, %s\n", s5, s6);
-        // for (int indxOutput=0; indxOutput < interpreter->outputs().size(); ++indxOutput){
-        //     for (int indxDim=0; indxDim < interpreter->output_tensor(indxOutput)->dims->size; ++indxDim){
-        //         printf(">>  %d, %d, %d\n", indxOutput, indxDim, interpreter->output_tensor(indxOutput)->dims->data[indxDim]);
-        //     }
-        // }
-
+        //// modelBuffer already holds the new bytes: the previous model and its interpreters are dropped first,
+        //// and the new one is installed only once it is valid.
+        interpreters.reset(nullptr);
+        model.reset();
+        std::unique_ptr<tflite::FlatBufferModel> newModel = tflite::FlatBufferModel::BuildFromBuffer(modelBuffer, bufferSize);
+        CHECK_TFLITE_ERROR(newModel != nullptr);
+        CHECK_TFLITE_ERROR(prepareTensorType(*newModel) == 0);
+        model = std::move(newModel);
+        interpreters.reset(model.get());
+        espcnMsec   = 0;
+        espcnPixels = 0;
         return 0;
     }
 }
@@ -0,0 +1,148 @@
+#ifndef __YUV_SESSION_HPP__
+#define __YUV_SESSION_HPP__
+
+#include <algorithm>
+#include <vector>
+#include "fused_resize.hpp"
+#include "frame_format.hpp"
+
+// YUV decomposition of the current frame, kept between extract (Y for the model) and merge (upscaled Y -> RGBA).
+// Same coefficients as cv::COLOR_RGB2YUV / cv::COLOR_YUV2RGB, so the result matches the cvtColor based pipeline
+// except for rounding in the chroma resize.
+//   extract: RGBA -> Y (caller's buffer) and U, V (kept here), one pass.
+//   merge:   bicubic U, V upsample + YUV -> RGBA, one pass over the destination. No intermediate planes.
+// extractPlanar takes an I420 / NV12 frame instead: Y is only expanded to full range, and the 4:2:0 chroma is kept
+// at half resolution and converted with the BT.601 limited range coefficients in merge.
+class YUVSession
+{
+private:
+    int width = 0;
+    int height = 0;
+    int chromaWidth = 0;
+    int chromaHeight = 0;
+    int format = FRAME_FORMAT_RGBA; // layout extracted from
+    bool limitedRange = false;      // chroma from extractPlanar
+    std::vector<unsigned char> u, v;
+    std::vector<float> rowU, rowV;
+    ResizePlanCache plans;
+
+    static unsigned char saturate(float x)
+    {
+        x += 0.5f;
+        return x < 0.0f ? 0 : (x > 255.0f ? 255 : (unsigned char)x);
+    }
+
+public:
+    // rgba: width x height RGBA, y: width x height
+    void extract(const unsigned char *rgba, int w, int h, unsigned char *y)
+    {
+        width = chromaWidth = w;
+        height = chromaHeight = h;
+        format = FRAME_FORMAT_RGBA;
+        limitedRange = false;
+        u.resize(w * h);
+        v.resize(w * h);
+        const int size = w * h;
+        for (int i = 0; i < size; i++)
+        {
+            const unsigned char *p = rgba + i * 4;
+            float luma = 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2];
+            y[i] = saturate(luma);
+            u[i] = saturate((p[2] - luma) * 0.492f + 128.0f);
+            v[i] = saturate((p[0] - luma) * 0.877f + 128.0f);
+        }
+    }
+
+    // src: I420 / NV12 frame (w x h, even), y: w x h full range luma
+    void extractPlanar(int srcFormat, const unsigned char *src, int w, int h, unsigned char *y)
+    {
+        PlanarFrame frame = planarFrame(srcFormat, src, w, h);
+        width = w;
+        height = h;
+        format = srcFormat;
+        chromaWidth = frame.chromaWidth;
+        chromaHeight = frame.chromaHeight;
+        limitedRange = true;
+        for (int i = 0; i < w * h; i++)
+        {
+            y[i] = saturate((frame.y[i] - 16) * (255.0f / 219.0f));
+        }
+        u.resize(chromaWidth * chromaHeight);
+        v.resize(chromaWidth * chromaHeight);
+        for (int j = 0; j < chromaHeight; j++)
+        {
+            const unsigned char *srcU = frame.u + j * frame.chromaStride;
+            const unsigned char *srcV = frame.v + j * frame.chromaStride;
+            for (int i = 0; i < chromaWidth; i++)
+            {
+                u[j * chromaWidth + i] = srcU[i * frame.chromaStep];
+                v[j * chromaWidth + i] = srcV[i * frame.chromaStep];
+            }
+        }
+    }
+
+    // True when U, V of a w x h frame of the layout are kept.
+    bool matches(int srcFormat, int w, int h)
+    {
+        return srcFormat == format && w == width && h == height && width > 0;
+    }
+
+    // scaledY: dstWidth x dstHeight, rgba: dstWidth x dstHeight RGBA (alpha 255)
+    void merge(const unsigned char *scaledY, int dstWidth, int dstHeight, unsigned char *rgba)
+    {
+        std::shared_ptr<const ResizePlan> plan = plans.get(chromaWidth, chromaHeight, dstWidth, dstHeight, RESIZE_CUBIC);
+        const int xn = plan->xTaps.taps;
+        const int yn = plan->yTaps.taps;
+        // luma is full range in both cases. limited range chroma: 255/224 folded into the coefficients
+        const float kRV = limitedRange ? 1.596f : 1.140f;
+        const float kGU = limitedRange ? 0.391f : 0.395f;
+        const float kGV = limitedRange ? 0.813f : 0.581f;
+        const float kBU = limitedRange ? 2.018f : 2.032f;
+        rowU.resize(chromaWidth);
+        rowV.resize(chromaWidth);
+        for (int dy = 0; dy < dstHeight; dy++)
+        {
+            // vertical taps, once per destination row
+            const int *yIndex = &plan->yTaps.index[dy * yn];
+            const float *yWeight = &plan->yTaps.weight[dy * yn];
+            std::fill(rowU.begin(), rowU.end(), 0.0f);
+            std::fill(rowV.begin(), rowV.end(), 0.0f);
+            for (int j = 0; j < yn; j++)
+            {
+                const unsigned char *srcU = &u[yIndex[j] * chromaWidth];
+                const unsigned char *srcV = &v[yIndex[j] * chromaWidth];
+                const float w = yWeight[j];
+                for (int sx = 0; sx < chromaWidth; sx++)
+                {
+                    rowU[sx] += srcU[sx] * w;
+                    rowV[sx] += srcV[sx] * w;
+                }
+            }
+
+            // horizontal taps + YUV -> RGB
+            const int *xIndex = plan->xTaps.index.data();
+            const float *xWeight = plan->xTaps.weight.data();
+            const unsigned char *srcY = scaledY + dy * dstWidth;
+            unsigned char *dst = rgba + dy * dstWidth * 4;
+            for (int dx = 0; dx < dstWidth; dx++, xIndex += xn, xWeight += xn)
+            {
+                float du = 0, dv = 0;
+                for (int i = 0; i < xn; i++)
+                {
+                    du += rowU[xIndex[i]] * xWeight[i];
+                    dv += rowV[xIndex[i]] * xWeight[i];
+                }
+                // the resized chroma is uint8 in the cvtColor pipeline
+                du = std::min(std::max(du, 0.0f), 255.0f) - 128.0f;
+                dv = std::min(std::max(dv, 0.0f), 255.0f) - 128.0f;
+                const float luma = srcY[dx];
+                dst[dx * 4 + 0] = saturate(luma + kRV * dv);
+                dst[dx * 4 + 1] = saturate(luma - kGU * du - kGV * dv);
+                dst[dx * 4 + 2] = saturate(luma + kBU * du);
+                dst[dx * 4 + 3] = 255;
+            }
+        }
+    }
+};
+
+#endif // __YUV_SESSION_HPP__
@@ -0,0 +1,11 @@
+#ifndef __PLATFORM_HPP__
+#define __PLATFORM_HPP__
+
+// Emscripten glue. Native (host) builds compile the same code with the exports as plain C functions.
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+#endif // __PLATFORM_HPP__
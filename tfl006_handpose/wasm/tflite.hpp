@@ -12,6 +12,8 @@
 #include "mediapipe/NonMaxSuppression.hpp"
 #include "mediapipe/PackPalmResult.hpp"
 #include "const.hpp"
+#include "stage_timer.hpp"
+#include "frame_format.hpp"
 std::unique_ptr<tflite::Interpreter> interpreter;
 std::unique_ptr<tflite::Interpreter> landmarkInterpreter;
 static std::vector<Anchor> s_anchors;
@@ -248,9 +250,11 @@ public:
     }
 
     unsigned char *inputBuffer;
+    size_t inputBufferSize = 0;
     void initInputBuffer(int width, int height, int channel)
     {
         inputBuffer = new unsigned char[width * height * channel];
+        inputBufferSize = (size_t)width * height * channel;
         initOutputBuffer();
         initTemporaryBuffer();
     }
@@ -259,6 +263,31 @@ public:
         return inputBuffer;
     }
 
+    // Layout of the frame in the input buffer (FRAME_FORMAT_*): RGBA, I420 or NV12.
+    int inputFormat = FRAME_FORMAT_RGBA;
+    int setInputFormat(int format)
+    {
+        if (format != FRAME_FORMAT_RGBA && !isYUVFrameFormat(format))
+        {
+            return 1;
+        }
+        inputFormat = format;
+        return 0;
+    }
+
+    // Full resolution RGBA of the frame for the landmark crops. A YUV frame is converted here, only when something was detected.
+    std::vector<unsigned char> frameRGBA;
+    unsigned char *inputRGBA(int width, int height)
+    {
+        if (inputFormat == FRAME_FORMAT_RGBA)
+        {
+            return inputBuffer;
+        }
+        frameRGBA.resize((size_t)width * height * 4);
+        convertFrame(inputFormat, inputBuffer, width, height, FRAME_FORMAT_RGBA, frameRGBA.data());
+        return frameRGBA.data();
+    }
+
     float *outputBuffer;
     void initOutputBuffer()
     {
@@ -281,16 +310,20 @@ public:
 
     void exec(int width, int height, int max_palm_num, int resizedFactor)
     {
+        STAGE_TIMER(timer);
         float *input = interpreter->typed_input_tensor<float>(0);
 
-        cv::Mat inputImage(height, width, CV_8UC4, inputBuffer);
+        size_t frameSize = frameBufferSize(inputFormat, width, height);
+        if (frameSize == 0 || frameSize > inputBufferSize)
+        {
+            printf("[WASM] frame %dx%d (format %d) does not fit the input buffer\n", width, height, inputFormat);
+            return;
+        }
         cv::Mat temporaryImage(1024, 1024, CV_8UC4, temporaryBuffer);
 
-        cv::Mat inputImageRGB(height, width, CV_8UC3);
-        int fromTo[] = {0, 0, 1, 1, 2, 2}; // split alpha channel
-        cv::mixChannels(&inputImage, 1, &inputImageRGB, 1, fromTo, 3);
+        // resize first, then drop alpha (or convert from YUV) at the detector input size
         cv::Mat resizedInputImageRGB(palm_input_height, palm_input_width, CV_8UC3);
-        cv::resize(inputImageRGB, resizedInputImageRGB, resizedInputImageRGB.size());
+        resizeFrame(inputFormat, inputBuffer, width, height, FRAME_FORMAT_RGB, resizedInputImageRGB, cv::INTER_LINEAR);
         cv::Mat inputImage32F(palm_input_height, palm_input_width, CV_32FC3, input);
         resizedInputImageRGB.convertTo(inputImage32F, CV_32FC3);
 
@@ -304,14 +337,17 @@ public:
         {
             inputImage32F = inputImage32F / 255.0;
         }
+        STAGE_LAP(timer, STAGE_PREPROCESS);
 
         // // (2) Infer
         CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+        STAGE_LAP(timer, STAGE_INVOKE);
 
         //// decode keyoiints
         float score_thresh = 0.2f;
         std::list<palm_t> palm_list;
         decode_keypoints(palm_list, score_thresh, points_ptr, scores_ptr, &s_anchors, palmType);
+        STAGE_LAP(timer, STAGE_DECODE);
 
         //// NMS
         float iou_thresh = 0.005f;
@@ -321,7 +357,13 @@ public:
         //// Pack
         palm_detection_result_t palm_result;
         pack_palm_result(&palm_result, palm_nms_list, max_palm_num);
+        STAGE_LAP(timer, STAGE_NMS);
 
+        cv::Mat inputImage;
+        if (palm_result.num > 0)
+        {
+            inputImage = cv::Mat(height, width, CV_8UC4, inputRGBA(width, height));
+        }
         for (int i = 0; i < palm_result.num; i++)
         {
             int minX = width;
@@ -438,9 +480,11 @@ public:
             {
                 inputImage32F = inputImage32F / 255.0;
             }
+            STAGE_LAP(timer, STAGE_LANDMARK_PREPROCESS);
 
             //// Landmark検出
             CHECK_TFLITE_ERROR(landmarkInterpreter->Invoke() == kTfLiteOk);
+            STAGE_LAP(timer, STAGE_LANDMARK_INVOKE);
 
             float score = *handflag_ptr;
             if (score > 0.0000001)
@@ -464,6 +508,7 @@ public:
                     palm_result.palms[i].handedness = *handedness_ptr;
                 }
             }
+            STAGE_LAP(timer, STAGE_LANDMARK_DECODE);
 
             //// output
             /////
@@ -535,6 +580,7 @@ public:
                     }
                 }
             }
+            STAGE_LAP(timer, STAGE_OUTPUT);
         }
     }
 };
@@ -0,0 +1,95 @@
+#include <cstring>
+#include "replay_util.hpp"
+
+// Native frame replay for face landmark detection. Reports the latency of exec per frame.
+//// bazel build -c opt :replay && bazel-bin/replay --model <detector tflite> --landmark <landmark tflite> --frames <dir> [--size WxH]
+//// --max_face_num <(1)>
+extern "C"
+{
+    int initDetectorModelBuffer(int size);
+    char *getDetectorModelBufferAddress();
+    int loadDetectorModel(int size);
+    int initLandmarkModelBuffer(int size);
+    char *getLandmarkModelBufferAddress();
+    int loadLandmarkModel(int size);
+    int initInputBuffer(int width, int height, int channel);
+    unsigned char *getInputBufferAddress();
+    int setInputFormat(int format);
+    int exec(int width, int height, int max_face_num);
+}
+
+namespace
+{
+    bool loadModelFile(const std::string &path, int (*initBuffer)(int), char *(*getBuffer)(), int (*load)(int))
+    {
+        std::vector<char> model;
+        if (readFile(path, model) == false)
+        {
+            return false;
+        }
+        initBuffer(model.size());
+        memcpy(getBuffer(), model.data(), model.size());
+        return load(model.size()) == 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ReplayOptions opt;
+    if (parseReplayOptions(argc, argv, opt) == false || opt.landmarkModel.empty())
+    {
+        printf("[REPLAY] --model and --landmark are required\n");
+        return 1;
+    }
+    int maxFaceNum = intParam(opt, "max_face_num", 1);
+
+    // (1) Load models
+    if (loadModelFile(opt.model, initDetectorModelBuffer, getDetectorModelBufferAddress, loadDetectorModel) == false)
+    {
+        return 1;
+    }
+    if (loadModelFile(opt.landmarkModel, initLandmarkModelBuffer, getLandmarkModelBufferAddress, loadLandmarkModel) == false)
+    {
+        return 1;
+    }
+
+    int format = replayFormat(opt, FRAME_FORMAT_RGBA);
+    if (setInputFormat(format) != 0)
+    {
+        return 1;
+    }
+
+    // (2) Replay frames
+    std::vector<std::string> frames = listFrames(opt.frameDir);
+    std::vector<unsigned char> encoded;
+    LatencyRecorder recorder;
+    int allocatedPixels = 0;
+    for (int r = 0; r < opt.repeat; r++)
+    {
+        for (const std::string &path : frames)
+        {
+            cv::Mat frame;
+            if (loadFrame(path, opt, 4, frame) == false || encodeFrame(frame, format, encoded) == false)
+            {
+                continue;
+            }
+            if (frame.cols * frame.rows > allocatedPixels)
+            {
+                // input buffer is allocated for the largest frame, same as maxProcessWidth/Height on the JS side
+                initInputBuffer(frame.cols, frame.rows, 4);
+                allocatedPixels = frame.cols * frame.rows;
+            }
+            memcpy(getInputBufferAddress(), encoded.data(), encoded.size());
+            recorder.start();
+            int ret = exec(frame.cols, frame.rows, maxFaceNum);
+            recorder.stop(path);
+            if (ret != 0)
+            {
+                printf("[REPLAY] exec failed (%d) at %s\n", ret, path.c_str());
+                return 1;
+            }
+        }
+    }
+    recorder.summary();
+    return 0;
+}
@@ -41,11 +41,17 @@ export interface TFLite extends EmscriptenModule {
     _initDetectorModelBuffer(size: number): void;
     _initLandmarkModelBuffer(size: number): void;
     _initInputBuffer(width: number, height: number, channel: number): void
+    /// 0: RGBA, 1: I420, 2: NV12 (width and height must be even)
+    _setInputFormat(format: number): number;
 
     _loadDetectorModel(bufferSize: number): number;
     _loadLandmarkModel(bufferSize: number): number;
     _exec(widht: number, height: number, max_pose_num: number, resizedFactor: number, cropExt: number): number;
     _set_calculate_mode(mode: number): number
+
+    /// Stage timing ([frame, stage, msec] records, build with -DENABLE_STAGE_TIMING)
+    _getTimingBufferAddress(): number;
+    _getTimingCount(): number;
 }
 export const INPUT_WIDTH = 256
 export const INPUT_HEIGHT = 256
@@ -1,15 +1,12 @@
 #include <iostream>
 #include <memory>
 #include "tflite.hpp"
-#include <emscripten.h>
+#include "platform.hpp"
 
 namespace
 {
 }
 
-using std::chrono::high_resolution_clock;
-
-auto start_time = high_resolution_clock::now();
 MemoryUtil *m = new MemoryUtil();
 
 extern "C"
@@ -61,6 +58,11 @@ extern "C"
     {
         return m->inputBuffer;
     }
+    EMSCRIPTEN_KEEPALIVE
+    int setInputFormat(int format)
+    {
+        return m->setInputFormat(format);
+    }
 
     EMSCRIPTEN_KEEPALIVE
     float *getOutputBufferAddress()
@@ -94,4 +96,17 @@ extern "C"
         m->set_calculate_mode(mode);
         return 0;
     }
+
+    // Per-stage timing of exec. Records of [frame, stage, msec], see stage_timer.hpp.
+    // nullptr / 0 unless built with --copt=-DENABLE_STAGE_TIMING
+    EMSCRIPTEN_KEEPALIVE
+    float *getTimingBufferAddress()
+    {
+        return stageTimingRecords();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getTimingCount()
+    {
+        return stageTimingCount();
+    }
 }
\ No newline at end of file
@@ -11,6 +11,8 @@
 #include "mediapipe/NonMaxSuppression.hpp"
 #include "mediapipe/PackPoseResult.hpp"
 #include "const.hpp"
+#include "stage_timer.hpp"
+#include "frame_format.hpp"
 std::unique_ptr<tflite::Interpreter> interpreter;
 std::unique_ptr<tflite::Interpreter> landmarkInterpreter;
 static std::vector<Anchor> s_anchors;
@@ -246,9 +248,11 @@ public:
     }
 
     unsigned char *inputBuffer;
+    size_t inputBufferSize = 0;
     void initInputBuffer(int width, int height, int channel)
     {
         inputBuffer = new unsigned char[width * height * channel];
+        inputBufferSize = (size_t)width * height * channel;
         initOutputBuffer();
         initTemporaryBuffer();
     }
@@ -257,6 +261,31 @@ public:
         return inputBuffer;
     }
 
+    // Layout of the frame in the input buffer (FRAME_FORMAT_*): RGBA, I420 or NV12.
+    int inputFormat = FRAME_FORMAT_RGBA;
+    int setInputFormat(int format)
+    {
+        if (format != FRAME_FORMAT_RGBA && !isYUVFrameFormat(format))
+        {
+            return 1;
+        }
+        inputFormat = format;
+        return 0;
+    }
+
+    // Full resolution RGBA of the frame for the landmark crops. A YUV frame is converted here, only when something was detected.
+    std::vector<unsigned char> frameRGBA;
+    unsigned char *inputRGBA(int width, int height)
+    {
+        if (inputFormat == FRAME_FORMAT_RGBA)
+        {
+            return inputBuffer;
+        }
+        frameRGBA.resize((size_t)width * height * 4);
+        convertFrame(inputFormat, inputBuffer, width, height, FRAME_FORMAT_RGBA, frameRGBA.data());
+        return frameRGBA.data();
+    }
+
     float *outputBuffer;
     void initOutputBuffer()
     {
@@ -279,31 +308,37 @@ public:
 
     void exec(int width, int height, int max_pose_num, int resizedFactor, float cropExtention)
     {
+        STAGE_TIMER(timer);
         float *input = interpreter->typed_input_tensor<float>(0);
 
-        cv::Mat inputImage(height, width, CV_8UC4, inputBuffer);
+        size_t frameSize = frameBufferSize(inputFormat, width, height);
+        if (frameSize == 0 || frameSize > inputBufferSize)
+        {
+            printf("[WASM] frame %dx%d (format %d) does not fit the input buffer\n", width, height, inputFormat);
+            return;
+        }
         cv::Mat temporaryImage(1024, 1024, CV_8UC4, temporaryBuffer);
 
-        cv::Mat inputImageRGB(height, width, CV_8UC3);
-        int fromTo[] = {0, 0, 1, 1, 2, 2}; // split alpha channel
-        cv::mixChannels(&inputImage, 1, &inputImageRGB, 1, fromTo, 3);
-        // printf("detector input: %d,%d\n", detector_input_height, detector_input_width);
+        // resize first, then drop alpha (or convert from YUV) at the detector input size
         cv::Mat resizedInputImageRGB(detector_input_height, detector_input_width, CV_8UC3);
-        cv::resize(inputImageRGB, resizedInputImageRGB, resizedInputImageRGB.size());
+        resizeFrame(inputFormat, inputBuffer, width, height, FRAME_FORMAT_RGB, resizedInputImageRGB, cv::INTER_LINEAR);
         cv::Mat inputImage32F(detector_input_height, detector_input_width, CV_32FC3, input);
         resizedInputImageRGB.convertTo(inputImage32F, CV_32FC3);
         float mean = 128.0f;
         float std = 128.0f;
         inputImage32F = (inputImage32F - mean) / std;
+        STAGE_LAP(timer, STAGE_PREPROCESS);
 
         // // (2) Infer
         // printf("Infer!\n");
         CHECK_TFLITE_ERROR(interpreter->Invoke() == kTfLiteOk);
+        STAGE_LAP(timer, STAGE_INVOKE);
 
         //// decode keyoiints
         float score_thresh = 0.2f;
         std::list<pose_t> pose_list;
         decode_keypoints(pose_list, score_thresh, points_ptr, scores_ptr, &s_anchors);
+        STAGE_LAP(timer, STAGE_DECODE);
 
         //// NMS
         float iou_thresh = 0.005f;
@@ -313,7 +348,13 @@ public:
         //// Pack
         pose_detection_result_t pose_result;
         pack_pose_result(&pose_result, pose_nms_list, max_pose_num);
+        STAGE_LAP(timer, STAGE_NMS);
 
+        cv::Mat inputImage;
+        if (pose_result.num > 0)
+        {
+            inputImage = cv::Mat(height, width, CV_8UC4, inputRGBA(width, height));
+        }
         for (int i = 0; i < pose_result.num; i++)
         {
             float *landmarkInput = landmarkInterpreter->typed_input_tensor<float>(0);
@@ -392,9 +433,11 @@ public:
             cv::Mat inputImage32F(landmark_input_height, landmark_input_width, CV_32FC3, landmarkInput);
             inputImageRGB.convertTo(inputImage32F, CV_32FC3);
             inputImage32F = inputImage32F / 255.0;
+            STAGE_LAP(timer, STAGE_LANDMARK_PREPROCESS);
 
             //// Landmark検出
             CHECK_TFLITE_ERROR(landmarkInterpreter->Invoke() == kTfLiteOk);
+            STAGE_LAP(timer, STAGE_LANDMARK_INVOKE);
 
             float score = *poseflag_ptr;
             if (score > 0.0000001)
@@ -481,6 +524,7 @@ public:
                     }
                 }
             }
+            STAGE_LAP(timer, STAGE_LANDMARK_DECODE);
         }
 
         //// output
@@ -562,6 +606,7 @@ public:
                 }
             }
         }
+        STAGE_LAP(timer, STAGE_OUTPUT);
     }
 
     int set_calculate_mode(int mode)
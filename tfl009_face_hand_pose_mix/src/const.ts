@@ -29,6 +29,10 @@ export interface PoseLandmarkDetectionConfig {
     wasmBase64: string;
     wasmSimdBase64: string;
     useSimd: boolean;
+    // pthreads build (tflite-simd-threads). Used only on a cross-origin isolated page, it is not bundled.
+    useThreads: boolean;
+    numThreads: number;
+    wasmThreadsUrl: string;
 
     maxProcessWidth: number
     maxProcessHeight: number
@@ -40,6 +44,9 @@ export interface PoseLandmarkDetectionOperationParams {
 }
 
 export interface TFLite extends EmscriptenModule {
+    /** Common **/
+    _setNumThreads(numThreads: number): number;
+
     /** Hand  **/
     _getHandInputBufferAddress(): number;
     _getHandOutputBufferAddress(): number;
@@ -51,6 +58,7 @@ export interface TFLite extends EmscriptenModule {
     _initPalmDetectorModelBuffer(size: number): void;
     _initHandLandmarkModelBuffer(size: number): void;
     _initHandInputBuffer(width: number, height: number, channel: number): void
+    _setHandInputFormat(format: number): number; // 0: RGBA, 1: I420, 2: NV12
 
     _loadPalmDetectorModel(bufferSize: number): number;
     _loadHandLandmarkModel(bufferSize: number): number;
@@ -67,6 +75,7 @@ export interface TFLite extends EmscriptenModule {
     _initFaceDetectorModelBuffer(size: number): void;
     _initFaceLandmarkModelBuffer(size: number): void;
     _initFaceInputBuffer(width: number, height: number, channel: number): void
+    _setFaceInputFormat(format: number): number; // 0: RGBA, 1: I420, 2: NV12
 
     _loadFaceDetectorModel(bufferSize: number): number;
     _loadFaceLandmarkModel(bufferSize: number): number;
@@ -83,11 +92,16 @@ export interface TFLite extends EmscriptenModule {
     _initPoseDetectorModelBuffer(size: number): void;
     _initPoseLandmarkModelBuffer(size: number): void;
     _initPoseInputBuffer(width: number, height: number, channel: number): void
+    _setPoseInputFormat(format: number): number; // 0: RGBA, 1: I420, 2: NV12
 
     _loadPoseDetectorModel(bufferSize: number): number;
     _loadPoseLandmarkModel(bufferSize: number): number;
     _execPose(widht: number, height: number, max_pose_num: number, resizedFactor: number, cropExt: number): number;
     _set_pose_calculate_mode(mode: number): number
+
+    /** Stage timing ([frame, stage, msec] records, build with -DENABLE_STAGE_TIMING) **/
+    _getTimingBufferAddress(): number;
+    _getTimingCount(): number;
 }
 export const INPUT_WIDTH = 256
 export const INPUT_HEIGHT = 256
@@ -95,6 +95,10 @@ export const generatePoseLandmarkDetectionDefaultConfig = (): PoseLandmarkDetect
         useSimd: true,
         wasmBase64: wasm.split(",")[1],
         wasmSimdBase64: wasmSimd.split(",")[1],
+        useThreads: true,
+        // ?threads=N to compare thread counts (1 - 4, TFLITE_MAX_NUM_THREADS of threads.hpp)
+        numThreads: parseInt(new URLSearchParams(window.location.search).get("threads") || "") || Math.min(4, navigator.hardwareConcurrency || 1),
+        wasmThreadsUrl: "./wasm/tflite-simd-threads.js",
         maxProcessWidth: 1024 ,
         maxProcessHeight: 1024 
     };
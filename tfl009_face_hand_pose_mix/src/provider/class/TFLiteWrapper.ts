@@ -1,6 +1,24 @@
 import { BrowserTypes, getBrowserType } from "@dannadori/000_WorkerBase";
 import { TFLite, TFLitePoseLandmarkDetection, PoseLandmarkDetectionConfig, PoseLandmarkDetectionOperationParams, TFLiteHand, TFLiteFaceLandmarkDetection } from "../../const";
 
+// The pthreads build needs SharedArrayBuffer, which only a cross-origin isolated page has (COOP / COEP headers).
+const isCrossOriginIsolated = () => {
+    return (window as Window & { crossOriginIsolated?: boolean }).crossOriginIsolated === true;
+};
+
+// The pthreads build is loaded from its file, not bundled: its workers load the same script again by URL.
+const loadThreadsModule = (url: string) => {
+    return new Promise<void>((resolve, reject) => {
+        const script = document.createElement("script");
+        script.src = url;
+        script.onload = () => resolve();
+        script.onerror = () => reject(new Error(`${url} is not available`));
+        document.head.appendChild(script);
+    }).then(() => {
+        return (window as Window & { createTFLiteSIMDThreadsModule: () => Promise<TFLite> }).createTFLiteSIMDThreadsModule();
+    });
+};
+
 export class TFLiteWrapper {
     tflite: TFLite | null = null;
     poseImageInputAddress: number = 0
@@ -16,7 +34,20 @@ export class TFLiteWrapper {
 
     init = async (config: PoseLandmarkDetectionConfig) => {
         const browserType = getBrowserType();
-        if (config.useSimd && browserType !== BrowserTypes.SAFARI) {
+        this.tflite = null;
+        if (config.useThreads && config.useSimd && browserType !== BrowserTypes.SAFARI && isCrossOriginIsolated()) {
+            try {
+                this.tflite = await loadThreadsModule(config.wasmThreadsUrl);
+                // before the models are loaded: the XNNPACK pool of each interpreter is sized when it is built
+                this.tflite._setNumThreads(config.numThreads);
+            } catch (e) {
+                console.log("[TFLiteWrapper] threads build is not available, fall back to simd", e);
+                this.tflite = null;
+            }
+        }
+        if (this.tflite) {
+            console.log("[TFLiteWrapper] threads build, num threads:", config.numThreads);
+        } else if (config.useSimd && browserType !== BrowserTypes.SAFARI) {
             const modSimd = require("../../../resources/wasm/tflite-simd.js");
             const b = Buffer.from(config.wasmSimdBase64!, "base64");
             this.tflite = await modSimd({ wasmBinary: b });
@@ -1,7 +1,7 @@
 #include <iostream>
 #include <memory>
 #include "face-core.hpp"
-#include <emscripten.h>
+#include "platform.hpp"
 
 namespace
 {
@@ -58,6 +58,11 @@ extern "C"
     {
         return face->faceInputBuffer;
     }
+    EMSCRIPTEN_KEEPALIVE
+    int setFaceInputFormat(int format)
+    {
+        return face->setInputFormat(format);
+    }
 
     EMSCRIPTEN_KEEPALIVE
     float *getFaceOutputBufferAddress()
@@ -11,6 +11,9 @@
 #include "mediapipe_face/NonMaxSuppression.hpp"
 #include "mediapipe_face/PackFaceResult.hpp"
 #include "const.hpp"
+#include "threads.hpp"
+#include "stage_timer.hpp"
+#include "frame_format.hpp"
 std::unique_ptr<tflite::Interpreter> faceInterpreter;
 std::unique_ptr<tflite::Interpreter> faceLandmarkInterpreter;
 static std::vector<Anchor> s_anchors;
@@ -65,7 +68,7 @@ public:
 
         tflite::ops::builtin::BuiltinOpResolver resolver;
         tflite::InterpreterBuilder builder(*model, resolver);
-        builder(&faceInterpreter);
+        builder(&faceInterpreter, tfliteNumThreads());
         CHECK_TFLITE_ERROR(faceInterpreter != nullptr);
         CHECK_TFLITE_ERROR(faceInterpreter->AllocateTensors() == kTfLiteOk);
 
@@ -173,7 +176,7 @@ public:
 
         tflite::ops::builtin::BuiltinOpResolver resolver;
         tflite::InterpreterBuilder builder(*landmarkModel, resolver);
-        builder(&faceLandmarkInterpreter);
+        builder(&faceLandmarkInterpreter, tfliteNumThreads());
         CHECK_TFLITE_ERROR(faceLandmarkInterpreter != nullptr);
         CHECK_TFLITE_ERROR(faceLandmarkInterpreter->AllocateTensors() == kTfLiteOk);
 
@@ -268,9 +271,11 @@ public:
     }
 
     unsigned char *faceInputBuffer;
+    size_t faceInputBufferSize = 0;
     void initFaceInputBuffer(int width, int height, int channel)
     {
         faceInputBuffer = new unsigned char[width * height * channel];
+        faceInputBufferSize = (size_t)width * height * channel;
         initFaceOutputBuffer();
         initFaceTemporaryBuffer();
     }
@@ -279,6 +284,31 @@ public:
         return faceInputBuffer;
     }
 
+    // Layout of the frame in the input buffer (FRAME_FORMAT_*): RGBA, I420 or NV12.
+    int inputFormat = FRAME_FORMAT_RGBA;
+    int setInputFormat(int format)
+    {
+        if (format != FRAME_FORMAT_RGBA && !isYUVFrameFormat(format))
+        {
+            return 1;
+        }
+        inputFormat = format;
+        return 0;
+    }
+
+    // Full resolution RGBA of the frame for the landmark crops. A YUV frame is converted here, only when something was detected.
+    std::vector<unsigned char> frameRGBA;
+    unsigned char *inputRGBA(int width, int height)
+    {
+        if (inputFormat == FRAME_FORMAT_RGBA)
+        {
+            return faceInputBuffer;
+        }
+        frameRGBA.resize((size_t)width * height * 4);
+        convertFrame(inputFormat, faceInputBuffer, width, height, FRAME_FORMAT_RGBA, frameRGBA.data());
+        return frameRGBA.data();
+    }
+
     float *faceOutputBuffer;
     void initFaceOutputBuffer()
     {
@@ -301,30 +331,37 @@ public:
 
     void execFace(int width, int height, int max_face_num)
     {
+        STAGE_TIMER(timer);
         float *input = faceInterpreter->typed_input_tensor<float>(0);
 
-        cv::Mat inputImage(height, width, CV_8UC4, faceInputBuffer);
+        size_t frameSize = frameBufferSize(inputFormat, width, height);
+        if (frameSize == 0 || frameSize > faceInputBufferSize)
+        {
+            printf("[WASM] frame %dx%d (format %d) does not fit the input buffer\n", width, height, inputFormat);
+            return;
+        }
         cv::Mat temporaryImage(1024, 1024, CV_8UC4, faceTemporaryBuffer);
 
-        cv::Mat inputImageRGB(height, width, CV_8UC3);
-        int fromTo[] = {0, 0, 1, 1, 2, 2}; // split alpha channel
-        cv::mixChannels(&inputImage, 1, &inputImageRGB, 1, fromTo, 3);
+        // resize first, then drop alpha (or convert from YUV) at the detector input size
         cv::Mat resizedInputImageRGB(detector_input_height, detector_input_width, CV_8UC3);
-        cv::resize(inputImageRGB, resizedInputImageRGB, resizedInputImageRGB.size());
+        resizeFrame(inputFormat, faceInputBuffer, width, height, FRAME_FORMAT_RGB, resizedInputImageRGB, cv::INTER_LINEAR);
         cv::Mat inputImage32F(detector_input_height, detector_input_width, CV_32FC3, input);
         resizedInputImageRGB.convertTo(inputImage32F, CV_32FC3);
         float mean = 128.0f;
         float std = 128.0f;
         inputImage32F = (inputImage32F - mean) / std;
+        STAGE_LAP(timer, STAGE_PREPROCESS);
 
         // // (2) Infer
         // printf("Infer!\n");
         CHECK_TFLITE_ERROR(faceInterpreter->Invoke() == kTfLiteOk);
+        STAGE_LAP(timer, STAGE_INVOKE);
 
         //// decode keyoiints
         float score_thresh = 0.2f;
         std::list<face_t> face_list;
         decode_keypoints(face_list, score_thresh, points_ptr, scores_ptr, &s_anchors, detectorType);
+        STAGE_LAP(timer, STAGE_DECODE);
 
         //// NMS
         float iou_thresh = 0.005f;
@@ -333,7 +370,13 @@ public:
         //// Pack
         face_detection_result_t face_result;
         pack_face_result(&face_result, face_nms_list, max_face_num);
+        STAGE_LAP(timer, STAGE_NMS);
 
+        cv::Mat inputImage;
+        if (face_result.num > 0)
+        {
+            inputImage = cv::Mat(height, width, CV_8UC4, inputRGBA(width, height));
+        }
         for (int i = 0; i < face_result.num; i++)
         {
             int minX = width;
@@ -439,9 +482,11 @@ public:
             cv::Mat inputImage32F(landmark_input_height, landmark_input_width, CV_32FC3, landmarkInput);
             inputImageRGB.convertTo(inputImage32F, CV_32FC3);
             inputImage32F = inputImage32F / 255.0;
+            STAGE_LAP(timer, STAGE_LANDMARK_PREPROCESS);
 
             //// Landmark検出
             CHECK_TFLITE_ERROR(faceLandmarkInterpreter->Invoke() == kTfLiteOk);
+            STAGE_LAP(timer, STAGE_LANDMARK_INVOKE);
             float score = *faceflag_ptr;
             if (score > 0.0000001)
             {
@@ -550,6 +595,7 @@ public:
                     face_result.faces[i].landmark_right_iris[j].y = (dst_points[0].y - squaredRoiMinY + minY) / height;
                 }
             }
+            STAGE_LAP(timer, STAGE_LANDMARK_DECODE);
         }
 
         //// output
@@ -660,6 +706,7 @@ public:
                 }
             }
         }
+        STAGE_LAP(timer, STAGE_OUTPUT);
     }
 };
 #endif //__FACE_CORE_HPP__
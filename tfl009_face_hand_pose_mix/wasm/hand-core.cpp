@@ -1,7 +1,7 @@
 #include <iostream>
 #include <memory>
 #include "hand-core.hpp"
-#include <emscripten.h>
+#include "platform.hpp"
 
 namespace
 {
@@ -58,6 +58,11 @@ extern "C"
     {
         return hand->handInputBuffer;
     }
+    EMSCRIPTEN_KEEPALIVE
+    int setHandInputFormat(int format)
+    {
+        return hand->setInputFormat(format);
+    }
 
     EMSCRIPTEN_KEEPALIVE
     float *getHandOutputBufferAddress()
@@ -1,7 +1,7 @@
 #include <iostream>
 #include <memory>
 #include "pose-core.hpp"
-#include <emscripten.h>
+#include "platform.hpp"
 
 namespace
 {
@@ -58,6 +58,11 @@ extern "C"
     {
         return pose->poseInputBuffer;
     }
+    EMSCRIPTEN_KEEPALIVE
+    int setPoseInputFormat(int format)
+    {
+        return pose->setInputFormat(format);
+    }
 
     EMSCRIPTEN_KEEPALIVE
     float *getPoseOutputBufferAddress()
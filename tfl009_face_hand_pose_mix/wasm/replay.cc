@@ -0,0 +1,166 @@
+#include <cstring>
+#include "replay_util.hpp"
+
+// Native frame replay for face/hand/pose mix. Reports the latency of execHand/execFace/execPose per frame.
+//// bazel build -c opt :replay && bazel-bin/replay --mode <hand|face|pose> --model <detector tflite> --landmark <landmark tflite> --frames <dir> [--size WxH]
+//// --max_num <hand:4, face:1, pose:1> --resized_factor <hand:2, pose:4> --crop_extention <pose:1.8> --threads <(1)>
+extern "C"
+{
+    int setNumThreads(int numThreads);
+
+    int initPalmDetectorModelBuffer(int size);
+    char *getPalmDetectorModelBufferAddress();
+    int loadPalmDetectorModel(int size);
+    int initHandLandmarkModelBuffer(int size);
+    char *getHandLandmarkModelBufferAddress();
+    int loadHandLandmarkModel(int size);
+    int initHandInputBuffer(int width, int height, int channel);
+    unsigned char *getHandInputBufferAddress();
+    int setHandInputFormat(int format);
+    int execHand(int width, int height, int max_palm_num, int resizedFactor);
+
+    int initFaceDetectorModelBuffer(int size);
+    char *getFaceDetectorModelBufferAddress();
+    int loadFaceDetectorModel(int size);
+    int initFaceLandmarkModelBuffer(int size);
+    char *getFaceLandmarkModelBufferAddress();
+    int loadFaceLandmarkModel(int size);
+    int initFaceInputBuffer(int width, int height, int channel);
+    unsigned char *getFaceInputBufferAddress();
+    int setFaceInputFormat(int format);
+    int execFace(int width, int height, int max_face_num);
+
+    int initPoseDetectorModelBuffer(int size);
+    char *getPoseDetectorModelBufferAddress();
+    int loadPoseDetectorModel(int size);
+    int initPoseLandmarkModelBuffer(int size);
+    char *getPoseLandmarkModelBufferAddress();
+    int loadPoseLandmarkModel(int size);
+    int initPoseInputBuffer(int width, int height, int channel);
+    unsigned char *getPoseInputBufferAddress();
+    int setPoseInputFormat(int format);
+    int execPose(int width, int height, int max_pose_num, int resizedFactor, float cropExtention);
+}
+
+namespace
+{
+    bool loadModelFile(const std::string &path, int (*initBuffer)(int), char *(*getBuffer)(), int (*load)(int))
+    {
+        std::vector<char> model;
+        if (readFile(path, model) == false)
+        {
+            return false;
+        }
+        initBuffer(model.size());
+        memcpy(getBuffer(), model.data(), model.size());
+        return load(model.size()) == 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ReplayOptions opt;
+    if (parseReplayOptions(argc, argv, opt) == false || opt.landmarkModel.empty() || opt.params.count("mode") == 0)
+    {
+        printf("[REPLAY] --mode, --model and --landmark are required\n");
+        return 1;
+    }
+    const std::string mode = opt.params["mode"];
+    if (mode != "hand" && mode != "face" && mode != "pose")
+    {
+        printf("[REPLAY] unknown mode: %s\n", mode.c_str());
+        return 1;
+    }
+    int maxNum = intParam(opt, "max_num", mode == "hand" ? 4 : 1);
+    int resizedFactor = intParam(opt, "resized_factor", mode == "hand" ? 2 : 4);
+    float cropExtention = floatParam(opt, "crop_extention", 1.8);
+    setNumThreads(intParam(opt, "threads", 1));
+
+    // (1) Load models
+    bool loaded = false;
+    if (mode == "hand")
+    {
+        loaded = loadModelFile(opt.model, initPalmDetectorModelBuffer, getPalmDetectorModelBufferAddress, loadPalmDetectorModel) &&
+                 loadModelFile(opt.landmarkModel, initHandLandmarkModelBuffer, getHandLandmarkModelBufferAddress, loadHandLandmarkModel);
+    }
+    else if (mode == "face")
+    {
+        loaded = loadModelFile(opt.model, initFaceDetectorModelBuffer, getFaceDetectorModelBufferAddress, loadFaceDetectorModel) &&
+                 loadModelFile(opt.landmarkModel, initFaceLandmarkModelBuffer, getFaceLandmarkModelBufferAddress, loadFaceLandmarkModel);
+    }
+    else
+    {
+        loaded = loadModelFile(opt.model, initPoseDetectorModelBuffer, getPoseDetectorModelBufferAddress, loadPoseDetectorModel) &&
+                 loadModelFile(opt.landmarkModel, initPoseLandmarkModelBuffer, getPoseLandmarkModelBufferAddress, loadPoseLandmarkModel);
+    }
+    if (loaded == false)
+    {
+        return 1;
+    }
+
+    int format = replayFormat(opt, FRAME_FORMAT_RGBA);
+    int formatRet = mode == "hand" ? setHandInputFormat(format) : (mode == "face" ? setFaceInputFormat(format) : setPoseInputFormat(format));
+    if (formatRet != 0)
+    {
+        return 1;
+    }
+
+    // (2) Replay frames
+    std::vector<std::string> frames = listFrames(opt.frameDir);
+    std::vector<unsigned char> encoded;
+    LatencyRecorder recorder;
+    int allocatedPixels = 0;
+    for (int r = 0; r < opt.repeat; r++)
+    {
+        for (const std::string &path : frames)
+        {
+            cv::Mat frame;
+            if (loadFrame(path, opt, 4, frame) == false || encodeFrame(frame, format, encoded) == false)
+            {
+                continue;
+            }
+            if (frame.cols * frame.rows > allocatedPixels)
+            {
+                // input buffer is allocated for the largest frame, same as maxProcessWidth/Height on the JS side
+                if (mode == "hand")
+                {
+                    initHandInputBuffer(frame.cols, frame.rows, 4);
+                }
+                else if (mode == "face")
+                {
+                    initFaceInputBuffer(frame.cols, frame.rows, 4);
+                }
+                else
+                {
+                    initPoseInputBuffer(frame.cols, frame.rows, 4);
+                }
+                allocatedPixels = frame.cols * frame.rows;
+            }
+            unsigned char *input = mode == "hand" ? getHandInputBufferAddress() : (mode == "face" ? getFaceInputBufferAddress() : getPoseInputBufferAddress());
+            memcpy(input, encoded.data(), encoded.size());
+
+            recorder.start();
+            int ret = 0;
+            if (mode == "hand")
+            {
+                ret = execHand(frame.cols, frame.rows, maxNum, resizedFactor);
+            }
+            else if (mode == "face")
+            {
+                ret = execFace(frame.cols, frame.rows, maxNum);
+            }
+            else
+            {
+                ret = execPose(frame.cols, frame.rows, maxNum, resizedFactor, cropExtention);
+            }
+            recorder.stop(path);
+            if (ret != 0)
+            {
+                printf("[REPLAY] exec%s failed (%d) at %s\n", mode.c_str(), ret, path.c_str());
+                return 1;
+            }
+        }
+    }
+    recorder.summary();
+    return 0;
+}
@@ -0,0 +1,14 @@
+#include "threads.hpp"
+#include "platform.hpp"
+
+extern "C"
+{
+    // Applied to OpenCV immediately and to the models loaded after this call. numThreads: 1 - TFLITE_MAX_NUM_THREADS
+    EMSCRIPTEN_KEEPALIVE
+    int setNumThreads(int numThreads)
+    {
+        setTFLiteNumThreads(numThreads);
+        printf("[WASM] num threads: %d\n", tfliteNumThreads());
+        return 0;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef __TFLITE_THREADS_HPP__
+#define __TFLITE_THREADS_HPP__
+
+#include "opencv2/opencv.hpp"
+
+// Number of threads shared by the interpreters (XNNPACK delegate) and OpenCV parallel_for_ (resize, warpAffine).
+// More than 1 is effective only with the pthreads build (tflite-simd-threads).
+// Interpreters take this value when they are built, so set it before loading the models.
+// The threads come from the web workers the module starts with (PTHREAD_POOL_SIZE in BUILD): each of the
+// TFLITE_INTERPRETER_NUM interpreters keeps an XNNPACK pool of numThreads - 1 workers, OpenCV up to numThreads.
+// A worker cannot be added while wasm runs, so the count is capped to what the pool holds.
+constexpr int TFLITE_MAX_NUM_THREADS = 4;
+constexpr int TFLITE_INTERPRETER_NUM = 6;   // palm, hand landmark, face, face landmark, pose, pose landmark
+constexpr int TFLITE_THREAD_POOL_SIZE = TFLITE_INTERPRETER_NUM * (TFLITE_MAX_NUM_THREADS - 1) + TFLITE_MAX_NUM_THREADS;
+
+inline int &tfliteNumThreads()
+{
+    static int numThreads = 1;
+    return numThreads;
+}
+
+inline void setTFLiteNumThreads(int numThreads)
+{
+    tfliteNumThreads() = std::max(1, std::min(numThreads, TFLITE_MAX_NUM_THREADS));
+    cv::setNumThreads(tfliteNumThreads());
+}
+
+#endif // __TFLITE_THREADS_HPP__
@@ -0,0 +1,18 @@
+#include "stage_timer.hpp"
+#include "platform.hpp"
+
+extern "C"
+{
+    // Per-stage timing of execFace / execHand / execPose. Records of [frame, stage, msec], see stage_timer.hpp.
+    // nullptr / 0 unless built with --copt=-DENABLE_STAGE_TIMING
+    EMSCRIPTEN_KEEPALIVE
+    float *getTimingBufferAddress()
+    {
+        return stageTimingRecords();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int getTimingCount()
+    {
+        return stageTimingCount();
+    }
+}
@@ -61,5 +61,10 @@ module.exports = {
             directory: path.join(__dirname, "dist"),
         },
         https: true,
+        // cross-origin isolation, so that the page has SharedArrayBuffer for the pthreads build (tflite-simd-threads)
+        headers: {
+            "Cross-Origin-Opener-Policy": "same-origin",
+            "Cross-Origin-Embedder-Policy": "require-corp",
+        },
     },
 };